@@ -14,6 +14,32 @@ History:
 make some optimizations on the split phase to get a better performance and merge the sequential version of this algorithm into one program.
 4 Jack 01/20/2015 V4.0 remove the active part from the interface and put these into a configuration file
 5 Jack 01/24/2015 V5.0 get the start status automatically for each thread
+6 Jack 10/18/2026 V5.1 sample hardware performance counters for the split phase and for each thread in the process phase
+7 Jack 10/18/2026 V5.2 add the auto version which chooses the sequential or parallel version, the number of threads and the number of parts 
+by a calibrated cost model, and let each thread deal with several parts of the file
+8 Jack 10/18/2026 V5.3 balance the parts by the markup density of the file instead of the number of bytes
+9 Jack 10/18/2026 V5.4 generate a lexer specialized for the XPath as C source, which could be loaded as a plugin or built into the program
+10 Jack 10/18/2026 V5.5 support predicates on the attributes of the output tag(e.g [@age="35"], [@age>30], [@sex]), checked while the attributes are lexed
+11 Jack 10/18/2026 V5.6 support an attribute as the output(e.g /company/develop/programmer/@age), and keep all the outputs as spans of the XML text
+12 Jack 10/18/2026 V5.7 support the aggregations count(), sum(), min(), max() and distinct() over the outputs, computed for each part and merged
+13 Jack 10/18/2026 V5.8 stop dealing with the file once the first N outputs in document order are confirmed(limit in config)
+14 Jack 10/18/2026 V5.9 output the whole element(with its attributes and children) as a fragment of the file, stitched across the parts
+15 Jack 10/18/2026 V6.0 add the record mode for a file of many small XML documents, which are dealt with in batches and output in order
+16 Jack 10/18/2026 V6.1 add the batch mode for many files(a glob or a list), small files are dealt with as a whole and large files are split
+17 Jack 10/18/2026 V6.2 read gzip, BGZF and zstd(built with XPQ_ZSTD) files, decompressed in parallel or by a pipeline with the threads(link with -lz)
+18 Jack 10/18/2026 V6.3 read the XML from stdin or a pipe(File_Name=-), the parts are dealt with as the blocks are read and merged in document order
+19 Jack 10/18/2026 V6.4 add the query server over a UNIX socket, which keeps the threads, the mapped files and the compiled automata between the queries
+20 Jack 10/18/2026 V6.5 add the sharded execution: worker processes deal with byte ranges and write summaries, which are merged by a coordinator
+21 Jack 10/18/2026 V6.6 validate the tags while the parts are dealt with, the start and close tags not matched in each part are cancelled across the parts
+22 Jack 10/18/2026 V6.7 add the encoding stage by the BOM and the XML declaration: UTF-8 is validated, UTF-16 and the other encodings(e.g gb2312) are transcoded into UTF-8 by chunks in parallel
+23 Jack 10/18/2026 V6.8 report the line and column of the outputs, the fragments and the errors: the newlines of each part are counted by its thread, and the offsets are converted only when reported
+24 Jack 10/18/2026 V6.9 the stacks of states, the mappings and the automata grow as needed: a part keeps its states in small arrays and moves them to the heap only when it is deeper
+25 Jack 10/18/2026 V7.0 add the event API(XML_parallel.h) for the programs embedding the lexer: the parts keep their tokens as events, which are delivered in document order by batches(build with XPQ_LIBRARY)
+26 Jack 10/18/2026 V7.1 the lexer is driven by a table of the states and the classes of bytes, and the actions for the ends of the tokens are in one switch
+27 Jack 10/18/2026 V7.2 add the predicates on the text(text()=, contains(), starts-with()), which are checked in place when the text ends, contains() by a SSE2 substring search
+28 Jack 10/18/2026 V7.3 add the columnar result(column-output): the output and the attributes of its element are typed as int64, double or string columns by the parts in parallel and written into one file which can be mapped
+29 Jack 10/18/2026 V7.4 add decode-entities: an output with '&' is marked when it is saved, and only the marked outputs are decoded(&amp; &lt; &#NN; ...) when they are printed or written into the columns, and the values compared by the predicates or folded into the aggregations are decoded the same way
+30 Jack 10/18/2026 V7.5 add namespaces: the steps p:name are matched by the interned URI ids and the hashes of the local names, the declarations before each part are assumed from the elements enclosing the head of the file(the root and the wrappers) and folded over the parts afterwards, and the parts resolved otherwise are dealt with again, so a part whose prefixes are declared by other elements costs twice
 ***********************************************************/
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,8 +48,48 @@ make some optimizations on the split phase to get a better performance and merge
 #include <pthread.h>
 #include <malloc.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/file.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include <fcntl.h>
+#ifndef _WIN32
+#include <glob.h>
+#endif
+#include <zlib.h>
+#include <iconv.h>
+#include <strings.h>
+#ifdef XPQ_ZSTD
+#include <zstd.h>
+#endif
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#endif
+#include <signal.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
+#include "XML_parallel.h"
 
 /*data structure for each thread*/
 #define MAX_THREAD 10
@@ -31,62 +97,331 @@ pthread_t thread[MAX_THREAD];
 int thread_args[MAX_THREAD];
 int finish_args[MAX_THREAD];
 
+/*data structure for the parts of the file, each thread takes the next part until all of them are done*/
+#define MAX_PART 256
+int partCount=0; //the number of parts for the file
+int nextPart=0;  //the next part waiting to be dealt with
+pthread_mutex_t part_lock=PTHREAD_MUTEX_INITIALIZER;
+double part_time[MAX_PART]; //the duration for dealing with each part
+double part_setup[MAX_PART]; //the duration for preparing each part before it is lexed, a part of part_time
+long part_bytes[MAX_PART];  //the number of bytes in each part
+long part_tags[MAX_PART];   //the number of tags in each part(estimated by blocks)
+long part_offset[MAX_PART]; //the offset of each part in the file
+int firstPart=0; //the first part of the file whose results are merged(the batch mode keeps the parts of several files)
+
+/*data structure for the line numbers. The thread of each part counts its newlines(16 bytes at a time), and the lines before each part 
+are summed over the parts in document order; an offset is converted into its line and column only when it is reported, by counting the 
+newlines from the beginning of its part.*/
+typedef struct{
+	char* text;  //the text counted, e.g a part
+	long line0;  //the number of lines before text
+	long start0; //the offset in text where the line going on at text[0] begins(0 or negative)
+	long at;     //the offset in text of the last position found
+	long line;   //the line of at(from 1)
+	long start;  //the offset in text where the line of at begins
+}LineCursor;
+int lineMode=0;             //0--off 1--report the line and column of the outputs, the fragments and the errors
+long part_lines[MAX_PART];  //the number of newlines in each part
+long part_tail[MAX_PART];   //the number of bytes after the last newline of each part, -1 if there is no newline
+long line_base[MAX_PART];   //the number of lines before each part
+long column_base[MAX_PART]; //the number of bytes of the line going on at the beginning of each part
+long lineRun=0;             //the number of lines before the next part in document order
+long columnRun=0;           //the number of bytes of the line going on at the beginning of the next part
+
+/*data structure for the limit of outputs, the parts are confirmed in document order and the parts after the limit are cancelled*/
+#define LIMIT_PARTS 4  //parts for each thread when there is a limit, so that less of the file is dealt with after the limit
+int outputLimit=0;    //0--all the outputs N--only the first N outputs in document order
+int part_done[MAX_PART]; //1--this part has been dealt with
+int confirmedPart=0;  //all the parts before this one have been dealt with
+long long confirmedCount=0; //the number of outputs in the parts before confirmedPart
+volatile int limitPart=MAX_PART; //the parts from this one are not needed, they are skipped or cancelled
+
+/*data structure for the aggregation over the outputs(e.g count(/company/develop/programmer)), computed for each part*/
+typedef enum{
+	agg_none=0,agg_count,agg_sum,agg_min,agg_max,agg_distinct
+}agg_Kind;
+#define HLL_BITS 10  //distinct() is estimated by HyperLogLog with 2^HLL_BITS registers(about 3% error)
+#define HLL_REGISTERS (1<<HLL_BITS)
+#define DISTINCT_EXACT 1024  //distinct() is exact while there are no more distinct hashes than this
+typedef struct{
+	long long count;  //the number of outputs
+	long long numbers;//the number of outputs which are numbers
+	double sum;
+	double min;
+	double max;
+	unsigned char hll[HLL_REGISTERS];
+	int exact;        //the distinct hashes kept in hashes, -1--there are more than DISTINCT_EXACT, only the registers count
+	unsigned long long hashes[DISTINCT_EXACT];
+}Aggregate;
+agg_Kind aggKind=agg_none;
+char aggName[6][10]={"","count","sum","min","max","distinct"};
+Aggregate part_agg[MAX_PART]; //the partial aggregation of each part
+
+/*data structure for balancing the parts*/
+#define SPLIT_BLOCK 4096 //the markup density is counted for each block of this size
+int splitMode=0; //0--equal bytes for each part 1--equal estimated cost for each part
+double tagWeight=100; //the cost of a tag measured in bytes of text, refined by the duration of each part
+
+/*data structure for predicates on attributes and on the text(e.g [contains(text(),"yyy")])*/
+#define INIT_PRED 4 //the predicates of a tag at first, doubled when a tag has more
+#define SMALL_PRED_WORDS 2 //the bits of the predicates(64) checked in a small array by xml_process(), a tag with more takes the heap
+typedef enum {
+    pred_exist, /* [@xxx] */
+    pred_eq, /* [@xxx="yyy"] [text()="yyy"] */
+    pred_ne, /* [@xxx!="yyy"] */
+    pred_lt, /* [@xxx<1] */
+    pred_le, /* [@xxx<=1] */
+    pred_gt, /* [@xxx>1] */
+    pred_ge, /* [@xxx>=1] */
+    pred_contains, /* [contains(text(),"yyy")] */
+    pred_starts    /* [starts-with(text(),"yyy")] */
+}
+pred_Op;
+
+typedef struct{
+	char* name;  //the name of the attribute, "text()" for the text
+	int name_len;
+	pred_Op op;
+	char* value; //the value to be compared
+	int value_len;
+	int numeric; //1--the value is a number and compared as a number
+	double number;
+}Predicate;
+
 /*data structure for automata*/
 typedef struct{
 	int start;
 	char * str;
 	int end;
 	int isoutput; 
+	Predicate* pred; //the predicates on the attributes of this tag(only for start tags)
+	int predCount;
+	int maxPred;     //the capacity of pred
+	Predicate* textPred; //the predicates on the text of this tag, checked when the text ends(only for start tags)
+	int textPredCount;
+	int maxTextPred; //the capacity of textPred
+	char* outputAttr; //the attribute to be output instead of the text(e.g /xxx/@age), NULL for the text
+	int uri;          //with namespaces: the id of the URI of this step
+	unsigned int hash;//the hash of the local name
+	char* local;      //the local name(in str)
+	int local_len;
 }Automata;
 
 #define MAX_SIZE 50
-Automata stateMachine[MAX_SIZE];   //save automata for XPath
+#define INIT_MACHINE 16  //the nodes of the automata at first, doubled when an XPath has more steps
+Automata* stateMachine=NULL;   //save automata for XPath
+int maxMachine=0;   //the capacity of stateMachine
 
 int stateCount=0; //the number of states for XPath
 int machineCount=1; //the number of nodes for automata
+int useAttributes=0; //1--some attributes are needed by XPath, so the lexer can not skip them
+
+/*data structure for the lexer specialized for XPath*/
+typedef int (*TagMatcher)(const char* name, int len, int* begin, int* end);
+TagMatcher startMatcher=NULL; //the compiled matcher for start tags, NULL--interpret stateMachine
+TagMatcher endMatcher=NULL;   //the compiled matcher for end tags, NULL--interpret stateMachine
+int skipDeadStates=0; //1--jump over text, comments, CDATA and attributes which the XPath never uses
+#ifdef XPQ_STATIC
+extern const char xpq_query[];
+extern const int xpq_skip_dead_states;
+int xpq_match_start(const char* name, int len, int* begin, int* end);
+int xpq_match_end(const char* name, int len, int* begin, int* end);
+#endif
+
+/*data structure for the table-driven lexer. Each byte is mapped into a class, and the state with the class gives a rule: the next 
+state in the low byte and the action in the high byte. A byte which keeps the state without an action(most of the text, names and 
+values) has the state itself as its rule, so it costs two lookups and one compare. The tables take about 800 bytes, and they are 
+built again when a specialized lexer is loaded, so the skipping actions are only in the tables of a lexer which turns them on.*/
+#define LEX_STATES 21  //the states 0--19 of xml_process() and LEX_ERROR
+#define LEX_ERROR 20   //the markup is not correct
+#define LEX_CLASSES 12
+typedef enum{
+	lex_c_other=0,lex_c_lt,lex_c_gt,lex_c_slash,lex_c_question,lex_c_bang,lex_c_space,lex_c_dash,lex_c_lbracket,lex_c_rbracket,
+	lex_c_quote,lex_c_equal
+}lex_Class;
+typedef enum{
+	lex_a_none=0,lex_a_open,lex_a_name,lex_a_close_name,lex_a_head,lex_a_end,lex_a_begin,lex_a_name_end,lex_a_attributes,
+	lex_a_empty,lex_a_text,lex_a_skip_text,lex_a_cdata_open,lex_a_skip_comment,lex_a_comment,lex_a_attribute_name,
+	lex_a_value_open,lex_a_attribute_value,lex_a_skip_cdata,lex_a_cdata,lex_a_fail
+}lex_Action;
+unsigned char lexClass[256];  //the class of each byte
+unsigned short lexRule[LEX_STATES][LEX_CLASSES];  //the next state | the action<<8
+
+/*data structure for a span of the XML text*/
+typedef struct
+{
+    char *p;
+    int len;
+    int entity; //1--the output has '&', its references are decoded when it is printed(with decode-entities)
+}
+xml_Text;
+int decodeMode=0; //0--the outputs are printed as they are 1--the entity and character references of the outputs are decoded
+#define MAX_REFERENCE 10   //the longest reference between '&' and ';', e.g #x10FFFF
+#define DECODE_BUFFER 1024 //an output decoded in a buffer on the stack, a longer one in the heap
+
+/*data structure for a whole element as a fragment of the file, -1 for the begin(or end) which is in another part*/
+typedef struct{
+	long begin; //the offset of '<' of the start tag in the file, FRAG_REJECTED for an element rejected by the predicates
+	long end;   //the offset after '>' of the close tag in the file
+}Fragment;
+#define FRAG_REJECTED -2 //the element is not printed, it is kept only to pair its close tag
+int fragmentMode=0; //0--output the text of the tag 1--output the whole element as a fragment of the file
 
-/*data structure for the whole status stack*/
-#define MAX_OUTPUT 50000000
+/*data structure for the whole status stack. The stack and the queue of states are kept in the small arrays of the status, and 
+they move to the heap(doubled when they are full) only when the part is deeper in the tags of the automata.*/
+#define INIT_OUTPUT 1024
+#define SMALL_STATES 16 //the states kept in the status itself
 typedef struct status{
-	int stack[MAX_SIZE+1];
-	int queue[MAX_SIZE+1];
+	int* stack;     //small_stack, or the heap once it is full
+	int* queue;     //small_queue, or the heap once it is full
+	int maxstack;
+	int maxqueue;
+	int small_stack[SMALL_STATES];
+	int small_queue[SMALL_STATES];
 	int top_stack;
 	int bottom_stack;
 	int rear_queue;
 	int front_queue;
 	int hasOutput;
-	char** output;
+	xml_Text* output; //the outputs are kept as spans of the XML text in buffFiles
 	int topput;
+	int maxput; //the capacity of output, doubled when it is full
+	int exact; //1--the start state is known(the beginning of a record), 0--it is found from the first tag
+	Fragment* frag; //the fragments begun or ended in this part, in document order
+	int topfrag;
+	int maxfrag;
+	int* openfrag;  //the fragments whose close tag has not been met in this part
+	int topopen;
 }status;
 
-status state_stack[MAX_THREAD];
+status state_stack[MAX_PART];
 
+/*data structure for the columnar result(column-output in config). The output of XPath is the first column, and the attributes of 
+the output element listed by columns(e.g @age,@sex) are the columns after it; each part keeps them as spans for each output. The 
+parts are typed and converted by the tasks, then the columns are written in document order into one file which can be mapped: 
+ColumnHeader, one ColumnDesc for each column, and the data of each column from an offset aligned to 8 bytes, which is an int64 
+array of the values, a double array of the values, or the offsets(rows+1, int64) followed by the bytes of the strings.*/
+#define MAX_COLUMNS 16   //the attributes in the columns after the output
+#define COLUMN_NAME 48
+typedef enum{
+	col_string=0,col_int64,col_double
+}col_Type;
+typedef struct{
+	char magic[8];      //"XPQCOL1"
+	long long rows;
+	long long columns;
+}ColumnHeader;
+typedef struct{
+	int type;           //col_Type
+	int reserved;
+	long long offsets;  //the offset of the offsets in the file(a string column), 0 for the numbers
+	long long data;     //the offset of the bytes or the values in the file
+	long long bytes;    //the size of the bytes or the values
+	char name[COLUMN_NAME];
+}ColumnDesc;
+typedef struct{
+	int isInt;          //1--all the values of this column in this part are integers
+	int isNumber;       //1--all the values are numbers
+	long long bytes;    //the bytes of the strings
+	long long* ints;    //the values converted, for the numbers
+	double* reals;
+	char* decoded;      //the values which had references, decoded
+}ColumnPart;
+char* columnFile=NULL;  //the file of the columnar result, NULL--the outputs are printed as text
+char* columnNames[MAX_COLUMNS]; //the attributes of the output element in the columns(without '@')
+int columnCount=0;
+xml_Text* part_columns[MAX_PART]; //columnCount attributes for each output of a part, len is -1 if the attribute is missing
+xml_Text element_columns[MAX_PART][MAX_COLUMNS]; //the attributes of the output element being lexed by each part
+ColumnPart column_part[MAX_PART][MAX_COLUMNS+1]; //the typed columns of each part, column 0 is the output
+int column_rows[MAX_PART]; //the outputs of each part in the columns(the first N outputs if there is a limit)
 
-/*data structure for files in each thread*/
-char * buffFiles[MAX_THREAD]; 
+/*data structure for the namespaces(namespaces in config, e.g ns=http://x.com/a,=http://x.com/b). The URIs of the query are interned 
+as ids from 1, 0 is no namespace and NS_OTHER is any URI which is not in the query. A step p:name matches a tag whose prefix is bound 
+to the URI of p, by comparing the URI ids and the hashes of the local names(then the names themselves). Each part keeps the 
+declarations of its elements which are open with their levels. The declarations in scope at the beginning of a part are assumed to be 
+those of the elements enclosing the head of the file(the root and the wrappers which are not closed in NS_HEAD bytes); after all the 
+parts are done, the real ones are folded over the parts in document order, and a part whose prefixes are resolved otherwise by them is 
+dealt with again as a whole, so a prefix declared by an element below the wrappers and used across the parts doubles the cost of them.*/
+#define MAX_NAMESPACES 16
+#define NS_HEAD 65536  //the head of the first part scanned for the declarations assumed before the parts
+#define NS_OTHER -1    //a URI which is not in the query, or a prefix which is not declared
+#define NS_UNBOUND -2  //the prefix is not declared in this scope
+typedef struct{
+	char* prefix;   //the prefix in the XML text(not ended with '\0'), NULL for the default namespace
+	int prefix_len;
+	int uri;        //the id of the URI
+	int level;      //the level of the element declaring it, from the beginning of the part(or the document for the scope before it)
+}NsBinding;
+typedef struct{
+	NsBinding* bind; //the inner declarations at the top
+	int top;
+	int max;
+}NsScope;
+typedef struct{
+	char* prefix;   //a prefix resolved by the scope before the part, while it is assumed
+	int prefix_len;
+	int uri;        //the URI found(NS_UNBOUND if it is not declared)
+	int low;        //the lowest and highest depth reached in this part when it was resolved
+	int high;
+}NsLookup;
+typedef struct{
+	NsScope own;    //the declarations of the elements of this part which are open
+	NsScope before; //the declarations in scope at the beginning of this part
+	int exact;      //1--before and base are the real ones 0--before is assumed
+	int base;       //the level at the beginning of this part, when it is exact
+	int depth;      //the elements opened minus the elements closed in this part
+	int low;        //the lowest depth reached in this part, <0--the elements opened before this part are closed
+	NsLookup* used; //the prefixes resolved by the assumed scope
+	int topused;
+	int maxused;
+}NsPart;
+int nsMode=0;   //0--the steps are compared with the tag names 1--the steps are matched by the namespace URIs and the local names
+char* nsPrefixes[MAX_NAMESPACES]; //the prefixes of the query, "" for the steps without prefix
+int nsPrefixUri[MAX_NAMESPACES];  //the id of the URI of each prefix
+char* nsUris[MAX_NAMESPACES+1];   //the URIs of the query by id
+int nsPrefixCount=0;
+int nsUriCount=0;
+NsPart ns_part[MAX_PART];
+NsScope rootScope;  //the declarations of the elements enclosing the head of the file, assumed before the parts
+int rootScanned=0;
+int* nsRedo;        //the parts dealt with again, -1 for a part which fails
+pthread_mutex_t ns_lock=PTHREAD_MUTEX_INITIALIZER;
 
-/*data structure for elements in XML file*/
-typedef struct
-{
-    char *p;
-    int len;
-}
-xml_Text;
+/*data structure for the event API(XML_parallel.h). Each part keeps its events with the depth from its beginning, and the depth
+before each part is summed over the parts in document order when the events are delivered.*/
+typedef struct{
+	XpqEvent* event;
+	int top;
+	int max;
+	int depth;  //the depth at the end of the part, from 0 at its beginning(negative if it closes the elements of the parts before)
+	int failed; //1--the part is not correct XML
+	int done;   //1--the part has been lexed(or skipped), its events could be delivered
+}EventList;
+int eventMode=0; //1--the tokens are kept as events for xpq_events()
+volatile int eventStop=0; //1--the events are not needed any more, the parts which are not lexed yet are skipped
+pthread_cond_t event_ready=PTHREAD_COND_INITIALIZER;
+EventList part_events[MAX_PART];
 
-typedef enum {
-    xml_tt_U, /* Unknow */
-    xml_tt_H, /* XML Head <?xxx?>*/
-    xml_tt_E, /* End Tag </xxx> */
-    xml_tt_B, /* Start Tag <xxx> */
-    xml_tt_BE, /* Tag <xxx/> */
-    xml_tt_T, /* Content for the tag <aaa>xxx</aaa> */
-    xml_tt_C, /* Comment <!--xx-->*/
-    xml_tt_ATN, /* Attribute Name <xxx id="">*/
-    xml_tt_ATV, /* Attribute Value <xxx id="222">*/
-    xml_tt_CDATA/* <![CDATA[xxxxx]]>*/
-}
-xml_TokenType;
+/*data structure for hardware performance counters*/
+#define PERF_COUNTERS 6
+typedef struct{
+	int fd[PERF_COUNTERS];
+	long long value[PERF_COUNTERS];  //-1--this counter is not available
+	int enabled;  //0--no counter could be opened 1--counters are working
+}PerfCounter;
+
+int perfMode=0; //0--no hardware counters 1--sample hardware counters around each phase
+int perfWarned=0; //whether the "not available" message has been printed
+PerfCounter perf_split; //counters for the split phase (main thread)
+PerfCounter perf_process[MAX_THREAD]; //counters for the process phase of each thread
+char perfName[PERF_COUNTERS][MAX_SIZE]={"cycles","instructions","branches","branch-misses","cache-references","cache-misses"};
 
+
+/*data structure for files in each part*/
+char * buffFiles[MAX_PART]; 
+FILE* resultFile; //the results are printed into this file: stdout, or the reply of the query server
+
+/*data structure for elements in XML file(xml_TokenType is in XML_parallel.h)*/
 typedef struct
 {
     xml_Text text;
@@ -95,34 +430,339 @@ typedef struct
 xml_Token;
 
 #define MAX_LINE 100
-static char multiExpContent[MAX_THREAD][MAX_LINE];  //save for multi-line explanations
-static char multiCDATAContent[MAX_THREAD][MAX_LINE]; //save for multi-line CDATA
+
+/*data structure for the validation of the tags. Each part keeps the close tags whose start tag is in an earlier part and the start 
+tags which are not closed in it, and the parts are merged in document order, so the tags of adjacent parts cancel each other.*/
+typedef struct{
+	char* p;   //the name of the tag, a span of the part(or a copy in the merged check)
+	int len;
+	long at;   //the offset of '<' of the tag in the file
+	long line; //the merged check: the line and column of at, with line-numbers
+	long column;
+}TagName;
+typedef struct{
+	TagName* open;  //the start tags which are not closed, in document order(the merged check: the stack of the file so far)
+	int topopen;
+	int maxopen;
+	TagName* close; //the close tags whose start tag is before this part, in document order
+	int topclose;
+	int maxclose;
+	int owned;      //1--the names are copies, which are freed with the check
+	long error;     //the offset of the first error, -1 for none
+	char reason[MAX_LINE*2]; //what the first error is
+	long unfinished;//the offset of the markup which is not finished at the end of the part, -1 for none
+	int parts;      //the merged check: the number of parts merged
+	long line;      //the merged check: the line and column of the first error, with line-numbers
+	long column;
+	long endline;   //the merged check: the line and column of the markup not finished
+	long endcolumn;
+}TagCheck;
+int validateMode=0;  //0--off 1--check that the tags are well-formed and balanced while the parts are dealt with
+TagCheck part_check[MAX_PART];
+TagCheck checkSet;   //the check of the parts merged so far
+
+/*data structure for the compressed input(gzip, BGZF and zstd), which is decompressed straight into memory*/
+typedef enum{
+	comp_none=0,comp_gzip,comp_bgzf,comp_zstd
+}comp_Kind;
+#define GZ_SPAN (4*1024*1024) //an access point of the gzip index for each span of the uncompressed bytes
+#define GZ_WINDOW 32768       //the bytes before an access point needed to inflate from it
+typedef struct{
+	long out;  //the offset in the uncompressed bytes
+	long in;   //the offset in the compressed bytes
+	int bits;  //the bits of the byte before in which belong to the next block
+	unsigned char window[GZ_WINDOW];
+}AccessPoint;
+int inflateThreads=1;   //the number of threads to decompress the input
+int streamInput=0;      //1--the parts are published by the decompression pipeline while the threads deal with them
+int inputDone=1;        //0--the pipeline may publish more parts
+pthread_cond_t part_ready=PTHREAD_COND_INITIALIZER; //signalled when a part is published or the pipeline ends
+/*the tasks of the parallel decompression, each task fills its own range of the uncompressed bytes*/
+int taskCount=0;
+int nextTask=0;
+unsigned char* taskData;  //the compressed file
+char* taskOut;            //the uncompressed bytes
+long* taskIn;             //the compressed bytes of each task
+long* taskInLen;
+long* taskOutOff;         //the uncompressed bytes of each task
+long* taskOutLen;
+AccessPoint* taskPoint;   //the access point of each task(gzip index), NULL for BGZF and zstd
+int taskFailed=0;
+
+/*data structure for the encoding of the input, which is found by the BOM and the XML declaration. UTF-8 is validated, and UTF-16 
+or another declared encoding(e.g gb2312, by iconv) is transcoded into UTF-8 before the lexer. The content is cut into chunks whose 
+edges are at the boundaries of the characters, and the chunks are validated or transcoded in parallel by the tasks.*/
+typedef enum{
+	enc_utf8=0,enc_utf16le,enc_utf16be,enc_other
+}enc_Kind;
+#define ENC_CHUNK (4*1024*1024) //the bytes of the input for each task
+#define ENC_HEAD 256            //the bytes looked at for the BOM and the XML declaration
+int encodingMode=0;       //0--the bytes are dealt with as they are 1--validate UTF-8 and transcode the other encodings into UTF-8
+char encodingName[MAX_LINE]; //the encoding declared, for iconv
+char** taskTemp;          //the output of each task of iconv, NULL--the chunk is ASCII and copied as it is
+long* taskBad;            //the offset of the first byte which is not valid in each task, -1 for none
+
+/*data structure for the batch mode, the files are dealt with in rounds whose parts are taken by the threads together*/
+#define BATCH_SPLIT_SIZE (4*1024*1024)   //a file larger than this is split, a smaller one is dealt with as a whole by one thread
+#define BATCH_ROUND_SIZE (128*1024*1024) //the bytes of files loaded into memory for each round, two rounds are kept at a time
+#define BATCH_ROUND_PARTS (MAX_PART/2)   //the parts for each round, a round is loaded into one half of the parts while the other is dealt with
+char* batchFiles=NULL; //a glob(e.g shards/*.xml) or @ with a file of names(one for each line), NULL--only File_Name
+typedef struct{
+	char* name;
+	long size;
+	int parts; //the number of parts for this file
+	int first; //the first part of this file in this round, -1--can't be loaded
+	int last;
+}BatchFile;
+
+/*data structure for the record mode, a file of many small XML documents is dealt with as records in batches*/
+#define RECORD_BATCH 256 //records for each batch taken by a thread
+int recordMode=0; //0--one document 1--records separated by recordDelimiter 2--each top-level document is a record
+char recordDelimiter[MAX_LINE]="\n";
+long recordCount=0;
+long* record_begin;  //the offset of each record in buffFiles[0]
+long* record_len;
+int* record_out;     //the outputs of record r end at record_out[r] in the outputs of its batch
+float* record_latency; //the duration from taking each record until it is output(in microseconds)
+double* record_taken; //the time when each record is taken by a thread(in microseconds from recordClock)
+struct timespec recordClock; //the beginning of the record mode
+long batchCount=0;
+long nextBatch=0;    //the next batch waiting to be dealt with
+long emitBatch=0;    //the next batch waiting to be output, the batches are output in order
+xml_Text** batch_out; //the outputs of each batch, kept until the batch is output
+int* batch_done;
+
+/*data structure for the query server, which keeps the threads, the mapped files and the compiled automata between the queries. 
+A request is a frame(4 bytes of length in network order, then the bytes) with the lines File_Name=xxx and XPath=xxx, and the reply 
+is a frame with the results.*/
+#define SERVER_FILES 8      //the files kept in the cache
+#define SERVER_QUERIES 32   //the automata kept in the cache
+#define MAX_REQUEST 65536   //the largest frame of a request
+#define MAX_CLIENTS 64      //the connections polled by the server at the same time
+#define CLIENT_TIMEOUT 5    //the seconds a client could take to read its reply before it is dropped
+typedef struct{
+	char* name;      //NULL--this entry is empty
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;    //the file is loaded again once it is changed
+	char* content;   //the mapped file, or the decompressed content of a compressed file
+	long length;
+	int mapped;      //1--content is mapped 0--content is in the memory from malloc
+	int parts;       //the number of parts asked for the structural index
+	int count;       //the number of parts which are not empty
+	long* point;     //the structural index: the beginning of each part, at an open angle bracket
+	unsigned long used; //the last query on this file, the least recently used entry is dropped
+}CachedFile;
+typedef struct{
+	char* xpath;     //NULL--this entry is empty
+	Automata* machine;
+	int maxMachine;
+	int machineCount;
+	int stateCount;
+	int useAttributes;
+	agg_Kind aggKind;
+	unsigned long used;
+}CachedQuery;
+typedef struct{
+	int fd;
+	unsigned int head;   //the length of the frame in network order
+	unsigned int got;    //the bytes of the frame received, with the 4 bytes of length
+	unsigned int len;
+	char* data;          //the bytes of the request, NULL until its length is received
+}Connection;             //a request is received by pieces, so a client which stalls does not block the others
+int serverMode=0;        //0--off 1--serve the queries over a UNIX socket 2--send the query to the server
+char* serverSocket=NULL; //the path of the UNIX socket
+int serverWorkers=1;     //the threads of the pool
+CachedFile fileCache[SERVER_FILES];
+CachedQuery queryCache[SERVER_QUERIES];
+unsigned long serverClock=0; //the number of queries, for the least recently used entries
+int poolJob=0;           //the number of the job(a query, or a round of the batch mode) for the pool, a thread waits until it is changed
+int poolBusy=0;          //the threads still dealing with the job
+int poolSize=0;          //the threads of the pool
+pthread_cond_t job_ready=PTHREAD_COND_INITIALIZER;
+pthread_cond_t job_done=PTHREAD_COND_INITIALIZER;
+int serverLimit=0;       //the limit and the output-mode in config, for each query
+int serverFragment=0;
+
+/*data structure for the sharded execution. Each worker process deals with a byte range of the file and writes the summary of its 
+parts(the mappings, outputs, partial aggregations and fragments), and the coordinator merges the summaries in document order.*/
+#define SHARD_MAGIC "XPQSHRD1"
+int shardMode=0;           //0--off 1--worker 2--coordinator
+int shardCount=0;          //the number of worker processes launched by the coordinator
+long shardBegin=0;         //the byte range of the worker, the end 0--the end of the file
+long shardEnd=0;
+char* shardOutput=NULL;    //the file(or named pipe) for the summary of the worker
+char* shardSummaries=NULL; //a glob(@ with a file of names on Windows) of the summaries written by the workers, merged by the coordinator without launching workers
 
 #define MAX_ATT_NUM 50
 char tokenValue[MAX_ATT_NUM][MAX_ATT_NUM]={"UNKNOWN","HEAD","NODE_END","NODE_BEGIN","NODE_BEGIN_END","TEXT","COMMENT","ATTRIBUTE_NAME","ATTRIBUTE_VALUE","CDATA"};
 char defaultToken[MAX_ATT_NUM]="WRONG_INFO";
 
-/*data structure for mapping result*/
+/*data structure for mapping result, the stacks are doubled when they are full(the mapping of one part is a view of its status)*/
 typedef struct ResultSet
 {
 	int begin;
-	int begin_stack[MAX_SIZE];
+	int* begin_stack;
 	int topbegin;
+	int maxbegin;
 	int end;
-	int end_stack[MAX_SIZE];
+	int* end_stack;
 	int topend;
+	int maxend;
 }ResultSet;
 
+/*data structure for the input from stdin or a pipe(File_Name=-), the parts are published as the blocks are read and merged in 
+document order as soon as they are done, so a slot of the parts is used again by a later part(part k uses the slot k%MAX_PART)*/
+#define STDIN_BLOCK (4*1024*1024) //the bytes of each part read from stdin
+int stdinInput=0;          //1--the parts are read from stdin while the threads deal with them
+int mergedParts=0;         //the parts before this one have been merged and their slots are free
+volatile int stopInput=0;  //1--the first N outputs have been printed, no more blocks are read
+ResultSet streamSet;       //the mapping of the parts merged
+int streamMerged=0;        //the number of parts merged into streamSet
+Aggregate streamTotal;     //the aggregation of the parts merged
+long long streamOutputs=0; //the number of outputs printed
+int streamFailed=0;        //1--the mappings of the parts can not be merged, no more outputs are printed
+long streamTicket=0;       //the number of the next outputs copied by merge_stream
+long printTicket=0;        //the number of the next outputs to be printed
+pthread_mutex_t print_lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t print_turn=PTHREAD_COND_INITIALIZER;
+
+
+/*data structure for the cost model of the auto version (all the costs are in seconds)*/
+typedef struct{
+	double text_cost;   //cost for each byte of text content
+	double markup_cost; //cost for each byte of markup
+	double tag_cost;    //cost for each tag
+	double thread_cost; //cost to create and wait for one thread
+	double part_cost;   //cost to prepare one part(buffers and state stack)
+	int runs;           //the number of runs this model has been calibrated with
+}CostModel;
+CostModel costModel={1.5e-9,4e-9,1.5e-7,1e-4,5e-5,0};
+char calibrationFile[MAX_SIZE]="calibration"; //the calibration of the cost model is kept here between runs
+
+/*data structure for the sample of an XML file*/
+#define SAMPLE_SIZE 65536  //bytes for each of the three samples(head, middle, tail)
+#define MIN_PART_SIZE 65536  //a part smaller than this costs more to set up than to deal with
+#define PART_IMBALANCE 0.25  //the last part to finish is late by this fraction of one part
+#define CALIBRATION_RATE 0.5 //how far each run moves the cost model towards the measurement
+typedef struct{
+	long size;
+	double tag_density;   //tags for each byte
+	double text_fraction; //bytes outside markup for each byte
+}FileSample;
 
 /*before thread creation*/
-int load_file(char* file_name); //load XML into memory(only used for sequential version)
-int split_file(char* file_name, int n);  //split XML file into several parts and load them into memory
+int load_file(char* file_name, int first); //load XML into memory as one part
+int split_file(char* file_name, int n, int first);  //split XML file into several parts and load them into memory
+long* cut_points(char* content, long size, int n, int* count); //find where each part begins, at an open angle bracket
+char* load_content(char* file_name, long* size); //load the whole file into memory, decompressing it if it is compressed
+unsigned char* read_whole(char* file_name, long* size); //read the whole file into memory without decompressing it
+comp_Kind detect_compression(unsigned char* data, long size); //find the compression by the magic number
+comp_Kind file_compression(char* file_name); //find the compression of a file by its first bytes
+void publish_content(char* p, long len, long offset); //copy the decompressed bytes into a new part and publish it
+char* gunzip(unsigned char* data, long size, long* out_size, char* index_name, long parts); //inflate gzip sequentially, building the index
+char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name); //decompress the tasks in parallel
+void run_tasks(int threads, void (*task)(int)); //run taskCount tasks by several threads
+void inflate_task(int k); //inflate the deflate data of one task
+int save_gz_index(char* index_name, long in_size, long out_size, AccessPoint* point, int count); //save the access points of a gzip file
+AccessPoint* load_gz_index(char* index_name, long in_size, long* out_size, int* count); //load the access points of a gzip file
+int stream_input(char* file_name); //whether the file should be dealt with by the decompression pipeline
+int stream_parts(char* file_name, int parts); //decompress the file and publish the parts while the threads deal with them
+long publish_blocks(char* data, long size, long offset, int last); //publish the full blocks of the bytes read from stdin
+int stdin_parts(void); //read stdin by blocks and publish the parts while the threads deal with them
+int count_char(char* s, long len, char c); //count a character in a string, 16 bytes at a time if SSE2 is supported
+void count_lines(int i); //count the newlines of one part
+void next_line_base(int i); //take the lines before one part, which is the next one in document order
+void line_bases(int first, int n); //sum the lines before each part
+void init_cursor(LineCursor* c, char* text, long line, long column); //begin to find the positions in a text
+void find_position(LineCursor* c, long at, long* line, long* column); //convert an offset of the text into its line and column
+void part_position(int i, long offset, long* line, long* column); //convert an offset of the file in one part into its line and column
+void print_position(long line, long column); //print a line and column, with line-numbers
+int is_ascii(char* s, long len); //whether all the bytes are ASCII, 16 bytes at a time if SSE2 is supported
+enc_Kind detect_encoding(unsigned char* data, long size, char* name); //find the encoding by the BOM and the XML declaration
+int must_load(char* file_name); //whether the file must be loaded by load_content instead of being mapped
+char* decode_content(char* content, long* size, char* source); //validate UTF-8 or transcode the content into UTF-8
+long validate_utf8(char* content, long size); //validate UTF-8 by chunks in parallel
+long utf8_invalid(unsigned char* s, long len); //find the first byte which is not valid UTF-8, 16 bytes at a time for ASCII
+long utf16_to_utf8(unsigned char* s, long len, int big, char* out, long* bad); //transcode UTF-16, or count the bytes of UTF-8
+void utf8_task(int k); //validate UTF-8 in one chunk
+void utf16_count_task(int k); //count the bytes of UTF-8 for one chunk of UTF-16
+void utf16_task(int k); //transcode one chunk of UTF-16 into its range of the content
+void iconv_task(int k); //transcode one chunk of the declared encoding by iconv
+void copy_task(int k); //copy the output of one chunk of iconv into its range of the content
+void balance_points(char* content, long size, int n, long* point); //choose the cutting points with equal estimated cost
+void refine_split(int parts); //refine the weight of a tag by the duration of each part
 char* ReadXPath(char* xpath_name);  //load XPath into memory
-void createAutoMachine(char* xmlPath);   //create automachine for XPath.txt
+char* trim_value(char* s); //remove the blanks and the end of line after a value in config
+int read_config_line(char** buf, int* size, FILE* fp); //read a whole line of config
+int createAutoMachine(char* xmlPath);   //create automachine for XPath.txt
+void grow_automata(void); //make room for the two nodes of the next step of XPath
+char* next_step(char** cursor); //get the next step of XPath, the '/' in predicates is kept
+int parse_predicates(char* s, Automata* node); //parse the predicates(e.g [@age="35"]) of a step
+Predicate* grow_predicates(Predicate* pred, int* max); //double the predicates of a tag
+int generate_lexer(char* file_name, char* xpath); //write the C source of a lexer specialized for XPath
+int load_lexer(char* plugin_name, char* xpath); //use the specialized lexer from a plugin(or built into this program)
+void build_lexer(void); //fill the tables of the lexer for skipDeadStates
+void lex_rule(int state, int cls, int next, int action); //set the next state and the action of a state for a class of bytes
 
 /*main functions for each thread*/
 void push(int thread_num,int nextState); //push new element into stack
+int add_event(int thread_num, int type, char* p, long len); //keep a token as an event of this part
+void end_event(int thread_num, int ev, int type, char* p); //finish the event of a start tag at its end
+void event_task(int k); //deal with one part for xpq_events()
+void enqueue(int thread_num,int nextState); //append a state to the start queue
+int* grow_states(int* s, int* small, int* max); //double a stack of states, a small array moves to the heap
+void reset_states(int i); //empty the stack and the queue of states of a part
+void add_output(int thread_num, char* p, int len); //save an output span for this part
+void aggregate_output(Aggregate* agg, char* p, int len); //fold an output into the partial aggregation
+int add_fragment(int thread_num, long begin, long end); //save a fragment(or a part of it) for this part
+void open_fragment(int thread_num, char* p, int passed); //a start tag of the output begins a fragment
+void close_fragment(int thread_num, char* p); //a close tag of the output ends the last fragment
+int match_start_tag(char* name, int len, int* begin, int* end); //look for a start tag in the automata
+int match_end_tag(char* name, int len, int* begin, int* end); //look for an end tag(e.g /xxx) in the automata
+char* skip_attributes(char* p, char* end); //jump to the end of a tag without looking at its attributes
+void check_attribute(int node, char* name, int name_len, char* value, int value_len, unsigned int* bits); //check an attribute against the predicates
+int predicates_passed(int node, unsigned int* bits); //whether all the predicates of a tag are satisfied
+unsigned int* clear_predicates(unsigned int* bits, unsigned int* small, int* words, int count); //empty the bits of the predicates of a tag
+int compare_value(Predicate* pred, char* value, int value_len); //compare a value in the XML text by a predicate
+int text_passed(int node, char* text, int len); //whether the text of a tag satisfies all its text predicates
+void keep_column(int thread_num, char* name, int name_len, char* value, int value_len); //keep an attribute of the output element for the columns
+void check_tag(int thread_num, char* name, int len, int close); //match a tag against the start tags not closed in this part
+void check_error(int thread_num, char* p, char* reason); //keep the first error of this part
  void pop(int next, int thread_num); //pop element due to end_tag e.g</d>
+int deal_part(int i); //initialize the state stack for one part and deal with it
+long find_records(char* content, long size); //find the beginning and the length of each record
+char* find_string(char* s, long len, char* sub, long sublen); //look for a string in a buffer which may not end with '\0'
+int deal_record(int t, long r); //deal with one record with the known start state
+void *record_thread(void *arg); //main function for each thread in the record mode
+void emit_batches(); //output the batches which are done, in order
+int record_main(int workers); //deal with all the records and print the throughput and latency
+double record_time(void); //the time from the beginning of the record mode
+int batch_main(char* pattern, int workers); //deal with many files by one scheduler
+long load_round(BatchFile* files, BatchFile** order, long from, long count, int base, int* end); //load the files of a round of the batch mode
+int server_main(char* socket_name, int workers); //serve the queries over a UNIX socket until it is killed
+int serve_client(Connection* c); //receive a piece of the query from a client, deal with it and send the reply once it is complete
+int receive_frame(Connection* c, unsigned int max); //receive the bytes of a frame which are ready without waiting for the rest
+void *pool_thread(void *arg); //main function for each thread of the pool, which deals with the parts of each job
+void start_pool(int workers); //start the threads of the pool, which are kept for all the jobs
+void pool_job(int first, int last); //give the parts of a job to the pool
+void pool_wait(void); //wait until the pool has dealt with all the parts of the job
+CachedFile* lookup_file(char* file_name, int parts); //get the file and its parts from the cache, or load it
+int compile_query(char* xpath); //get the automata from the cache, or create it
+void free_automata(Automata* machine, int count); //free the names, predicates and attributes of an automata
+void serve_query(char* file_name, char* xpath); //deal with one query and print the results into resultFile
+int read_frame(int fd, char** data, unsigned int* len, unsigned int max); //read a frame of the protocol
+int write_frame(int fd, char* data, unsigned int len); //write a frame of the protocol
+int query_server(char* socket_name, char* file_name, char* xpath); //send the query to the server and print the reply
+int shard_worker(char* file_name, long begin, long end, FILE* out, int workers, int parts); //deal with a byte range and write its summary
+int write_summary(FILE* out, long begin, long end, int count); //write the mappings, outputs and fragments of the parts
+int read_summary_head(FILE* in, long* begin, long* end, int* count); //read the range and the number of parts of a summary
+int read_summary_parts(FILE* in, int first, int count); //read the parts of a summary into the state stacks
+int write_names(FILE* out, TagName* name, int count); //write the tags kept by a part for the validation
+int read_names(FILE* in, TagName** name, int* count); //read the tags kept by a part for the validation
+int shard_main(char* file_name, int shards, int workers, int parts, char* summaries); //launch the workers and merge their summaries
+void publish_part(int i); //confirm the parts in document order and find the parts which are not needed for the limit
 int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);  //parse and deal with every element in an xmlText, return value:0--success -1--error 1--multiline explantion 2--multiline CDATA
 
 /*functions called by each thread*/
@@ -135,1118 +775,7016 @@ int left_null_count(char *s);  //calculate the number of blanket for each string
 
 /*get and merge the mappings for the result*/
 ResultSet getresult(int n);
+void put_state(int** s, int* top, int* max, int state); //append a state to a stack of the mapping
+void free_result(ResultSet* set); //free the stacks of a mapping
+int merge_part(ResultSet* final_set, int i, int* merged); //merge the mapping of one part into the final mapping
+char* merge_stream(int k, size_t* size); //merge the parts read from stdin in document order and copy out their outputs
+void print_stream(char* text, size_t size, long ticket); //print the outputs copied by merge_stream in the order they were merged
 void print_result(ResultSet set,int n);
+int write_columns(ResultSet set, char* file_name, int n, int workers); //write the outputs and their attributes into a file by columns
+void column_task(int k); //type and convert the columns of one part
+int parse_number(char* p, int len, long long* integer, double* real); //convert a value into an integer or a number
+int find_amp(char* s, int len); //find the first '&' of a span, 16 bytes at a time if SSE2 is supported
+int decode_entities(char* s, int len, char* out); //decode the entity and character references of a span
+char* decode_value(char* p, int* len, char* local); //decode a value compared or aggregated in place, with decode-entities
+int decode_reference(char* s, int len, char* out); //decode one reference(without '&' and ';')
+void print_text(FILE* f, xml_Text* t); //print an output, decoding its references if it has '&'
+int parse_columns(char* list); //get the attributes in the columns from the list in config
+int parse_namespaces(char* list); //get the prefixes and the URIs of the query from the list in config
+int resolve_steps(void); //find the URI id and the local name of each step of the automata
+int intern_uri(char* uri, int len); //get the id of a URI, NS_OTHER if it is not in the query
+unsigned int name_hash(char* name, int len); //the hash of a local name
+void declare_namespaces(NsScope* scope, char* p, char* end, int level); //keep the namespace declarations of a tag
+void add_binding(NsScope* scope, char* prefix, int prefix_len, int uri, int level); //append a declaration to a scope
+int scope_uri(NsScope* scope, char* prefix, int prefix_len, int level); //find the URI of a prefix in a scope
+int resolve_prefix(int thread_num, char* prefix, int prefix_len); //find the URI of a prefix for the current tag of a part
+void note_lookup(NsPart* s, char* prefix, int prefix_len, int uri); //keep a prefix resolved by the assumed scope
+int match_ns_tag(int thread_num, char* name, int len, int close, int* begin, int* end); //look for a tag in the automata by its URI and local name
+void open_element(int thread_num); //a start tag opens an element of the part
+void close_element(int thread_num); //an element of the part is closed, its declarations go out of scope
+void reset_namespaces(int i); //empty the scopes of a part, the scope before it is assumed if it is not known
+void root_namespaces(void); //keep the declarations of the elements enclosing the head of the file, which are assumed before the parts
+int resolve_namespaces(int n, int workers); //fold the scopes over the parts and deal with the parts resolved otherwise again
+void redo_task(int k); //deal with a part again with the real scope before it
+char* parse_aggregate(char* xpath); //get the aggregation and the path inside it
+int merge_aggregates(ResultSet set, int n, Aggregate* total); //combine the partial aggregations of all the parts
+void add_aggregate(Aggregate* total, Aggregate* part); //combine the partial aggregation of one part
+void add_hash(Aggregate* agg, unsigned long long h); //keep a distinct hash until there are too many for an exact distinct()
+void stitch_fragments(int n); //join the fragments which begin and end in different parts
+int print_fragments(char* file_name, int n); //print the fragments from the file mapped into memory
+void write_fragments(char* map, long size, int n); //print the fragments from the content of the file
+void print_aggregate(ResultSet set, int n);
+void print_total(Aggregate* total); //print the aggregation, NULL--the mappings can not be merged
+void init_check(TagCheck* check); //empty a check of the tags
+void merge_check(TagCheck* set, int i); //cancel the tags of one part against the start tags not closed before it
+void print_check(TagCheck* set); //print whether the file is well-formed, or its first error
+
+/*the cost model for the auto version*/
+int sample_file(char* file_name, FileSample* fs); //estimate the size, tag density and text fraction of the file
+double predict_cost(FileSample* fs, int workers, int parts); //predict the duration for dealing with the file
+void choose_plan(FileSample* fs, int* choose, int* workers, int* parts); //choose the version, the number of threads and parts
+void load_calibration(char* name); //load the calibrated cost model
+void save_calibration(char* name); //save the calibrated cost model
+void calibrate(FileSample* fs, int choose, int workers, int parts, double duration); //tune the cost model by the measured duration
+
+/*hardware performance counters for each phase*/
+void perf_start(PerfCounter *pc);  //open and enable the counters for the calling thread
+void perf_stop(PerfCounter *pc);   //disable, read and close the counters
+void perf_print(char *phase, PerfCounter *pc);  //print the counts together with IPC and miss rates
 
 
 /*************************************************
-Function: int split_file(char* file_name,int n);
-Description: split a large file into several parts according to the number of threads for this program, while keeping the split XML files into the memory
-Called By: int main(void);
-Input: file_name--the name for the xml file; n--the number of threads for this program
-Return: the number of threads(start with 0); -1--can't open the XML file
+Function: int split_file(char* file_name, int n, int first);
+Description: split a large file into several parts, while keeping the split XML files into the memory. The whole file is loaded at first, 
+and the cutting points divide it into parts with equal bytes(split-mode 0) or equal estimated cost(split-mode 1). Then each cutting point 
+is moved forward to the next open angle bracket, so that every part except the first one starts with a tag. A part which would be empty is dropped.
+The parts are spans of the loaded content, which is not copied: the first part begins with it, so it is freed once by the first part.
+Called By: int main(void); int batch_main(char* pattern, int workers);
+Input: file_name--the name for the xml file; n--the number of parts for this program; first--the number of the first part
+Return: the number of the last part; -1--can't open the XML file
 *************************************************/
-int split_file(char* file_name,int n)
+int split_file(char* file_name, int n, int first)
 {
-	FILE *fp;
-    int i,j,k,one_size;
-    int size;
-    fp = fopen (file_name,"rb");
-    if (fp==NULL) { return -1;}
-    fseek (fp, 0, SEEK_END);   
-    size=ftell (fp);
-    rewind(fp);
-    one_size=(size/n)+1;
-    n=n-1;
-    char ch=-1;
-    int temp_one_size=0;
-    int s;
-    for (i=0;i<n;i++)
-    {
-    	s=0;
-        buffFiles[i]=(char*)malloc((one_size+MAX_LINE)*sizeof(char));
-        if(ch!=-1)
-        {
-    	    buffFiles[i][0]=ch;
-    	    buffFiles[i][1]='\0';
-    	    char * buff=(char*)malloc((one_size)*sizeof(char));
-    	    k = fread (buff,1,one_size-1,fp);
-    	    buff[one_size-1]='\0'; 
-    	    buffFiles[i]=strcat(buffFiles[i],buff);
-    	    free(buff);
-	    }
-	    else
-	    {
-	    	k = fread (buffFiles[i],1,one_size,fp);
-		}
-        /*skip the default size to look for the next open angle bracket*/
-        ch=fgetc(fp);
-        while(ch!='<')
-        {
-        	buffFiles[i][one_size+(s++)]=ch;
-        	ch=fgetc(fp);
-        	temp_one_size++;
-		}
-		buffFiles[i][one_size+s]='\0';
-    }
-    j = size % one_size-temp_one_size;
-    if (j!=0) {
-    buffFiles[n]=(char*)malloc((j+1)*sizeof(char));
-    if(ch!=-1)
-    {
-    	buffFiles[n][0]=ch;
-    	buffFiles[n][1]='\0';
-    	char * buff=(char*)malloc((j+1)*sizeof(char));
-    	k = fread (buff,1,j,fp);
-    	buff[j+1]='\0'; 
-    	buffFiles[n]=strcat(buffFiles[n],buff);
-    	buffFiles[n][j]='\0'; 
-    	free(buff);
-	}
-    else
+    int i,k,count;
+    long size,begin,end;
+    char* content=load_content(file_name,&size);
+    if (content==NULL) { return -1;}
+    long* point=cut_points(content,size,n,&count);
+    k=first;
+    for (i=0;i<count;i++)
     {
-    	k = fread (buffFiles[n],1,j,fp);
-        buffFiles[n][j]='\0';  
+    	begin=point[i];
+    	end=point[i+1];
+    	buffFiles[k]=content+begin;  //the first part begins with the content, since the first cutting point is 0
+    	part_offset[k]=begin;
+    	part_bytes[k]=end-begin;
+    	part_tags[k]=count_char(buffFiles[k],end-begin,'<');
+    	k++;
 	}
-	
-    }
-    fclose(fp);
-    return n;
+	free(point);
+	if(k==first)
+	{
+		buffFiles[k]=content;
+		part_offset[k]=0;
+		part_bytes[k]=0;
+		part_tags[k]=0;
+		k++;
+	}
+    return k-1;
 }
 
 /*************************************************
-Function: int load_file(char* file_name);
-Description: load the XML file into memory(only used for sequential version)
-Called By: int main(void);
-Input: file_name--the name for the xml file
-Return: 0--load successful; -1--can't open the XML file
+Function: int count_char(char* s, long len, char c);
+Description: count a character in a string. With SSE2, 16 bytes are compared at a time and the matches are counted from the bit mask.
+Called By: int split_file(char* file_name, int n, int first); void balance_points(char* content, long size, int n, long* point);
+Input: s--the string; len--the length of the string; c--the character
+Return: the number of this character in the string
 *************************************************/
-int load_file(char* file_name)
+int count_char(char* s, long len, char c)
 {
-	FILE *fp;
-    int i,j,k,n;
-    int size;
-    fp = fopen (file_name,"rb");
-    if (fp==NULL) { return -1;}
-    fseek (fp, 0, SEEK_END);   
-    size=ftell (fp);
-    rewind(fp);
-    buffFiles[0]=(char*)malloc((size+1)*sizeof(char));
-    k = fread (buffFiles[0],1,size,fp);
-    buffFiles[0][size]='\0'; 
-    fclose(fp);
-    return 0;
+	long i=0;
+	int count=0;
+#ifdef __SSE2__
+	__m128i pattern=_mm_set1_epi8(c);
+	for(;i+16<=len;i+=16)
+	{
+		__m128i block=_mm_loadu_si128((__m128i*)(s+i));
+		count+=__builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block,pattern)));
+	}
+#endif
+	for(;i<len;i++)
+	{
+		if(s[i]==c) count++;
+	}
+	return count;
 }
 
 /*************************************************
-Function: char* ReadXPath(char* xpath_name);
-Description: load XPath from related file
-Called By: int main(void);
-Input: xpath_name--the name for the XPath file
-Return: the contents in the Xpath file; error--can't open the XPath file
+Function: void count_lines(int i);
+Description: count the newlines of one part and the bytes after its last newline. It is called by the thread of the part, so the 
+parts are counted in parallel.
+Called By: int deal_part(int i);
+Input: i--the number of this part
 *************************************************/
-char* ReadXPath(char* xpath_name)
+void count_lines(int i)
 {
-	FILE *fp;
-	char* buf=(char*)malloc(MAX_LINE*sizeof(char));
-	char* xpath=(char*)malloc(MAX_LINE*sizeof(char));
-	xpath=strcpy(xpath,"");
-	if((fp = fopen(xpath_name,"r")) == NULL)
-    {
-        xpath=strcpy(xpath,"error");
-    }
-    else{
-    	while(fgets(buf,MAX_LINE,fp) != NULL)
-    	{
-    		xpath=strcat(xpath,buf);
-		}
+	char* s=buffFiles[i];
+	long k;
+	part_lines[i]=count_char(s,part_bytes[i],'\n');
+	part_tail[i]=-1;
+	if(part_lines[i]>0)
+	{
+		for(k=part_bytes[i]-1;s[k]!='\n';k--);
+		part_tail[i]=part_bytes[i]-1-k;
 	}
-	free(buf);
-    return xpath;
 }
 
 /*************************************************
-Function: void createAutoMachine(char* xmlPath);
-Description: create an automata by the XPath Query command
-Called By: int main(void);
-Input: xmlPath--XPath Query command
+Function: void next_line_base(int i);
+Description: take the lines before one part and the bytes of the line going on at its beginning, then move them after the part. 
+The parts must be taken in document order.
+Called By: void line_bases(int first, int n); char* merge_stream(int k, size_t* size);
+Input: i--the number of this part, which has been counted
 *************************************************/
-void createAutoMachine(char* xmlPath)
+void next_line_base(int i)
 {
-	char seps[] = "/"; 
-	char *token = strtok(xmlPath, seps); 
-	while(token!= NULL) 
+	line_base[i]=lineRun;
+	column_base[i]=columnRun;
+	lineRun+=part_lines[i];
+	columnRun=(part_tail[i]==-1)?columnRun+part_bytes[i]:part_tail[i];
+}
+
+/*************************************************
+Function: void line_bases(int first, int n);
+Description: sum the lines before each part of a file(a prefix sum over the newlines counted by the parts).
+Called By: int main(void); int batch_main(char* pattern, int workers); void serve_query(char* file_name, char* xpath);
+Input: first--the first part of the file; n--the last part of the file
+*************************************************/
+void line_bases(int first, int n)
+{
+	int i;
+	lineRun=0;
+	columnRun=0;
+	for(i=first;i<=n;i++)
 	{
-		stateCount++;
-		stateMachine[machineCount].start=stateCount;
-		stateMachine[machineCount].str=(char*)malloc((strlen(token)+1)*sizeof(char));
-		stateMachine[machineCount].str=strcpy(stateMachine[machineCount].str,token);
-		stateMachine[machineCount].end=stateCount+1;
-		stateMachine[machineCount].isoutput=0;
-		machineCount++;
-		if(stateCount>=1)
-		{
-			stateMachine[machineCount].start=stateCount+1;
-			stateMachine[machineCount].str=(char*)malloc((strlen(stateMachine[machineCount-1].str)+2)*sizeof(char));
-			stateMachine[machineCount].str=strcpy(stateMachine[machineCount].str,"/");
-			stateMachine[machineCount].str=strcat(stateMachine[machineCount].str,stateMachine[machineCount-1].str);
-			stateMachine[machineCount].end=stateCount;
-			stateMachine[machineCount].isoutput=0;
-		}
-		token=strtok(NULL,seps);  
-		if(token==NULL)
-		{
-			stateMachine[machineCount-1].isoutput=1;
-			stateMachine[machineCount].isoutput=1;
-		}
-		else machineCount++;
+		next_line_base(i);
 	}
-    stateCount++;
 }
 
 /*************************************************
-Function: void push(int thread_num,int nextState);
-Description: push the next state into stack
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: thread_num--the number of thread;nextState--the next state;
+Function: void init_cursor(LineCursor* c, char* text, long line, long column);
+Description: begin to find the positions in a text. The positions are found from the last one, so they are found in one pass if 
+they are in order.
+Called By: void part_position(int i, long offset, long* line, long* column); void print_result(ResultSet set, int n); 
+char* merge_stream(int k, size_t* size); void write_fragments(char* map, long size, int n); char* decode_content(char* content, long* size, char* source);
+Input: c--the cursor; text--the text; line--the number of lines before text; column--the number of bytes of the line going on at text[0]
+Output: c
 *************************************************/
-void push(int thread_num,int nextState) 
+void init_cursor(LineCursor* c, char* text, long line, long column)
 {
-	state_stack[thread_num].stack[state_stack[thread_num].top_stack++]=nextState;
+	c->text=text;
+	c->line0=line;
+	c->start0=-column;
+	c->at=0;
+	c->line=line+1;
+	c->start=-column;
 }
 
-
 /*************************************************
-Function: void pop(int next, int thread_num);
-Description: if type of the xml element is End Tag(e.g </xxx>) and the content of the tag could be found in the automata, 
-then this function would delete the related state from the stack of state_stack. If no such node exists, the next state will
-be pushed into the queue of state_stack.
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: next--the next state;thread_num--the number of thread;
+Function: void find_position(LineCursor* c, long at, long* line, long* column);
+Description: convert an offset of the text into its line and column(from 1, the column counts the bytes). The newlines between the 
+last position and this one are counted 16 bytes at a time; a position before the last one is counted from the beginning of the text.
+Called By: void part_position(int i, long offset, long* line, long* column); void print_result(ResultSet set, int n); 
+char* merge_stream(int k, size_t* size); void write_fragments(char* map, long size, int n); char* decode_content(char* content, long* size, char* source);
+Input: c--the cursor; at--the offset in the text
+Output: c; line, column--the position of at
 *************************************************/
-void pop(int next, int thread_num) //pop element due to end_tag e.g</d>
+void find_position(LineCursor* c, long at, long* line, long* column)
 {
-	int stack_top=-1;
-	int top=state_stack[thread_num].top_stack;
-	int rear;
-	if(state_stack[thread_num].top_stack>1)
-	    stack_top=state_stack[thread_num].stack[top-2];  
-	if(stack_top!=-1&&stack_top==next) //for state next
+	long n,k;
+	if(at<c->at)
 	{
-		state_stack[thread_num].top_stack--;
+		c->at=0;
+		c->line=c->line0+1;
+		c->start=c->start0;
 	}
-	else //not in final stack, add it into the start queue
+	n=count_char(c->text+c->at,at-c->at,'\n');
+	if(n>0)
 	{
-		state_stack[thread_num].stack[top-1]=next;
-		rear=state_stack[thread_num].rear_queue++;
-		state_stack[thread_num].queue[rear]=next;
+		for(k=at-1;c->text[k]!='\n';k--);
+		c->start=k+1;
+		c->line+=n;
 	}
+	c->at=at;
+	*line=c->line;
+	*column=at-c->start+1;
 }
 
 /*************************************************
-Function: char * convertTokenTypeToStr(xml_TokenType type);
-Description: convert the XML token type from digit to the real string for output
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: type--the enumeration for the type of XML
-Return: the output string for this type
+Function: void part_position(int i, long offset, long* line, long* column);
+Description: convert an offset of the file in one part into its line and column, the lines before the part have been taken.
+Called By: void merge_check(TagCheck* set, int i);
+Input: i--the number of this part; offset--the offset in the file
+Output: line, column--the position of offset
 *************************************************/
-char * convertTokenTypeToStr(xml_TokenType type)
+void part_position(int i, long offset, long* line, long* column)
 {
+	LineCursor c;
+	init_cursor(&c,buffFiles[i],line_base[i],column_base[i]);
+	find_position(&c,offset-part_offset[i],line,column);
+}
 
-	return tokenValue[type];
-	//else return defaultToken;
+/*************************************************
+Function: void print_position(long line, long column);
+Description: print a line and column after an offset in a message, only with line-numbers.
+Called By: void print_check(TagCheck* set);
+Input: line, column--the position
+*************************************************/
+void print_position(long line, long column)
+{
+	if(lineMode==1) fprintf(resultFile,"(line %ld, column %ld)",line,column);
 }
 
 /*************************************************
-Function: int xml_initText(xml_Text *pText, char *s);
-Description: initiate a xml_Text for a string loading from original XML file
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText--the xml_Text element waiting to be initialized; s--the XML string;
-Output: pText--the initialized xml_Text
-Return: 0--success
+Function: int is_ascii(char* s, long len);
+Description: whether all the bytes of a string are ASCII. With SSE2, the sign bits of 16 bytes are taken at a time.
+Called By: void iconv_task(int k);
+Input: s--the string; len--the length of the string
+Return: 1--all the bytes are ASCII; 0--some byte is not
 *************************************************/
-int xml_initText(xml_Text *pText, char *s)
+int is_ascii(char* s, long len)
 {
-    pText->p = s;
-    pText->len = strlen(s);
-    return 0;
+	long i=0;
+#ifdef __SSE2__
+	for(;i+16<=len;i+=16)
+	{
+		if(_mm_movemask_epi8(_mm_loadu_si128((__m128i*)(s+i)))!=0) return 0;
+	}
+#endif
+	for(;i<len;i++)
+	{
+		if((unsigned char)s[i]>=0x80) return 0;
+	}
+	return 1;
 }
 
 /*************************************************
-Function: xml_initToken(xml_Token *pToken, xml_Text *pText);
-Description: initiate a xml_Token for a initialized xml_Text
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pToken--the xml_Token element waiting to be initialized; pText--input xml_Text;
-Output: pToken--the initialized xml_Token
-Return: 0--success
+Function: void balance_points(char* content, long size, int n, long* point);
+Description: choose the cutting points so that each part has the same estimated cost. The file is divided into blocks of SPLIT_BLOCK bytes, 
+the cost of a block is its bytes plus tagWeight for each tag in it, and each cutting point is placed where the accumulated cost reaches 
+its share(interpolated inside the block).
+Called By: int split_file(char* file_name, int n, int first);
+Input: content--the whole file; size--the size of the file; n--the number of parts
+Output: point--point[i] is the end of part i before it is moved to the next open angle bracket
 *************************************************/
-int xml_initToken(xml_Token *pToken, xml_Text *pText)
+void balance_points(char* content, long size, int n, long* point)
 {
-    pToken->text.p = pText->p;
-    pToken->text.len = 0;
-    pToken->type = xml_tt_U;
-    return 0;
+	long blocks=(size+SPLIT_BLOCK-1)/SPLIT_BLOCK;
+	long b,len;
+	int i;
+	double total=0,sum=0,target,cost;
+	double* block_cost=(double*)malloc((blocks+1)*sizeof(double));
+	for(b=0;b<blocks;b++)
+	{
+		len=(b==blocks-1)?size-b*SPLIT_BLOCK:SPLIT_BLOCK;
+		block_cost[b]=len+tagWeight*count_char(content+b*SPLIT_BLOCK,len,'<');
+		total+=block_cost[b];
+	}
+	b=0;
+	for(i=0;i<n-1;i++)
+	{
+		target=total*(i+1)/n;
+		while(b<blocks&&sum+block_cost[b]<target) sum+=block_cost[b++];
+		if(b>=blocks) point[i]=size;
+		else
+		{
+			cost=block_cost[b]>0?(target-sum)/block_cost[b]:0;
+			point[i]=b*SPLIT_BLOCK+(long)(cost*SPLIT_BLOCK);
+			if(point[i]>size) point[i]=size;
+		}
+	}
+	point[n-1]=size;
+	free(block_cost);
 }
 
 /*************************************************
-Function: int xml_print(xml_Text *pText, int begin, int end);
-Description: print the substring of a xml_Text
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText--input xml_Text; begin--start position; end--end position;
-Output: the substring of a xml_Text
-Return: 0--success
+Function: void refine_split(int parts);
+Description: refine the weight of a tag by the duration of each part in this run. The duration of part i is fitted as 
+a*part_bytes[i]+c*part_tags[i] by least squares, and tagWeight moves by CALIBRATION_RATE towards c/a.
+Called By: int main(void);
+Input: parts--the number of parts
 *************************************************/
-int xml_print(xml_Text *pText, int begin, int end)
+void refine_split(int parts)
 {
-    int i;
-    char * temp=pText->p;
-    temp = ltrim(pText->p);
-    int j=0;
-    for (i = begin; i < end; i++)
-    {
-        putchar(temp[i]);
-    }
-    return 0;
+	int i;
+	double bb=0,bt=0,tt=0,by=0,ty=0,det,a,c;
+	if(parts<2) return;
+	for(i=0;i<parts;i++)
+	{
+		bb+=(double)part_bytes[i]*part_bytes[i];
+		bt+=(double)part_bytes[i]*part_tags[i];
+		tt+=(double)part_tags[i]*part_tags[i];
+		by+=part_bytes[i]*part_time[i];
+		ty+=part_tags[i]*part_time[i];
+	}
+	det=bb*tt-bt*bt;
+	if(det<=0) return;  //the parts have the same density, nothing could be learned
+	a=(by*tt-ty*bt)/det;
+	c=(ty*bb-by*bt)/det;
+	if(a<=0||c<=0) return;
+	tagWeight+=CALIBRATION_RATE*(c/a-tagWeight);
+	printf("The weight of a tag is refined to %lf bytes.\n",tagWeight);
 }
 
 /*************************************************
-Function: char* substring(char *pText, int begin, int end);
-Description: print the substring of the original string
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText--the original string; begin--start position; end--end position;
-Return: the final string
+Function: long* cut_points(char* content, long size, int n, int* count);
+Description: find where each part of the content begins. The cutting points divide it into parts with equal bytes(split-mode 0) or 
+equal estimated cost(split-mode 1), then each cutting point is moved forward to the next open angle bracket. A part which would be 
+empty is dropped.
+Called By: int split_file(char* file_name, int n, int first); CachedFile* lookup_file(char* file_name, int parts);
+Input: content--the content of the file; size--the size of content; n--the number of parts
+Output: count--the number of parts which are not empty
+Return: the beginning of each part, followed by size
 *************************************************/
-char* substring(char *pText, int begin, int end)
+long* cut_points(char* content, long size, int n, int* count)
 {
-    int i,j;
-    char * temp=pText;
-    temp = ltrim(pText);
-    char* temp1=(char*)malloc((end-begin+1)*sizeof(char));
-    for (j = 0,i = begin; i < end; i++,j++)
-    {
-        temp1[j]=temp[i];
-    }
-    temp1[j]='\0';
-    return temp1;
+	int i;
+	long begin,end;
+	long* point=(long*)malloc((n+1)*sizeof(long));  //point[i]--the end of part i
+	long* cut=(long*)malloc((n+1)*sizeof(long));
+	if(splitMode==1) balance_points(content,size,n,point);
+	else
+	{
+		for (i=0;i<n;i++) point[i]=(size/n)*(i+1);
+	}
+	point[n-1]=size;
+	begin=0;
+	*count=0;
+	for (i=0;i<n&&begin<size;i++)
+	{
+		end=point[i];
+		if(end<begin) end=begin;
+		/*skip the default size to look for the next open angle bracket*/
+		while(end<size&&content[end]!='<') end++;
+		if(end==begin) continue;
+		cut[(*count)++]=begin;
+		begin=end;
+	}
+	cut[*count]=size;
+	free(point);
+	return cut;
 }
 
 /*************************************************
-Function: char * ltrim(char *s);
-Description: remove the left blankets of a string
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: s--the original string; 
-Return: the final substring
+Function: int load_file(char* file_name, int first);
+Description: load the XML file into memory as one part(used for sequential version, the record mode and the small files of the batch mode)
+Called By: int main(void); int batch_main(char* pattern, int workers);
+Input: file_name--the name for the xml file; first--the number of this part
+Return: the number of this part; -1--can't open the XML file
 *************************************************/
-char * ltrim(char *s)
+int load_file(char* file_name, int first)
 {
-     char *temp;
-     temp = s;
-     while((*temp == ' ')&&temp){*temp++;}
-     return temp;
+    long size;
+    buffFiles[first]=load_content(file_name,&size);
+    if (buffFiles[first]==NULL) { return -1;}
+    part_offset[first]=0;
+    part_bytes[first]=size;
+    part_tags[first]=0;
+    return first;
 }
 
 /*************************************************
-Function: int left_null_count(char *s);
+Function: unsigned char* read_whole(char* file_name, long* size);
+Description: read the whole file into memory without decompressing it, the bytes are ended with '\0'. 
+Stdin(the file name -) can't be sought, so it is read by blocks until its end.
+Called By: char* load_content(char* file_name, long* size); int stream_parts(char* file_name, int parts);
+Input: file_name--the name for the file, - for stdin
+Output: size--the size of the file
+Return: the bytes of the file; NULL--can't open the file
+*************************************************/
+unsigned char* read_whole(char* file_name, long* size)
+{
+	FILE *fp;
+	unsigned char* data;
+	long k,max=STDIN_BLOCK;
+	if(strcmp(file_name,"-")==0)
+	{
+		data=(unsigned char*)malloc((max+1)*sizeof(char));
+		*size=0;
+		while((k=fread(data+*size,1,max-*size,stdin))>0)
+		{
+			*size+=k;
+			if(*size==max)
+			{
+				max*=2;
+				data=(unsigned char*)realloc(data,(max+1)*sizeof(char));
+			}
+		}
+		data[*size]='\0';
+		return data;
+	}
+	fp = fopen (file_name,"rb");
+	if (fp==NULL) { return NULL;}
+	fseek (fp, 0, SEEK_END);
+	*size=ftell (fp);
+	rewind(fp);
+	data=(unsigned char*)malloc((*size+1)*sizeof(char));
+	k = fread (data,1,*size,fp);
+	fclose(fp);
+	if(k!=*size)
+	{
+		free(data);
+		return NULL;
+	}
+	data[*size]='\0';
+	return data;
+}
+
+/*************************************************
+Function: comp_Kind detect_compression(unsigned char* data, long size);
+Description: find the compression of a file by its magic number. A gzip member with the BC extra field is BGZF, whose members 
+are independent and know their own sizes.
+Called By: char* load_content(char* file_name, long* size); comp_Kind file_compression(char* file_name);
+Input: data--the beginning of the file; size--the bytes of data
+Return: the compression of the file
+*************************************************/
+comp_Kind detect_compression(unsigned char* data, long size)
+{
+	if(size>=18&&data[0]==0x1f&&data[1]==0x8b&&data[2]==8)
+	{
+		if((data[3]&4)&&data[12]=='B'&&data[13]=='C'&&data[14]==2&&data[15]==0) return comp_bgzf;
+		return comp_gzip;
+	}
+	if(size>=4&&data[0]==0x28&&data[1]==0xb5&&data[2]==0x2f&&data[3]==0xfd) return comp_zstd;
+	return comp_none;
+}
+
+/*************************************************
+Function: comp_Kind file_compression(char* file_name);
+Description: find the compression of a file by reading its first bytes
+Called By: int stream_input(char* file_name); int print_fragments(char* file_name, int n);
+Input: file_name--the name for the file
+Return: the compression of the file, comp_none if the file can't be opened
+*************************************************/
+comp_Kind file_compression(char* file_name)
+{
+	FILE *fp;
+	unsigned char head[18];
+	long k;
+	fp = fopen (file_name,"rb");
+	if (fp==NULL) { return comp_none;}
+	k = fread (head,1,sizeof(head),fp);
+	fclose(fp);
+	return detect_compression(head,k);
+}
+
+/*************************************************
+Function: char* load_content(char* file_name, long* size);
+Description: load the whole file into memory. A compressed file is decompressed straight into memory: BGZF, gzip with an index 
+and zstd with several frames are decompressed in parallel by inflateThreads threads, other gzip files are inflated sequentially 
+and an index(the file name with .zidx) is saved for the next time.
+Called By: int split_file(char* file_name, int n, int first); int load_file(char* file_name, int first); 
+int print_fragments(char* file_name, int n);
+Input: file_name--the name for the file
+Output: size--the size of the content
+Return: the content ended with '\0'; NULL--can't open or decompress the file
+*************************************************/
+char* load_content(char* file_name, long* size)
+{
+	long in_size;
+	unsigned char* data=read_whole(file_name,&in_size);
+	char* content;
+	char* index_name;
+	comp_Kind kind;
+	if(data==NULL) return NULL;
+	kind=detect_compression(data,in_size);
+	if(kind==comp_none)
+	{
+		*size=in_size;
+		content=(char*)data;
+	}
+	else
+	{
+		index_name=NULL;
+		if(strcmp(file_name,"-")!=0)  //no index for stdin
+		{
+			index_name=(char*)malloc(strlen(file_name)+6);
+			sprintf(index_name,"%s.zidx",file_name);
+		}
+		content=inflate_parallel(data,in_size,size,kind,index_name);
+		free(index_name);
+		free(data);
+		if(content==NULL) printf("The compressed file %s can not be decompressed.\n",file_name);
+	}
+	if(content!=NULL&&encodingMode==1)
+	{
+		content=decode_content(content,size,strcmp(file_name,"-")==0?"from stdin":file_name);
+	}
+	return content;
+}
+
+/*************************************************
+Function: enc_Kind detect_encoding(unsigned char* data, long size, char* name);
+Description: find the encoding of the XML by its BOM, by the first characters of the XML declaration in UTF-16(<? with zero bytes), 
+or by the encoding in the XML declaration. Without a declared encoding, the XML is UTF-8; US-ASCII is UTF-8 too, and a declared 
+UTF-16 without the BOM or zero bytes is dealt with as UTF-8, since its bytes are ASCII.
+Called By: char* decode_content(char* content, long* size, char* source); int must_load(char* file_name); int stdin_parts(void);
+Input: data--the beginning of the XML; size--the bytes of data
+Output: name--the encoding declared, an empty string if it is not declared
+Return: the encoding of the XML
+*************************************************/
+enc_Kind detect_encoding(unsigned char* data, long size, char* name)
+{
+	long end,k;
+	int len=0;
+	char quote;
+	name[0]='\0';
+	if(size>=3&&data[0]==0xef&&data[1]==0xbb&&data[2]==0xbf) return enc_utf8;
+	if(size>=2&&data[0]==0xff&&data[1]==0xfe) return enc_utf16le;
+	if(size>=2&&data[0]==0xfe&&data[1]==0xff) return enc_utf16be;
+	if(size>=4&&data[0]=='<'&&data[1]==0&&data[2]=='?'&&data[3]==0) return enc_utf16le;
+	if(size>=4&&data[0]==0&&data[1]=='<'&&data[2]==0&&data[3]=='?') return enc_utf16be;
+	if(size<5||memcmp(data,"<?xml",5)!=0) return enc_utf8;
+	end=(size<ENC_HEAD)?size:ENC_HEAD;
+	for(k=5;k+1<end&&!(data[k]=='?'&&data[k+1]=='>');k++)
+	{
+		if(k+8<end&&memcmp(data+k,"encoding",8)==0)
+		{
+			for(k+=8;k<end&&(data[k]==' '||data[k]=='=');k++);
+			if(k>=end||(data[k]!='"'&&data[k]!='\'')) break;
+			quote=data[k++];
+			for(;k<end&&data[k]!=quote&&len<MAX_LINE-1;k++) name[len++]=data[k];
+			name[len]='\0';
+			break;
+		}
+	}
+	if(name[0]=='\0'||strcasecmp(name,"utf-8")==0||strcasecmp(name,"utf8")==0||strcasecmp(name,"us-ascii")==0
+		||strcasecmp(name,"ascii")==0||strncasecmp(name,"utf-16",6)==0) return enc_utf8;
+	return enc_other;
+}
+
+/*************************************************
+Function: int must_load(char* file_name);
+Description: whether the file must be loaded by load_content instead of being mapped, because its content is not its bytes: 
+it is compressed, or it is transcoded into UTF-8 (the offsets of the parts and fragments are in the content). On Windows there is 
+no mmap, so every file is loaded.
+Called By: int print_fragments(char* file_name, int n); CachedFile* lookup_file(char* file_name, int parts); 
+int shard_worker(char* file_name, long begin, long end, FILE* out, int workers, int parts); 
+int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: file_name--the name for the file
+Return: 1--the file must be loaded; 0--the file could be mapped
+*************************************************/
+int must_load(char* file_name)
+{
+	FILE *fp;
+	unsigned char head[ENC_HEAD];
+	char name[MAX_LINE];
+	long k;
+#ifdef _WIN32
+	return 1;
+#endif
+	if(file_compression(file_name)!=comp_none) return 1;
+	if(encodingMode==0) return 0;
+	fp = fopen (file_name,"rb");
+	if (fp==NULL) { return 0;}
+	k = fread (head,1,sizeof(head),fp);
+	fclose(fp);
+	return detect_encoding(head,k,name)!=enc_utf8;
+}
+
+/*************************************************
+Function: char* decode_content(char* content, long* size, char* source);
+Description: the encoding stage before the lexer. UTF-8 is validated in place. UTF-16(without its BOM) and the other declared 
+encodings are transcoded into UTF-8 in two rounds of the tasks: the first round finds the bytes of UTF-8 for each chunk(UTF-16 is 
+counted, iconv writes into a buffer of the chunk), then each chunk is written into its range of the new content. The chunks of 
+UTF-16 do not split a surrogate pair, and the chunks of the other encodings end before an open angle bracket, which is one byte in 
+an encoding compatible with ASCII(e.g gb2312). A chunk of ASCII is copied as it is, and the content is kept if all of it is ASCII.
+Called By: char* load_content(char* file_name, long* size); int stdin_parts(void);
+Input: content--the content ended with '\0', which is freed when it is transcoded or not valid; size--the size of content; 
+source--the name of the file for the messages
+Output: size--the size of the content in UTF-8
+Return: the content in UTF-8 ended with '\0'; NULL--the content is not valid in its encoding, or the encoding is not supported
+*************************************************/
+char* decode_content(char* content, long* size, char* source)
+{
+	char name[MAX_LINE];
+	enc_Kind kind=detect_encoding((unsigned char*)content,*size,name);
+	long k,edge,total,bad=-1,skip=0;
+	int count=0,max,copied=0;
+	unsigned int unit;
+	iconv_t cd;
+	char* out=NULL;
+	if(kind==enc_utf8)
+	{
+		bad=validate_utf8(content,*size);
+		if(bad==-1) return content;
+		if(lineMode==1)
+		{
+			LineCursor cursor;
+			long line,column;
+			init_cursor(&cursor,content,0,0);
+			find_position(&cursor,bad,&line,&column);
+			printf("The XML %s is not valid UTF-8 at %ld(line %ld, column %ld).\n",source,bad,line,column);
+		}
+		else printf("The XML %s is not valid UTF-8 at %ld.\n",source,bad);
+		free(content);
+		return NULL;
+	}
+	if(kind==enc_other)
+	{
+		cd=iconv_open("UTF-8",name);
+		if(cd==(iconv_t)-1)
+		{
+			printf("The encoding %s of the XML %s can not be transcoded into UTF-8.\n",name,source);
+			free(content);
+			return NULL;
+		}
+		iconv_close(cd);
+		strcpy(encodingName,name);
+	}
+	else if((unsigned char)content[0]==0xff||(unsigned char)content[0]==0xfe) skip=2;  //the BOM is not needed in UTF-8
+	/*cut the content into chunks at the boundaries of the characters*/
+	max=(*size)/ENC_CHUNK+2;
+	taskIn=(long*)malloc(max*sizeof(long));
+	taskInLen=(long*)malloc(max*sizeof(long));
+	taskOutOff=(long*)malloc(max*sizeof(long));
+	taskOutLen=(long*)malloc(max*sizeof(long));
+	taskBad=(long*)malloc(max*sizeof(long));
+	taskTemp=(char**)malloc(max*sizeof(char*));
+	for(k=skip;k<*size;k=edge)
+	{
+		edge=k+ENC_CHUNK;
+		if(edge>=*size) edge=*size;
+		else if(kind==enc_other)
+		{
+			while(edge<*size&&content[edge]!='<') edge++;
+		}
+		else
+		{
+			edge-=(edge-skip)&1;
+			unit=(kind==enc_utf16be)?((unsigned char)content[edge-2]<<8|(unsigned char)content[edge-1])
+				:((unsigned char)content[edge-1]<<8|(unsigned char)content[edge-2]);
+			if(unit>=0xd800&&unit<=0xdbff) edge+=2;  //the high surrogate stays with the low one
+			if(edge>*size) edge=*size;
+		}
+		taskIn[count]=k;
+		taskInLen[count]=edge-k;
+		count++;
+	}
+	taskCount=count;
+	taskData=(unsigned char*)content;
+	run_tasks(inflateThreads,kind==enc_other?iconv_task:utf16_count_task);
+	total=0;
+	for(k=0;k<count;k++)
+	{
+		if(bad==-1&&taskBad[k]!=-1) bad=taskBad[k];
+		if(kind!=enc_other||taskTemp[k]!=NULL) copied=1;
+		taskOutOff[k]=total;
+		total+=taskOutLen[k];
+	}
+	if(bad!=-1) printf("The XML %s is not valid %s at %ld.\n",source,kind==enc_other?name:"UTF-16",bad);
+	else if(copied==0) out=content;  //all of it is ASCII
+	else
+	{
+		taskOut=(char*)malloc(total+1);
+		run_tasks(inflateThreads,kind==enc_other?copy_task:utf16_task);
+		taskOut[total]='\0';
+		out=taskOut;
+		printf("The XML %s is transcoded from %s into UTF-8(%ld bytes into %ld bytes).\n",source,
+			kind==enc_other?name:(kind==enc_utf16le?"UTF-16LE":"UTF-16BE"),*size,total);
+		*size=total;
+	}
+	if(out!=content)
+	{
+		for(k=0;k<count&&kind==enc_other;k++) free(taskTemp[k]);  //the buffers are freed by copy_task, unless it is not run
+		free(content);
+	}
+	free(taskIn);
+	free(taskInLen);
+	free(taskOutOff);
+	free(taskOutLen);
+	free(taskBad);
+	free(taskTemp);
+	return out;
+}
+
+/*************************************************
+Function: long validate_utf8(char* content, long size);
+Description: validate UTF-8 by chunks in parallel. A chunk does not begin with a continuation byte(10xxxxxx), so no character is split.
+Called By: char* decode_content(char* content, long* size, char* source); CachedFile* lookup_file(char* file_name, int parts); 
+int shard_worker(char* file_name, long begin, long end, FILE* out, int workers, int parts);
+Input: content--the content; size--the size of content
+Return: the offset of the first byte which is not valid; -1--the content is valid UTF-8
+*************************************************/
+long validate_utf8(char* content, long size)
+{
+	long k,edge,bad=-1;
+	int count=0,max=size/ENC_CHUNK+2;
+	taskIn=(long*)malloc(max*sizeof(long));
+	taskInLen=(long*)malloc(max*sizeof(long));
+	taskBad=(long*)malloc(max*sizeof(long));
+	for(k=0;k<size;k=edge)
+	{
+		edge=k+ENC_CHUNK;
+		if(edge>=size) edge=size;
+		else
+		{
+			while(edge>k+ENC_CHUNK-4&&((unsigned char)content[edge]&0xc0)==0x80) edge--;
+		}
+		taskIn[count]=k;
+		taskInLen[count]=edge-k;
+		count++;
+	}
+	taskCount=count;
+	taskData=(unsigned char*)content;
+	run_tasks(inflateThreads,utf8_task);
+	for(k=0;k<count&&bad==-1;k++)
+	{
+		bad=taskBad[k];
+	}
+	free(taskIn);
+	free(taskInLen);
+	free(taskBad);
+	return bad;
+}
+
+/*************************************************
+Function: long utf8_invalid(unsigned char* s, long len);
+Description: find the first byte which is not valid UTF-8(RFC 3629: no overlong form, no surrogate, no code point after U+10FFFF). 
+With SSE2, 16 bytes of ASCII are skipped at a time by the sign bits, so most of the markup runs at the speed of the memory.
+Called By: void utf8_task(int k); int stdin_parts(void);
+Input: s--the bytes; len--the number of bytes
+Return: the offset of the first byte which is not valid in s; -1--all of them are valid
+*************************************************/
+long utf8_invalid(unsigned char* s, long len)
+{
+	long i=0;
+	int need;
+	unsigned char c,low,high;
+	while(i<len)
+	{
+#ifdef __SSE2__
+		while(i+16<=len&&_mm_movemask_epi8(_mm_loadu_si128((__m128i*)(s+i)))==0) i+=16;
+		if(i>=len) break;
+#endif
+		c=s[i];
+		if(c<0x80)
+		{
+			i++;
+			continue;
+		}
+		low=0x80;
+		high=0xbf;
+		if(c>=0xc2&&c<=0xdf) need=1;
+		else if(c>=0xe0&&c<=0xef)
+		{
+			need=2;
+			if(c==0xe0) low=0xa0;
+			if(c==0xed) high=0x9f;
+		}
+		else if(c>=0xf0&&c<=0xf4)
+		{
+			need=3;
+			if(c==0xf0) low=0x90;
+			if(c==0xf4) high=0x8f;
+		}
+		else return i;
+		if(i+need>=len) return i;  //the character is cut
+		if(s[i+1]<low||s[i+1]>high) return i;
+		if(need>=2&&(s[i+2]&0xc0)!=0x80) return i;
+		if(need==3&&(s[i+3]&0xc0)!=0x80) return i;
+		i+=need+1;
+	}
+	return -1;
+}
+
+/*************************************************
+Function: long utf16_to_utf8(unsigned char* s, long len, int big, char* out, long* bad);
+Description: transcode UTF-16 into UTF-8, or count the bytes of UTF-8 if out is NULL. With SSE2, 8 units of ASCII are packed into 
+8 bytes at a time.
+Called By: void utf16_count_task(int k); void utf16_task(int k);
+Input: s--the bytes of UTF-16; len--the number of bytes; big--1 for big endian; out--the buffer for UTF-8, NULL--only count
+Output: bad--the offset in s of the first unit which is not valid(an odd byte or a surrogate without its pair), -1 for none
+Return: the bytes of UTF-8
+*************************************************/
+long utf16_to_utf8(unsigned char* s, long len, int big, char* out, long* bad)
+{
+	long i=0,n=0;
+	unsigned int u,v;
+	*bad=-1;
+	while(i+1<len)
+	{
+#ifdef __SSE2__
+		__m128i mask=_mm_set1_epi16((short)0xff80);
+		while(i+16<=len)
+		{
+			__m128i block=_mm_loadu_si128((__m128i*)(s+i));
+			if(big) block=_mm_or_si128(_mm_slli_epi16(block,8),_mm_srli_epi16(block,8));
+			if(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block,mask),_mm_setzero_si128()))!=0xffff) break;
+			if(out!=NULL) _mm_storel_epi64((__m128i*)(out+n),_mm_packus_epi16(block,block));
+			i+=16;
+			n+=8;
+		}
+		if(i+1>=len) break;
+#endif
+		u=big?(s[i]<<8|s[i+1]):(s[i+1]<<8|s[i]);
+		if(u<0x80)
+		{
+			if(out!=NULL) out[n]=u;
+			n++;
+		}
+		else if(u<0x800)
+		{
+			if(out!=NULL)
+			{
+				out[n]=0xc0|(u>>6);
+				out[n+1]=0x80|(u&0x3f);
+			}
+			n+=2;
+		}
+		else if(u>=0xd800&&u<=0xdfff)
+		{
+			if(u>0xdbff||i+3>=len)
+			{
+				*bad=i;
+				return n;
+			}
+			v=big?(s[i+2]<<8|s[i+3]):(s[i+3]<<8|s[i+2]);
+			if(v<0xdc00||v>0xdfff)
+			{
+				*bad=i;
+				return n;
+			}
+			u=0x10000+((u-0xd800)<<10)+(v-0xdc00);
+			if(out!=NULL)
+			{
+				out[n]=0xf0|(u>>18);
+				out[n+1]=0x80|((u>>12)&0x3f);
+				out[n+2]=0x80|((u>>6)&0x3f);
+				out[n+3]=0x80|(u&0x3f);
+			}
+			n+=4;
+			i+=2;
+		}
+		else
+		{
+			if(out!=NULL)
+			{
+				out[n]=0xe0|(u>>12);
+				out[n+1]=0x80|((u>>6)&0x3f);
+				out[n+2]=0x80|(u&0x3f);
+			}
+			n+=3;
+		}
+		i+=2;
+	}
+	if(i<len&&*bad==-1) *bad=i;  //an odd byte at the end
+	return n;
+}
+
+/*************************************************
+Function: void utf8_task(int k);
+Description: validate UTF-8 in one chunk
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void utf8_task(int k)
+{
+	long bad=utf8_invalid(taskData+taskIn[k],taskInLen[k]);
+	taskBad[k]=(bad==-1)?-1:taskIn[k]+bad;
+}
+
+/*************************************************
+Function: void utf16_count_task(int k);
+Description: count the bytes of UTF-8 for one chunk of UTF-16
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void utf16_count_task(int k)
+{
+	long bad;
+	/*the first byte tells the byte order: FE of the BOM or 00 of "<" in big endian*/
+	taskOutLen[k]=utf16_to_utf8(taskData+taskIn[k],taskInLen[k],taskData[0]==0xfe||taskData[0]==0,NULL,&bad);
+	taskBad[k]=(bad==-1)?-1:taskIn[k]+bad;
+}
+
+/*************************************************
+Function: void utf16_task(int k);
+Description: transcode one chunk of UTF-16 into its range of the content
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void utf16_task(int k)
+{
+	long bad;
+	utf16_to_utf8(taskData+taskIn[k],taskInLen[k],taskData[0]==0xfe||taskData[0]==0,taskOut+taskOutOff[k],&bad);
+}
+
+/*************************************************
+Function: void iconv_task(int k);
+Description: transcode one chunk of the declared encoding into a buffer of the chunk by iconv. A chunk of ASCII is not transcoded.
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void iconv_task(int k)
+{
+	char* in=(char*)taskData+taskIn[k];
+	size_t in_left=taskInLen[k],out_left=3*taskInLen[k]+16;  //a byte is at most 3 bytes of UTF-8
+	char* out;
+	iconv_t cd;
+	taskBad[k]=-1;
+	taskTemp[k]=NULL;
+	taskOutLen[k]=taskInLen[k];
+	if(is_ascii(in,taskInLen[k])) return;
+	taskTemp[k]=(char*)malloc(out_left);
+	out=taskTemp[k];
+	cd=iconv_open("UTF-8",encodingName);
+	if(iconv(cd,&in,&in_left,&out,&out_left)==(size_t)-1)
+	{
+		taskBad[k]=in-(char*)taskData;
+	}
+	iconv_close(cd);
+	taskOutLen[k]=out-taskTemp[k];
+}
+
+/*************************************************
+Function: void copy_task(int k);
+Description: copy the output of one chunk of iconv into its range of the content, and free the buffer of the chunk
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void copy_task(int k)
+{
+	memcpy(taskOut+taskOutOff[k],(taskTemp[k]!=NULL)?taskTemp[k]:(char*)taskData+taskIn[k],taskOutLen[k]);
+	free(taskTemp[k]);
+	taskTemp[k]=NULL;
+}
+
+/*************************************************
+Function: void publish_content(char* p, long len, long offset);
+Description: copy the decompressed bytes into a new part and publish it to the threads waiting for parts. The slot of the part 
+must be free: the parts from stdin use the slots again once the parts before are merged.
+Called By: char* gunzip(unsigned char* data, long size, long* out_size, char* index_name, long parts); 
+long publish_blocks(char* data, long size, long offset, int last);
+Input: p--the bytes of the part; len--the length of the part; offset--the offset of the part in the uncompressed file
+*************************************************/
+void publish_content(char* p, long len, long offset)
+{
+	int k=partCount%MAX_PART;
+	buffFiles[k]=(char*)malloc((len+1)*sizeof(char));
+	memcpy(buffFiles[k],p,len);
+	buffFiles[k][len]='\0';
+	part_offset[k]=offset;
+	part_bytes[k]=len;
+	part_tags[k]=count_char(buffFiles[k],len,'<');
+	pthread_mutex_lock(&part_lock);
+	partCount++;
+	pthread_cond_broadcast(&part_ready);
+	pthread_mutex_unlock(&part_lock);
+}
+
+/*************************************************
+Function: char* gunzip(unsigned char* data, long size, long* out_size, char* index_name, long parts);
+Description: inflate a gzip file sequentially. At the end of a deflate block, an access point is saved every GZ_SPAN bytes with 
+the GZ_WINDOW bytes before it, and the index of a file with one member is saved, so the file could be inflated in parallel next time. 
+In the pipeline(parts>0), a part is published whenever about size/parts bytes are inflated, so the threads deal with the parts 
+while the rest of the file is inflated; the pipeline stops early when the limit of outputs is reached.
+Called By: char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name); 
+int stream_parts(char* file_name, int parts);
+Input: data--the compressed file; size--the size of data; index_name--the file for the index, NULL--no index; 
+parts--the number of parts expected for the pipeline, 0--no pipeline
+Output: out_size--the size of the content
+Return: the content ended with '\0'; NULL--the file can't be inflated
+*************************************************/
+char* gunzip(unsigned char* data, long size, long* out_size, char* index_name, long parts)
+{
+	z_stream strm;
+	long cap,total=0,last=0,published=0,chunk=0,cut;
+	int ret,count=0,maxp=16,members=0,complete=0;
+	AccessPoint* point;
+	char* out;
+	cap=(long)data[size-4]|((long)data[size-3]<<8)|((long)data[size-2]<<16)|((long)data[size-1]<<24); //ISIZE is the size modulo 2^32
+	if(cap<size) cap=size*4;
+	out=(char*)malloc(cap+1);
+	memset(&strm,0,sizeof(strm));
+	if(inflateInit2(&strm,47)!=Z_OK)
+	{
+		free(out);
+		return NULL;
+	}
+	point=(AccessPoint*)malloc(maxp*sizeof(AccessPoint));
+	strm.next_in=data;
+	strm.avail_in=(size>(1L<<30))?(1L<<30):size;
+	if(parts>0)
+	{
+		chunk=cap/parts;
+		if(chunk<MIN_PART_SIZE) chunk=MIN_PART_SIZE;
+	}
+	while(1)
+	{
+		if(total==cap)
+		{
+			cap*=2;
+			out=(char*)realloc(out,cap+1);
+		}
+		if(strm.avail_in==0&&(char*)strm.next_in<(char*)data+size)
+		{
+			strm.avail_in=(data+size-strm.next_in>(1L<<30))?(1L<<30):(data+size-strm.next_in);
+		}
+		strm.next_out=(unsigned char*)out+total;
+		strm.avail_out=(cap-total>(1L<<30))?(1L<<30):(cap-total);
+		ret=inflate(&strm,Z_BLOCK);
+		total=(char*)strm.next_out-out;
+		if(ret==Z_STREAM_END)
+		{
+			members++;
+			if(data+size-strm.next_in>=2&&strm.next_in[0]==0x1f&&strm.next_in[1]==0x8b)  //another member
+			{
+				inflateReset(&strm);
+				continue;
+			}
+			complete=1;
+			break;
+		}
+		if(ret!=Z_OK&&(ret!=Z_BUF_ERROR||strm.next_in==data+size)) break;
+		if(members==0&&(strm.data_type&128)&&!(strm.data_type&64)&&(count==0||total-last>=GZ_SPAN))
+		{
+			if(count==maxp)
+			{
+				maxp*=2;
+				point=(AccessPoint*)realloc(point,maxp*sizeof(AccessPoint));
+			}
+			point[count].out=total;
+			point[count].in=strm.next_in-data;
+			point[count].bits=strm.data_type&7;
+			if(total>=GZ_WINDOW) memcpy(point[count].window,out+total-GZ_WINDOW,GZ_WINDOW);
+			else memset(point[count].window,0,GZ_WINDOW);
+			last=total;
+			count++;
+		}
+		while(parts>0&&total-published>=chunk&&partCount<MAX_PART-1)
+		{
+			cut=published+chunk;
+			while(cut<total&&out[cut]!='<') cut++;
+			if(cut>=total) break;
+			publish_content(out+published,cut-published,published);
+			published=cut;
+		}
+		if(parts>0&&limitPart<MAX_PART) break;  //the first N outputs are found
+	}
+	inflateEnd(&strm);
+	if(parts>0&&total>published)
+	{
+		publish_content(out+published,total-published,published);
+	}
+	if(complete==1&&members==1&&index_name!=NULL&&count>1)
+	{
+		save_gz_index(index_name,size,total,point,count);
+	}
+	free(point);
+	if(complete==0&&(parts==0||limitPart==MAX_PART))
+	{
+		free(out);
+		return NULL;
+	}
+	out[total]='\0';
+	*out_size=total;
+	return out;
+}
+
+#ifdef XPQ_ZSTD
+/*************************************************
+Function: char* unzstd(unsigned char* data, long size, long* out_size);
+Description: decompress zstd sequentially, used when the size of a frame is unknown
+Called By: char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name);
+Input: data--the compressed file; size--the size of data
+Output: out_size--the size of the content
+Return: the content ended with '\0'; NULL--the file can't be decompressed
+*************************************************/
+char* unzstd(unsigned char* data, long size, long* out_size)
+{
+	ZSTD_DStream* ds=ZSTD_createDStream();
+	ZSTD_inBuffer in={data,size,0};
+	ZSTD_outBuffer out;
+	size_t ret=1;
+	long cap=size*4;
+	char* content=(char*)malloc(cap+1);
+	ZSTD_initDStream(ds);
+	out.dst=content;
+	out.size=cap;
+	out.pos=0;
+	while(in.pos<in.size)
+	{
+		if(out.pos==out.size)
+		{
+			cap*=2;
+			content=(char*)realloc(content,cap+1);
+			out.dst=content;
+			out.size=cap;
+		}
+		ret=ZSTD_decompressStream(ds,&out,&in);
+		if(ZSTD_isError(ret)) break;
+	}
+	ZSTD_freeDStream(ds);
+	if(ZSTD_isError(ret)||ret!=0)
+	{
+		free(content);
+		return NULL;
+	}
+	content[out.pos]='\0';
+	*out_size=out.pos;
+	return content;
+}
+
+/*************************************************
+Function: void zstd_task(int k);
+Description: decompress one zstd frame into its range of the content
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void zstd_task(int k)
+{
+	size_t ret=ZSTD_decompress(taskOut+taskOutOff[k],taskOutLen[k],taskData+taskIn[k],taskInLen[k]);
+	if(ZSTD_isError(ret)||(long)ret!=taskOutLen[k]) taskFailed=1;
+}
+#endif
+
+/*************************************************
+Function: void inflate_task(int k);
+Description: inflate the raw deflate data of one task into its range of the content. A task of the gzip index begins at an access 
+point, so the bits before it and the window are restored at first.
+Called By: void run_tasks(int threads, void (*task)(int));
+Input: k--the number of the task
+*************************************************/
+void inflate_task(int k)
+{
+	z_stream strm;
+	int ret;
+	memset(&strm,0,sizeof(strm));
+	if(inflateInit2(&strm,-15)!=Z_OK)
+	{
+		taskFailed=1;
+		return;
+	}
+	if(taskPoint!=NULL)
+	{
+		if(taskPoint[k].bits>0) inflatePrime(&strm,taskPoint[k].bits,taskData[taskPoint[k].in-1]>>(8-taskPoint[k].bits));
+		if(taskPoint[k].out>0) inflateSetDictionary(&strm,taskPoint[k].window,GZ_WINDOW);
+	}
+	strm.next_in=taskData+taskIn[k];
+	strm.avail_in=(taskInLen[k]>(1L<<30))?(1L<<30):taskInLen[k];
+	strm.next_out=(unsigned char*)taskOut+taskOutOff[k];
+	strm.avail_out=taskOutLen[k];
+	while(strm.avail_out>0)
+	{
+		ret=inflate(&strm,Z_NO_FLUSH);
+		if(ret==Z_STREAM_END) break;
+		if(ret!=Z_OK)
+		{
+			taskFailed=1;
+			break;
+		}
+	}
+	if(strm.avail_out!=0) taskFailed=1;
+	inflateEnd(&strm);
+}
+
+/*************************************************
+Function: void *task_thread(void *arg);
+Description: take the next task until all of them are done
+Called By: void run_tasks(int threads, void (*task)(int)); int xpq_events(const char* content, long size, int threads, int batch, 
+XpqEventHandler handler, void* user);
+Input: arg--the function for each task
+*************************************************/
+void *task_thread(void *arg)
+{
+	void (*task)(int)=*(void (**)(int))arg;
+	int k;
+	while(1)
+	{
+		pthread_mutex_lock(&part_lock);
+		k=nextTask++;
+		pthread_mutex_unlock(&part_lock);
+		if(k>=taskCount) break;
+		task(k);
+	}
+	return NULL;
+}
+
+/*************************************************
+Function: void run_tasks(int threads, void (*task)(int));
+Description: run taskCount tasks by several threads, the calling thread is one of them
+Called By: char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name);
+Input: threads--the number of threads; task--the function for each task
+*************************************************/
+void run_tasks(int threads, void (*task)(int))
+{
+	pthread_t th[MAX_THREAD];
+	int i;
+	if(threads>MAX_THREAD) threads=MAX_THREAD;
+	if(threads>taskCount) threads=taskCount;
+	nextTask=0;
+	for(i=1;i<threads;i++)
+	{
+		if(pthread_create(&th[i],NULL,task_thread,&task)!=0) break;
+	}
+	threads=i;
+	task_thread(&task);
+	for(i=1;i<threads;i++)
+	{
+		pthread_join(th[i],NULL);
+	}
+}
+
+/*************************************************
+Function: char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name);
+Description: cut the compressed file into tasks with known ranges in the content, then decompress them in parallel. The tasks are 
+the members of BGZF, the spans between the access points of the gzip index, or the frames of zstd. A gzip file without an index 
+and zstd frames without the content size are decompressed sequentially.
+Called By: char* load_content(char* file_name, long* size);
+Input: data--the compressed file; size--the size of data; kind--the compression; index_name--the file for the gzip index
+Output: out_size--the size of the content
+Return: the content ended with '\0'; NULL--the file can't be decompressed
+*************************************************/
+char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name)
+{
+	long p=0,total=0,mlen,xlen;
+	int k,count=0,max=1024;
+	AccessPoint* point=NULL;
+	taskIn=(long*)malloc(max*sizeof(long));
+	taskInLen=(long*)malloc(max*sizeof(long));
+	taskOutOff=(long*)malloc(max*sizeof(long));
+	taskOutLen=(long*)malloc(max*sizeof(long));
+	if(kind==comp_gzip)
+	{
+		point=load_gz_index(index_name,size,&total,&count);
+		if(point==NULL) count=0;
+		else
+		{
+			taskIn=(long*)realloc(taskIn,count*sizeof(long));
+			taskInLen=(long*)realloc(taskInLen,count*sizeof(long));
+			taskOutOff=(long*)realloc(taskOutOff,count*sizeof(long));
+			taskOutLen=(long*)realloc(taskOutLen,count*sizeof(long));
+			for(k=0;k<count;k++)
+			{
+				taskIn[k]=point[k].in;
+				taskInLen[k]=size-point[k].in;
+				taskOutOff[k]=point[k].out;
+				taskOutLen[k]=((k+1<count)?point[k+1].out:total)-point[k].out;
+			}
+		}
+	}
+	else
+	{
+		while(p<size)
+		{
+			if(count==max)
+			{
+				max*=2;
+				taskIn=(long*)realloc(taskIn,max*sizeof(long));
+				taskInLen=(long*)realloc(taskInLen,max*sizeof(long));
+				taskOutOff=(long*)realloc(taskOutOff,max*sizeof(long));
+				taskOutLen=(long*)realloc(taskOutLen,max*sizeof(long));
+			}
+			if(kind==comp_bgzf)
+			{
+				if(detect_compression(data+p,size-p)!=comp_bgzf) break;
+				mlen=(data[p+16]|(data[p+17]<<8))+1;
+				xlen=data[p+10]|(data[p+11]<<8);
+				if(p+mlen>size||mlen<12+xlen+8) break;
+				taskIn[count]=p+12+xlen;
+				taskInLen[count]=mlen-12-xlen-8;
+				taskOutLen[count]=(long)data[p+mlen-4]|((long)data[p+mlen-3]<<8)|((long)data[p+mlen-2]<<16)|((long)data[p+mlen-1]<<24);
+			}
+			else
+			{
+#ifdef XPQ_ZSTD
+				unsigned long long content_size;
+				mlen=ZSTD_findFrameCompressedSize(data+p,size-p);
+				if(ZSTD_isError(mlen)) break;
+				content_size=ZSTD_getFrameContentSize(data+p,mlen);
+				if(content_size==ZSTD_CONTENTSIZE_UNKNOWN||content_size==ZSTD_CONTENTSIZE_ERROR) break;
+				taskIn[count]=p;
+				taskInLen[count]=mlen;
+				taskOutLen[count]=content_size;
+#else
+				break;
+#endif
+			}
+			taskOutOff[count]=total;
+			total+=taskOutLen[count];
+			count++;
+			p+=mlen;
+		}
+		if(p<size) count=0;  //the sizes are unknown, decompress it sequentially
+	}
+	char* content=NULL;
+	if(count>0)
+	{
+		taskCount=count;
+		taskData=data;
+		taskPoint=point;
+		taskFailed=0;
+		taskOut=(char*)malloc(total+1);
+#ifdef XPQ_ZSTD
+		run_tasks(inflateThreads,kind==comp_zstd?zstd_task:inflate_task);
+#else
+		run_tasks(inflateThreads,inflate_task);
+#endif
+		content=taskOut;
+		if(taskFailed==1)
+		{
+			free(content);
+			content=NULL;
+		}
+		else
+		{
+			content[total]='\0';
+			*out_size=total;
+		}
+	}
+	free(taskIn);
+	free(taskInLen);
+	free(taskOutOff);
+	free(taskOutLen);
+	free(point);
+	if(count>0) return content;
+	if(kind==comp_zstd)
+	{
+#ifdef XPQ_ZSTD
+		return unzstd(data,size,out_size);
+#else
+		printf("This program is built without zstd, please build it with XPQ_ZSTD and libzstd.\n");
+		return NULL;
+#endif
+	}
+	return gunzip(data,size,out_size,index_name,0);  //BGZF which is not well formed is inflated as gzip with several members
+}
+
+/*************************************************
+Function: int save_gz_index(char* index_name, long in_size, long out_size, AccessPoint* point, int count);
+Description: save the access points of a gzip file, together with the sizes to check the index when it is loaded
+Called By: char* gunzip(unsigned char* data, long size, long* out_size, char* index_name, long parts);
+Input: index_name--the file for the index; in_size--the size of the gzip file; out_size--the size of the content; 
+point--the access points; count--the number of access points
+Return: 0--success; -1--the index can't be written
+*************************************************/
+int save_gz_index(char* index_name, long in_size, long out_size, AccessPoint* point, int count)
+{
+	FILE *fp=fopen(index_name,"wb");
+	if(fp==NULL) return -1;
+	fwrite("XPQGZIX1",1,8,fp);
+	fwrite(&in_size,sizeof(long),1,fp);
+	fwrite(&out_size,sizeof(long),1,fp);
+	fwrite(&count,sizeof(int),1,fp);
+	fwrite(point,sizeof(AccessPoint),count,fp);
+	fclose(fp);
+	printf("The index of access points is saved into %s.\n",index_name);
+	return 0;
+}
+
+/*************************************************
+Function: AccessPoint* load_gz_index(char* index_name, long in_size, long* out_size, int* count);
+Description: load the access points of a gzip file, the index is dropped if it is not for a file of this size
+Called By: char* inflate_parallel(unsigned char* data, long size, long* out_size, comp_Kind kind, char* index_name); 
+int stream_input(char* file_name);
+Input: index_name--the file for the index, NULL--no index; in_size--the size of the gzip file
+Output: out_size--the size of the content; count--the number of access points
+Return: the access points; NULL--no index for this file
+*************************************************/
+AccessPoint* load_gz_index(char* index_name, long in_size, long* out_size, int* count)
+{
+	FILE *fp;
+	char magic[8];
+	long size;
+	AccessPoint* point;
+	if(index_name==NULL) return NULL;
+	fp=fopen(index_name,"rb");
+	if(fp==NULL) return NULL;
+	if(fread(magic,1,8,fp)!=8||memcmp(magic,"XPQGZIX1",8)!=0||fread(&size,sizeof(long),1,fp)!=1||size!=in_size
+		||fread(out_size,sizeof(long),1,fp)!=1||fread(count,sizeof(int),1,fp)!=1||*count<1)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	point=(AccessPoint*)malloc(*count*sizeof(AccessPoint));
+	if(fread(point,sizeof(AccessPoint),*count,fp)!=(size_t)*count)
+	{
+		free(point);
+		point=NULL;
+	}
+	fclose(fp);
+	return point;
+}
+
+/*************************************************
+Function: int stream_input(char* file_name);
+Description: whether the file should be dealt with by the decompression pipeline: a gzip file which is not BGZF and has no index 
+can only be inflated sequentially, so the parts are dealt with while it is inflated.
+Called By: int main(void);
+Input: file_name--the name for the file
+Return: 1--use the pipeline; 0--load the whole file
+*************************************************/
+int stream_input(char* file_name)
+{
+	char* index_name;
+	long out_size,size;
+	int count;
+	struct stat st;
+	AccessPoint* point;
+	if(file_compression(file_name)!=comp_gzip||encodingMode==1||stat(file_name,&st)!=0) return 0;  //the encoding stage needs the whole content
+	size=st.st_size;
+	index_name=(char*)malloc(strlen(file_name)+6);
+	sprintf(index_name,"%s.zidx",file_name);
+	point=load_gz_index(index_name,size,&out_size,&count);
+	free(index_name);
+	if(point==NULL) return 1;
+	free(point);
+	return 0;
+}
+
+/*************************************************
+Function: int stream_parts(char* file_name, int parts);
+Description: the decompression pipeline. The file is inflated by the calling thread, and each part is published as soon as it is 
+inflated, while the threads deal with the parts published before. The index is saved for the next time.
+Called By: int main(void);
+Input: file_name--the name for the file; parts--the number of parts expected
+Return: the number of the last part; -1--the file can't be inflated
+*************************************************/
+int stream_parts(char* file_name, int parts)
+{
+	long size,out_size;
+	char* index_name;
+	unsigned char* data=read_whole(file_name,&size);
+	char* content=NULL;
+	if(data!=NULL)
+	{
+		index_name=(char*)malloc(strlen(file_name)+6);
+		sprintf(index_name,"%s.zidx",file_name);
+		content=gunzip(data,size,&out_size,index_name,parts);
+		free(index_name);
+		free(data);
+	}
+	pthread_mutex_lock(&part_lock);
+	inputDone=1;
+	pthread_cond_broadcast(&part_ready);
+	pthread_mutex_unlock(&part_lock);
+	if(content==NULL) return -1;
+	free(content);
+	return partCount-1;
+}
+
+/*************************************************
+Function: long publish_blocks(char* data, long size, long offset, int last);
+Description: publish the full blocks of the bytes read from stdin. A part ends before the first open angle bracket after STDIN_BLOCK
+bytes, so that every part except the first one starts with a tag. Before a part is published, the calling thread waits until
+its slot is free(the part MAX_PART before it has been merged).
+Called By: int stdin_parts(void);
+Input: data--the bytes read but not published; size--the size of data; offset--the offset of data in the file;
+last--1: stdin is ended, the rest of the bytes is the last part
+Return: the bytes published
+*************************************************/
+long publish_blocks(char* data, long size, long offset, int last)
+{
+	long done=0,cut;
+	char* next;
+	while(stopInput==0&&size-done>0)
+	{
+		if(size-done>STDIN_BLOCK&&(next=(char*)memchr(data+done+STDIN_BLOCK,'<',size-done-STDIN_BLOCK))!=NULL) cut=next-data;
+		else if(last==1) cut=size;
+		else break;  //wait for more bytes
+		pthread_mutex_lock(&part_lock);
+		while(partCount-mergedParts>=MAX_PART&&stopInput==0)
+		{
+			pthread_cond_wait(&part_ready,&part_lock);
+		}
+		pthread_mutex_unlock(&part_lock);
+		if(stopInput==1) break;
+		publish_content(data+done,cut-done,offset+done);
+		done=cut;
+	}
+	return done;
+}
+
+/*************************************************
+Function: int stdin_parts(void);
+Description: read the XML from stdin or a pipe by the calling thread, and publish each block as a part as soon as it is read,
+while the threads deal with the parts published before. The memory is bounded by MAX_PART parts, since the parts are merged
+in document order as they are done. A compressed stream can't be split before it is decompressed, and a stream in another 
+encoding is transcoded into UTF-8, so they are read as a whole; UTF-8 is validated block by block with encoding-mode 1.
+No more blocks are read once the first N outputs have been printed.
+Called By: int main(void);
+Return: the number of the last part; -1--nothing is read from stdin
+*************************************************/
+int stdin_parts(void)
+{
+	long max=2*STDIN_BLOCK,size=0,offset=0,done,out_size,valid=0,k;
+	char* data=(char*)malloc((max+1)*sizeof(char));
+	char* content;
+	char name[MAX_LINE];
+	comp_Kind kind=comp_none;
+	int checked=0;
+	int whole=0;  //1--stdin is read as a whole before it is published(compressed, or transcoded into UTF-8)
+	while(stopInput==0&&(k=read(0,data+size,max-size))!=0)
+	{
+		if(k<0)
+		{
+			if(errno==EINTR) continue;
+			break;
+		}
+		size+=k;
+		if(checked==0&&size>=ENC_HEAD)  //a block is published only after STDIN_BLOCK bytes, so the magic number and the encoding are known before
+		{
+			kind=detect_compression((unsigned char*)data,size);
+			whole=(kind!=comp_none||(encodingMode==1&&detect_encoding((unsigned char*)data,size,name)!=enc_utf8));
+			checked=1;
+		}
+		if(whole==0)
+		{
+			if(encodingMode==1&&checked==1)  //UTF-8 is validated up to the last open angle bracket, where no character is cut
+			{
+				for(k=size;k>valid&&data[k-1]!='<';k--);
+				if(k>valid&&(done=utf8_invalid((unsigned char*)data+valid,k-1-valid))!=-1)
+				{
+					printf("The XML from stdin is not valid UTF-8 at %ld.\n",offset+valid+done);
+					stopInput=1;
+					break;
+				}
+				if(k>valid) valid=k-1;
+			}
+			done=publish_blocks(data,size,offset,0);
+			memmove(data,data+done,size-done);
+			size-=done;
+			offset+=done;
+			valid=(valid>done)?valid-done:0;
+		}
+		if(size==max)
+		{
+			max*=2;
+			data=(char*)realloc(data,(max+1)*sizeof(char));
+		}
+	}
+	if(checked==0)
+	{
+		kind=detect_compression((unsigned char*)data,size);
+		whole=(kind!=comp_none||encodingMode==1);
+	}
+	if(stopInput==1)
+	{
+		//the first N outputs have been printed or stdin is not valid UTF-8, the rest is not published
+	}
+	else if(whole==1)
+	{
+		out_size=size;
+		if(kind!=comp_none)
+		{
+			content=inflate_parallel((unsigned char*)data,size,&out_size,kind,NULL);
+			if(content==NULL) printf("The compressed XML from stdin can not be decompressed.\n");
+		}
+		else
+		{
+			data[size]='\0';
+			content=data;
+			data=NULL;
+		}
+		if(content!=NULL&&encodingMode==1) content=decode_content(content,&out_size,"from stdin");
+		if(content!=NULL)
+		{
+			publish_blocks(content,out_size,0,1);
+			free(content);
+		}
+	}
+	else if(encodingMode==1&&(done=utf8_invalid((unsigned char*)data+valid,size-valid))!=-1)
+	{
+		printf("The XML from stdin is not valid UTF-8 at %ld.\n",offset+valid+done);
+	}
+	else publish_blocks(data,size,offset,1);
+	free(data);
+	pthread_mutex_lock(&part_lock);
+	inputDone=1;
+	pthread_cond_broadcast(&part_ready);
+	pthread_mutex_unlock(&part_lock);
+	return partCount-1;
+}
+
+/*************************************************
+Function: char* ReadXPath(char* xpath_name);
+Description: load XPath from related file
+Called By: int main(void);
+Input: xpath_name--the name for the XPath file
+Return: the contents in the Xpath file; error--can't open the XPath file
+*************************************************/
+char* ReadXPath(char* xpath_name)
+{
+	FILE *fp;
+	char* buf=(char*)malloc(MAX_LINE*sizeof(char));
+	char* xpath=(char*)malloc(MAX_LINE*sizeof(char));
+	xpath=strcpy(xpath,"");
+	if((fp = fopen(xpath_name,"r")) == NULL)
+    {
+        xpath=strcpy(xpath,"error");
+    }
+    else{
+    	while(fgets(buf,MAX_LINE,fp) != NULL)
+    	{
+    		xpath=strcat(xpath,buf);
+		}
+	}
+	free(buf);
+    return xpath;
+}
+
+/*************************************************
+Function: int createAutoMachine(char* xmlPath);
+Description: create an automata by the XPath Query command. The output tag(the last step) could have predicates on its attributes, 
+e.g /company/develop/programmer[@age="35"][@sex], and one of its attributes could be output instead of its text, 
+e.g /company/develop/programmer/@age.
+Called By: int main(void); int compile_query(char* xpath);
+Input: xmlPath--XPath Query command
+Return: 0--success; -1--XPath is not correct
+*************************************************/
+int createAutoMachine(char* xmlPath)
+{
+	char *token = next_step(&xmlPath); 
+	char *bracket;
+	grow_automata();
+	if(token!=NULL&&token[0]=='@')
+	{
+		printf("The attribute in XPath must be the last step after a tag, please open the config and check it again!\n");
+		return -1;
+	}
+	while(token!= NULL) 
+	{
+		grow_automata();
+		stateCount++;
+		bracket=strchr(token,'[');
+		if(bracket!=NULL) *bracket='\0';
+		stateMachine[machineCount].start=stateCount;
+		stateMachine[machineCount].str=(char*)malloc((strlen(token)+1)*sizeof(char));
+		stateMachine[machineCount].str=strcpy(stateMachine[machineCount].str,token);
+		stateMachine[machineCount].end=stateCount+1;
+		stateMachine[machineCount].isoutput=0;
+		stateMachine[machineCount].pred=NULL;
+		stateMachine[machineCount].predCount=0;
+		stateMachine[machineCount].maxPred=0;
+		stateMachine[machineCount].textPred=NULL;
+		stateMachine[machineCount].textPredCount=0;
+		stateMachine[machineCount].maxTextPred=0;
+		stateMachine[machineCount].outputAttr=NULL;
+		if(bracket!=NULL&&parse_predicates(bracket+1,&stateMachine[machineCount])==-1)
+		{
+			printf("The predicates of %s in XPath are not correct, please open the config and check it again!\n",token);
+			return -1;
+		}
+		machineCount++;
+		if(stateCount>=1)
+		{
+			stateMachine[machineCount].start=stateCount+1;
+			stateMachine[machineCount].str=(char*)malloc((strlen(stateMachine[machineCount-1].str)+2)*sizeof(char));
+			stateMachine[machineCount].str=strcpy(stateMachine[machineCount].str,"/");
+			stateMachine[machineCount].str=strcat(stateMachine[machineCount].str,stateMachine[machineCount-1].str);
+			stateMachine[machineCount].end=stateCount;
+			stateMachine[machineCount].isoutput=0;
+			stateMachine[machineCount].pred=NULL;
+			stateMachine[machineCount].predCount=0;
+			stateMachine[machineCount].maxPred=0;
+			stateMachine[machineCount].textPred=NULL;
+			stateMachine[machineCount].textPredCount=0;
+			stateMachine[machineCount].maxTextPred=0;
+			stateMachine[machineCount].outputAttr=NULL;
+		}
+		token=next_step(&xmlPath);  
+		if(token!=NULL&&token[0]=='@')  //the attribute to be output
+		{
+			stateMachine[machineCount-1].outputAttr=strdup(token+1);
+			useAttributes=1;
+			token=next_step(&xmlPath);
+			if(token!=NULL||stateMachine[machineCount-1].outputAttr[0]=='\0')
+			{
+				printf("The attribute in XPath must be the last step after a tag, please open the config and check it again!\n");
+				return -1;
+			}
+			if(stateMachine[machineCount-1].textPredCount>0)
+			{
+				printf("The attribute is output before the text, so it can not have the predicates on the text, please open the config and check it again!\n");
+				return -1;
+			}
+		}
+		if(token==NULL)
+		{
+			stateMachine[machineCount-1].isoutput=1;
+			stateMachine[machineCount].isoutput=1;
+		}
+		else
+		{
+			if(stateMachine[machineCount-1].predCount>0||stateMachine[machineCount-1].textPredCount>0)
+			{
+				printf("Only the last step in XPath could have predicates, please open the config and check it again!\n");
+				return -1;
+			}
+			machineCount++;
+		}
+	}
+    stateCount++;
+    return 0;
+}
+
+/*************************************************
+Function: void grow_automata(void);
+Description: make room for the two nodes of the next step of XPath, stateMachine is doubled and the new nodes are cleared.
+Called By: int createAutoMachine(char* xmlPath);
+*************************************************/
+void grow_automata(void)
+{
+	int old=maxMachine;
+	if(machineCount+2<maxMachine) return;
+	while(machineCount+2>=maxMachine) maxMachine=(maxMachine>0)?maxMachine*2:INIT_MACHINE;
+	stateMachine=(Automata*)realloc(stateMachine,maxMachine*sizeof(Automata));
+	memset(stateMachine+old,0,(maxMachine-old)*sizeof(Automata));
+}
+
+/*************************************************
+Function: char* next_step(char** cursor);
+Description: get the next step of XPath. The steps are separated by '/', but the '/' in the predicates(e.g [@url="a/b"]) is kept.
+Called By: int createAutoMachine(char* xmlPath);
+Input: cursor--the rest of XPath
+Output: cursor--the rest of XPath after this step
+Return: the next step(ended with '\0'); NULL--no more steps
+*************************************************/
+char* next_step(char** cursor)
+{
+	char *p=*cursor;
+	char *step;
+	char quote=0;
+	int depth=0;
+	while(*p=='/') p++;
+	if(*p=='\0') return NULL;
+	step=p;
+	for(;*p!='\0';p++)
+	{
+		if(quote!=0)
+		{
+			if(*p==quote) quote=0;
+		}
+		else if(*p=='"'||*p=='\'') quote=*p;
+		else if(*p=='[') depth++;
+		else if(*p==']') depth--;
+		else if(*p=='/'&&depth==0) break;
+	}
+	if(*p=='/') *p++='\0';
+	*cursor=p;
+	return step;
+}
+
+/*************************************************
+Function: int parse_predicates(char* s, Automata* node);
+Description: parse the predicates of a step, each of them is [@name], [@name="value"] or [@name op number] 
+where op is one of = != < <= > >=. A quoted value is compared as a string, a value without quotes is compared as a number. 
+The text of the tag is compared by [text() op value], [contains(text(),"value")] or [starts-with(text(),"value")].
+Called By: int createAutoMachine(char* xmlPath);
+Input: s--the predicates after the first '['; node--the start tag in the automata
+Output: node->pred, node->predCount--the predicates on the attributes; node->textPred, node->textPredCount--the predicates on the text
+Return: 0--success -1--wrong format
+*************************************************/
+int parse_predicates(char* s, Automata* node)
+{
+	Predicate* pred;
+	char *p=s;
+	char *name;
+	char quote;
+	int text;  //1--the predicate is on the text
+	while(1)
+	{
+		while(*p==' ') p++;
+		text=(*p!='@');
+		if(text==1&&node->textPredCount==node->maxTextPred) node->textPred=grow_predicates(node->textPred,&node->maxTextPred);
+		if(text==0&&node->predCount==node->maxPred) node->pred=grow_predicates(node->pred,&node->maxPred);
+		pred=(text==1)?&node->textPred[node->textPredCount]:&node->pred[node->predCount];
+		pred->name=NULL;
+		pred->value=NULL;
+		pred->value_len=0;
+		pred->numeric=0;
+		if(text==1&&(strncmp(p,"contains(",9)==0||strncmp(p,"starts-with(",12)==0))
+		{
+			pred->op=(*p=='c')?pred_contains:pred_starts;
+			p=strchr(p,'(')+1;
+			while(*p==' ') p++;
+			if(strncmp(p,"text()",6)!=0) return -1;
+			p+=6;
+			while(*p==' ') p++;
+			if(*p!=',') return -1;
+			p++;
+			while(*p==' ') p++;
+			if(*p!='"'&&*p!='\'') return -1;
+			quote=*p++;
+			name=p;
+			while(*p!='\0'&&*p!=quote) p++;
+			if(*p!=quote) return -1;
+			pred->value_len=p-name;
+			pred->value=(char*)malloc((pred->value_len+1)*sizeof(char));
+			memcpy(pred->value,name,pred->value_len);
+			pred->value[pred->value_len]='\0';
+			p++;
+			while(*p==' ') p++;
+			if(*p!=')') return -1;
+			p++;
+			while(*p==' ') p++;
+			if(*p!=']') return -1;
+			pred->name=strdup("text()");
+			pred->name_len=6;
+			p++;
+			node->textPredCount++;
+			while(*p==' ') p++;
+			if(*p=='\0') return 0;
+			if(*p!='[') return -1;
+			p++;
+			continue;
+		}
+		if(text==1)
+		{
+			if(strncmp(p,"text()",6)!=0) return -1;
+			name=p;
+			p+=6;
+		}
+		else name=++p;
+		while(*p!='\0'&&*p!=']'&&*p!='='&&*p!='!'&&*p!='<'&&*p!='>'&&*p!=' ') p++;
+		pred->name_len=p-name;
+		pred->name=(char*)malloc((pred->name_len+1)*sizeof(char));
+		memcpy(pred->name,name,pred->name_len);
+		pred->name[pred->name_len]='\0';
+		if(pred->name_len==0||(text==1&&pred->name_len!=6)) return -1;
+		while(*p==' ') p++;
+		if(*p==']'&&text==1) return -1;  //[text()] is always true
+		if(*p==']') pred->op=pred_exist;
+		else
+		{
+			if(*p=='=') {pred->op=pred_eq; p++;}
+			else if(*p=='!'&&*(p+1)=='=') {pred->op=pred_ne; p+=2;}
+			else if(*p=='<'&&*(p+1)=='=') {pred->op=pred_le; p+=2;}
+			else if(*p=='<') {pred->op=pred_lt; p++;}
+			else if(*p=='>'&&*(p+1)=='=') {pred->op=pred_ge; p+=2;}
+			else if(*p=='>') {pred->op=pred_gt; p++;}
+			else return -1;
+			while(*p==' ') p++;
+			if(*p=='"'||*p=='\'')
+			{
+				quote=*p++;
+				name=p;
+				while(*p!='\0'&&*p!=quote) p++;
+				if(*p!=quote) return -1;
+				pred->value_len=p-name;
+				p++;
+			}
+			else
+			{
+				name=p;
+				while(*p!='\0'&&*p!=']'&&*p!=' ') p++;
+				pred->value_len=p-name;
+				pred->numeric=1;
+			}
+			pred->value=(char*)malloc((pred->value_len+1)*sizeof(char));
+			memcpy(pred->value,name,pred->value_len);
+			pred->value[pred->value_len]='\0';
+			if(pred->numeric==1)
+			{
+				char* rest;
+				pred->number=strtod(pred->value,&rest);
+				if(rest==pred->value||*rest!='\0') return -1;
+			}
+			else if(pred->op!=pred_eq&&pred->op!=pred_ne) return -1;  //strings are only compared by = and !=
+			while(*p==' ') p++;
+			if(*p!=']') return -1;
+		}
+		p++;
+		if(text==1) node->textPredCount++;
+		else
+		{
+			node->predCount++;
+			useAttributes=1;
+		}
+		while(*p==' ') p++;
+		if(*p=='\0') return 0;
+		if(*p!='[') return -1;
+		p++;
+	}
+}
+
+/*************************************************
+Function: Predicate* grow_predicates(Predicate* pred, int* max);
+Description: double the capacity of the predicates of a tag, starting with INIT_PRED
+Called By: int parse_predicates(char* s, Automata* node);
+Input: pred--the predicates, NULL for none; max--the capacity of pred
+Output: max--the new capacity
+Return: the predicates reallocated
+*************************************************/
+Predicate* grow_predicates(Predicate* pred, int* max)
+{
+	*max=(*max>0)?*max*2:INIT_PRED;
+	return (Predicate*)realloc(pred,*max*sizeof(Predicate));
+}
+
+/*************************************************
+Function: int generate_lexer(char* file_name, char* xpath);
+Description: write the C source of the tag matchers specialized for XPath. Tags are grouped by their length, and each tag name 
+is compared character by character with the transition of its state folded into constants, so no string in stateMachine is read 
+while lexing. The source could be built as a plugin for lexer-plugin or built into this program with XPQ_STATIC. xpq_skip_dead_states 
+only turns on the jumps over text, comments, CDATA and unused attributes, which do not depend on the state of the automata: the 
+subtrees which can not lead to a match are still lexed. The XPath is written into the comment with a space between '*' and '/', and the bytes of a 
+name which are not printable ASCII are written as hexadecimal escapes.
+Called By: int main(void);
+Input: file_name--the name for the C source; xpath--the XPath Query command
+Return: 0--success; -1--can't write the file
+*************************************************/
+int generate_lexer(char* file_name, char* xpath)
+{
+	FILE *fp;
+	int i,j,k,kind,len,found;
+	char *name;
+	if((fp = fopen(file_name,"w")) == NULL) return -1;
+	fprintf(fp,"/* Lexer specialized for the XPath ");
+	for(i=0;xpath[i]!='\0';i++)
+	{
+		fputc(xpath[i],fp);
+		if(xpath[i]=='*'&&xpath[i+1]=='/') fputc(' ',fp);  //the comment is not closed by the XPath
+	}
+	fprintf(fp,", generated by XML_parallel.\n");
+	fprintf(fp,"   Plugin: gcc -O2 -shared -fPIC -o query.so %s, then lexer-plugin=./query.so in config.\n",file_name);
+	fprintf(fp,"   Built in: gcc -O2 -DXPQ_STATIC XML_parallel.c %s -o XML_parallel -lpthread -lz -lm -ldl */\n\n",file_name);
+	fprintf(fp,"const char xpq_query[]=\"");
+	for(i=0;xpath[i]!='\0';i++)
+	{
+		if(xpath[i]=='"'||xpath[i]=='\\') fputc('\\',fp);
+		fputc(xpath[i],fp);
+	}
+	fprintf(fp,"\";\n");
+	fprintf(fp,"const int xpq_skip_dead_states=1;\n");
+	for(kind=0;kind<2;kind++)  //0--start tags(odd nodes) 1--end tags(even nodes)
+	{
+		fprintf(fp,"\nint xpq_match_%s(const char* s, int len, int* begin, int* end)\n{\n\tswitch(len)\n\t{\n",kind==0?"start":"end");
+		for(i=(kind==0?machineCount-1:machineCount);i>=1;i=i-2)
+		{
+			len=strlen(stateMachine[i].str);
+			found=0;
+			for(j=(kind==0?machineCount-1:machineCount);j>i;j=j-2)
+			{
+				if((int)strlen(stateMachine[j].str)==len) found=1;
+			}
+			if(found==1) continue;  //this length has been written
+			fprintf(fp,"\t\tcase %d:\n",len);
+			for(j=i;j>=1;j=j-2)
+			{
+				name=stateMachine[j].str;
+				if((int)strlen(name)!=len) continue;
+				fprintf(fp,"\t\t\tif(");
+				for(k=0;k<len;k++)
+				{
+					if(k>0) fprintf(fp,"&&");
+					if(name[k]=='\''||name[k]=='\\') fprintf(fp,"s[%d]=='\\%c'",k,name[k]);
+					else if((unsigned char)name[k]<0x20||(unsigned char)name[k]>=0x7f) fprintf(fp,"s[%d]=='\\x%02x'",k,(unsigned char)name[k]);
+					else fprintf(fp,"s[%d]=='%c'",k,name[k]);
+				}
+				fprintf(fp,") {*begin=%d; *end=%d; return %d;}\n",stateMachine[j].start,stateMachine[j].end,j);
+			}
+			fprintf(fp,"\t\t\tbreak;\n");
+		}
+		fprintf(fp,"\t}\n\treturn -1;\n}\n");
+	}
+	fclose(fp);
+	return 0;
+}
+
+/*************************************************
+Function: int load_lexer(char* plugin_name, char* xpath);
+Description: use the tag matchers of a specialized lexer. If the program is built with XPQ_STATIC, the built-in lexer is used, 
+otherwise the plugin is loaded. The lexer is only used when it is generated for the same XPath, otherwise stateMachine is interpreted.
+Called By: int main(void);
+Input: plugin_name--the name for the plugin, empty if there is none; xpath--the XPath Query command
+Return: 0--the specialized lexer is used; -1--stateMachine is interpreted
+*************************************************/
+int load_lexer(char* plugin_name, char* xpath)
+{
+	const char* query=NULL;
+	const int* skip=NULL;
+#ifdef XPQ_STATIC
+	query=xpq_query;
+	skip=&xpq_skip_dead_states;
+	startMatcher=xpq_match_start;
+	endMatcher=xpq_match_end;
+#elif !defined(_WIN32)
+	if(plugin_name[0]=='\0') return -1;
+	void* handle=dlopen(plugin_name,RTLD_NOW);
+	if(handle==NULL)
+	{
+		printf("The lexer plugin %s can not be loaded(%s), the automata is interpreted instead.\n",plugin_name,dlerror());
+		return -1;
+	}
+	query=(const char*)dlsym(handle,"xpq_query");
+	skip=(const int*)dlsym(handle,"xpq_skip_dead_states");
+	startMatcher=(TagMatcher)dlsym(handle,"xpq_match_start");
+	endMatcher=(TagMatcher)dlsym(handle,"xpq_match_end");
+#else
+	if(plugin_name[0]=='\0') return -1;
+	printf("The lexer plugin is not supported on this system, the automata is interpreted instead.\n");
+	return -1;
+#endif
+	if(query==NULL||startMatcher==NULL||endMatcher==NULL||strcmp(query,xpath)!=0)
+	{
+		printf("The specialized lexer is not generated for the XPath %s, the automata is interpreted instead.\n",xpath);
+		startMatcher=NULL;
+		endMatcher=NULL;
+		return -1;
+	}
+	skipDeadStates=(skip!=NULL)?*skip:0;
+	build_lexer();
+	printf("The lexer specialized for the XPath %s is used.\n",xpath);
+	return 0;
+}
+
+/*************************************************
+Function: void build_lexer(void);
+Description: fill the tables of the lexer. The first rule of each state is for all the classes, and the rules after it are for the 
+bytes which end a token or change the state. The actions which jump over the text, comments and CDATA are used only if skipDeadStates.
+Called By: int main(void); int load_lexer(char* plugin_name, char* xpath); int xpq_events(const char* content, long size, int threads, 
+int batch, XpqEventHandler handler, void* user);
+*************************************************/
+void build_lexer(void)
+{
+	int skip=(skipDeadStates==1);
+	memset(lexClass,lex_c_other,sizeof(lexClass));
+	lexClass['<']=lex_c_lt;
+	lexClass['>']=lex_c_gt;
+	lexClass['/']=lex_c_slash;
+	lexClass['?']=lex_c_question;
+	lexClass['!']=lex_c_bang;
+	lexClass[' ']=lex_c_space;
+	lexClass['-']=lex_c_dash;
+	lexClass['[']=lex_c_lbracket;
+	lexClass[']']=lex_c_rbracket;
+	lexClass['"']=lex_c_quote;
+	lexClass['=']=lex_c_equal;
+	lex_rule(0,-1,7,lex_a_none);         /* between the markups */
+	lex_rule(0,lex_c_lt,1,lex_a_open);
+	lex_rule(0,lex_c_space,0,lex_a_none);
+	lex_rule(1,-1,5,lex_a_name);         /* after '<' */
+	lex_rule(1,lex_c_question,2,lex_a_none);
+	lex_rule(1,lex_c_slash,4,lex_a_close_name);
+	lex_rule(1,lex_c_bang,8,lex_a_none);
+	lex_rule(1,lex_c_space,LEX_ERROR,lex_a_none);
+	lex_rule(2,-1,2,lex_a_none);         /* <?xxx */
+	lex_rule(2,lex_c_question,3,lex_a_none);
+	lex_rule(3,-1,LEX_ERROR,lex_a_none);
+	lex_rule(3,lex_c_gt,0,lex_a_head);
+	lex_rule(4,-1,4,lex_a_none);         /* </xxx */
+	lex_rule(4,lex_c_gt,0,lex_a_end);
+	lex_rule(4,lex_c_space,LEX_ERROR,lex_a_none);
+	lex_rule(5,-1,5,lex_a_none);         /* <xxx */
+	lex_rule(5,lex_c_gt,0,lex_a_begin);
+	lex_rule(5,lex_c_slash,6,lex_a_name_end);
+	lex_rule(5,lex_c_space,13,lex_a_attributes);
+	lex_rule(6,-1,LEX_ERROR,lex_a_none); /* <xxx/ */
+	lex_rule(6,lex_c_gt,0,lex_a_empty);
+	lex_rule(7,-1,7,skip?lex_a_skip_text:lex_a_none);  /* text */
+	lex_rule(7,lex_c_lt,0,lex_a_text);
+	lex_rule(8,-1,LEX_ERROR,lex_a_none); /* <! */
+	lex_rule(8,lex_c_dash,9,lex_a_none);
+	lex_rule(8,lex_c_lbracket,LEX_ERROR,lex_a_cdata_open);
+	lex_rule(9,-1,LEX_ERROR,lex_a_none);
+	lex_rule(9,lex_c_dash,10,lex_a_none);
+	lex_rule(10,-1,10,skip?lex_a_skip_comment:lex_a_none);  /* comment */
+	lex_rule(10,lex_c_dash,11,lex_a_none);
+	lex_rule(11,-1,LEX_ERROR,lex_a_none);
+	lex_rule(11,lex_c_dash,12,lex_a_none);
+	lex_rule(12,-1,LEX_ERROR,lex_a_none);
+	lex_rule(12,lex_c_gt,0,lex_a_comment);
+	lex_rule(13,-1,13,lex_a_none);       /* attribute name */
+	lex_rule(13,lex_c_gt,LEX_ERROR,lex_a_none);
+	lex_rule(13,lex_c_equal,14,lex_a_attribute_name);
+	lex_rule(14,-1,LEX_ERROR,lex_a_none);
+	lex_rule(14,lex_c_quote,15,lex_a_value_open);
+	lex_rule(14,lex_c_space,14,lex_a_none);
+	lex_rule(15,-1,15,lex_a_none);       /* attribute value */
+	lex_rule(15,lex_c_quote,5,lex_a_attribute_value);
+	lex_rule(16,-1,LEX_ERROR,lex_a_none);
+	lex_rule(16,lex_c_lbracket,17,lex_a_none);
+	lex_rule(17,-1,17,skip?lex_a_skip_cdata:lex_a_none);  /* CDATA */
+	lex_rule(17,lex_c_rbracket,18,lex_a_none);
+	lex_rule(18,-1,LEX_ERROR,lex_a_none);
+	lex_rule(18,lex_c_rbracket,19,lex_a_none);
+	lex_rule(19,-1,LEX_ERROR,lex_a_none);
+	lex_rule(19,lex_c_gt,0,lex_a_cdata);
+	lex_rule(LEX_ERROR,-1,LEX_ERROR,lex_a_fail);
+}
+
+/*************************************************
+Function: void lex_rule(int state, int cls, int next, int action);
+Description: set the next state and the action of a state for a class of bytes
+Called By: void build_lexer(void);
+Input: state--the state; cls--the class of bytes, -1 for all the classes; next--the next state; action--the action(lex_Action)
+*************************************************/
+void lex_rule(int state, int cls, int next, int action)
+{
+	int c;
+	for(c=0;c<LEX_CLASSES;c++)
+	{
+		if(cls==-1||c==cls)
+		{
+			lexRule[state][c]=(unsigned short)(next|(action<<8));
+		}
+	}
+}
+
+/*************************************************
+Function: void aggregate_output(Aggregate* agg, char* p, int len);
+Description: fold an output into the partial aggregation of a part instead of keeping it. sum(), min() and max() only take the outputs 
+which are numbers, and distinct() adds the hash of the output(without blanks at both ends) to the HyperLogLog registers, and keeps it 
+while there are few distinct hashes. With decode-entities, an output which has '&' is folded after it is decoded.
+Called By: void add_output(int thread_num, char* p, int len);
+Input: agg--the partial aggregation; p--the beginning of the output in the XML text; len--the length of the output;
+*************************************************/
+void aggregate_output(Aggregate* agg, char* p, int len)
+{
+	char number[64],local[DECODE_BUFFER];
+	char *stop,*raw=p;
+	double value;
+	unsigned long long h;
+	int i,rank;
+	agg->count++;
+	if(aggKind==agg_count) return;
+	p=decode_value(raw,&len,local);
+	while(len>0&&isspace((unsigned char)p[len-1])) len--;
+	if(aggKind==agg_distinct)
+	{
+		h=14695981039346656037ULL;  //FNV-1a, then mixed so that all the bits are used
+		for(i=0;i<len;i++)
+		{
+			h=(h^(unsigned char)p[i])*1099511628211ULL;
+		}
+		h^=h>>33; h*=0xff51afd7ed558ccdULL; h^=h>>33; h*=0xc4ceb9fe1a85ec53ULL; h^=h>>33;
+		add_hash(agg,h);
+		rank=1;
+		while(rank<=64-HLL_BITS&&((h<<HLL_BITS)&(1ULL<<(64-rank)))==0) rank++;
+		if(rank>agg->hll[h>>(64-HLL_BITS)]) agg->hll[h>>(64-HLL_BITS)]=rank;
+	}
+	else if(len>0&&len<(int)sizeof(number))
+	{
+		memcpy(number,p,len);
+		number[len]='\0';
+		value=strtod(number,&stop);
+		if(stop!=number&&*stop=='\0')
+		{
+			if(agg->numbers==0||value<agg->min) agg->min=value;
+			if(agg->numbers==0||value>agg->max) agg->max=value;
+			agg->sum+=value;
+			agg->numbers++;
+		}
+	}
+	if(p!=raw&&p!=local) free(p);
+}
+
+/*************************************************
+Function: int add_event(int thread_num, int type, char* p, long len);
+Description: keep a token as an event of this part, with the depth from the beginning of the part. The events are doubled when 
+they are full.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; type--the type of the token; p--the beginning of the token in the XML text; len--its length
+Return: the number of the event in this part
+*************************************************/
+int add_event(int thread_num, int type, char* p, long len)
+{
+	EventList* l=&part_events[thread_num];
+	XpqEvent* e;
+	if(l->top==l->max)
+	{
+		l->max=(l->max>0)?l->max*2:INIT_OUTPUT;
+		l->event=(XpqEvent*)realloc(l->event,l->max*sizeof(XpqEvent));
+	}
+	e=&l->event[l->top];
+	e->type=type;
+	e->depth=l->depth;
+	e->offset=part_offset[thread_num]+(p-buffFiles[thread_num]);
+	e->len=(int)len;
+	return l->top++;
+}
+
+/*************************************************
+Function: void end_event(int thread_num, int ev, int type, char* p);
+Description: finish the event of a start tag at its end. The event is kept when the tag begins, so it is before the events of 
+the attributes; the elements after a start tag(not <xxx/>) are one level deeper.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; ev--the event of the tag; type--xml_tt_B or xml_tt_BE; p--after '>' of the tag
+*************************************************/
+void end_event(int thread_num, int ev, int type, char* p)
+{
+	EventList* l=&part_events[thread_num];
+	XpqEvent* e=&l->event[ev];
+	e->type=type;
+	e->len=(int)(part_offset[thread_num]+(p-buffFiles[thread_num])-e->offset);
+	if(type==xml_tt_B) l->depth++;
+}
+
+/*************************************************
+Function: int add_fragment(int thread_num, long begin, long end);
+Description: append a fragment to the state_stack of the related part, the capacity of the fragment list is doubled when it is full.
+Called By: void open_fragment(int thread_num, char* p); void close_fragment(int thread_num, char* p); 
+int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; begin, end--the offsets of the fragment in the file, -1 for the one in another part;
+Return: the index of this fragment in the part
+*************************************************/
+int add_fragment(int thread_num, long begin, long end)
+{
+	status* s=&state_stack[thread_num];
+	if(s->topfrag==s->maxfrag)
+	{
+		s->maxfrag*=2;
+		s->frag=(Fragment*)realloc(s->frag,s->maxfrag*sizeof(Fragment));
+		s->openfrag=(int*)realloc(s->openfrag,s->maxfrag*sizeof(int));
+	}
+	s->frag[s->topfrag].begin=begin;
+	s->frag[s->topfrag].end=end;
+	return s->topfrag++;
+}
+
+/*************************************************
+Function: void open_fragment(int thread_num, char* p, int passed);
+Description: a start tag of the output begins a fragment, its end is unknown until the close tag is met. A start tag rejected by 
+the predicates begins a FRAG_REJECTED marker instead, so its close tag doesn't end the enclosing fragment.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; p--'<' of the start tag in buffFiles; passed--1 if the predicates are satisfied, else 0
+*************************************************/
+void open_fragment(int thread_num, char* p, int passed)
+{
+	int k=add_fragment(thread_num,passed?part_offset[thread_num]+(p-buffFiles[thread_num]):FRAG_REJECTED,-1);
+	state_stack[thread_num].openfrag[state_stack[thread_num].topopen++]=k;
+}
+
+/*************************************************
+Function: void close_fragment(int thread_num, char* p);
+Description: a close tag of the output ends the last fragment(or FRAG_REJECTED marker) begun in this part. If there is no such 
+fragment, it begins in an earlier part, so only the end is saved and it is stitched by stitch_fragments.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; p--the end of the close tag in buffFiles;
+*************************************************/
+void close_fragment(int thread_num, char* p)
+{
+	long end=part_offset[thread_num]+(p-buffFiles[thread_num]);
+	status* s=&state_stack[thread_num];
+	if(s->topopen>0)
+	{
+		s->frag[s->openfrag[--s->topopen]].end=end;
+	}
+	else add_fragment(thread_num,-1,end);
+}
+
+/*************************************************
+Function: void check_tag(int thread_num, char* name, int len, int close);
+Description: check a tag for the validation. A start tag is kept until its close tag is met in this part; a close tag must match 
+the last start tag not closed in this part, and a close tag met when there is no such start tag is kept for the merge, since its 
+start tag is in an earlier part. After the first error of the part, the tags are not checked any more.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; name, len--the name of the tag in buffFiles; close--0 for a start tag, 1 for a close tag
+*************************************************/
+void check_tag(int thread_num, char* name, int len, int close)
+{
+	TagCheck* c=&part_check[thread_num];
+	TagName* t;
+	char reason[MAX_LINE*2];
+	if(c->error!=-1) return;
+	if(close==0)
+	{
+		if(c->topopen==c->maxopen)
+		{
+			c->maxopen*=2;
+			c->open=(TagName*)realloc(c->open,c->maxopen*sizeof(TagName));
+		}
+		t=&c->open[c->topopen++];
+		t->p=name;
+		t->len=len;
+		t->at=part_offset[thread_num]+(name-1-buffFiles[thread_num]);
+		return;
+	}
+	if(c->topopen>0)
+	{
+		t=&c->open[c->topopen-1];
+		if(t->len==len&&memcmp(t->p,name,len)==0) c->topopen--;
+		else
+		{
+			snprintf(reason,sizeof(reason),"the close tag </%.*s> does not match the start tag <%.*s> at %ld",
+				len>40?40:len,name,t->len>40?40:t->len,t->p,t->at);
+			check_error(thread_num,name-2,reason);
+		}
+		return;
+	}
+	if(c->topclose==c->maxclose)
+	{
+		c->maxclose*=2;
+		c->close=(TagName*)realloc(c->close,c->maxclose*sizeof(TagName));
+	}
+	t=&c->close[c->topclose++];
+	t->p=name;
+	t->len=len;
+	t->at=part_offset[thread_num]+(name-2-buffFiles[thread_num]);
+}
+
+/*************************************************
+Function: void check_error(int thread_num, char* p, char* reason);
+Description: keep the first error of a part for the validation
+Called By: void check_tag(int thread_num, char* name, int len, int close); 
+int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; p--where the error is in buffFiles; reason--what the error is
+*************************************************/
+void check_error(int thread_num, char* p, char* reason)
+{
+	TagCheck* c=&part_check[thread_num];
+	if(c->error!=-1) return;
+	c->error=part_offset[thread_num]+(p-buffFiles[thread_num]);
+	snprintf(c->reason,sizeof(c->reason),"%s",reason);
+}
+
+/*************************************************
+Function: void push(int thread_num,int nextState);
+Description: push the next state into stack
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of thread;nextState--the next state;
+*************************************************/
+void push(int thread_num,int nextState) 
+{
+	status* s=&state_stack[thread_num];
+	if(s->top_stack==s->maxstack) s->stack=grow_states(s->stack,s->small_stack,&s->maxstack);
+	s->stack[s->top_stack++]=nextState;
+}
+
+/*************************************************
+Function: void enqueue(int thread_num,int nextState);
+Description: append a state to the start queue
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); void pop(int next, int thread_num);
+Input: thread_num--the number of thread;nextState--the state;
+*************************************************/
+void enqueue(int thread_num,int nextState) 
+{
+	status* s=&state_stack[thread_num];
+	if(s->rear_queue==s->maxqueue) s->queue=grow_states(s->queue,s->small_queue,&s->maxqueue);
+	s->queue[s->rear_queue++]=nextState;
+}
+
+/*************************************************
+Function: int* grow_states(int* s, int* small, int* max);
+Description: double the capacity of a stack of states. A stack kept in a small array moves to the heap, the small array is not freed.
+Called By: void push(int thread_num,int nextState); void enqueue(int thread_num,int nextState); 
+void put_state(int** s, int* top, int* max, int state); int read_summary_parts(FILE* in, int first, int count);
+Input: s--the states; small--the small array of the owner, NULL for none; max--the capacity of s
+Output: max--the new capacity
+Return: the states moved or reallocated
+*************************************************/
+int* grow_states(int* s, int* small, int* max)
+{
+	int old=*max;
+	int* grown;
+	*max=(old>0)?old*2:SMALL_STATES;
+	if(s!=NULL&&s==small)
+	{
+		grown=(int*)malloc(*max*sizeof(int));
+		memcpy(grown,s,old*sizeof(int));
+		return grown;
+	}
+	return (int*)realloc(s,*max*sizeof(int));
+}
+
+/*************************************************
+Function: void reset_states(int i);
+Description: empty the stack and the queue of states of a part. They are kept in the small arrays at first; the heap taken by an 
+earlier deep part in the same slot is kept for the next one.
+Called By: int deal_part(int i); int deal_record(int t, long r); int read_summary_parts(FILE* in, int first, int count);
+Input: i--the number of part
+*************************************************/
+void reset_states(int i)
+{
+	status* s=&state_stack[i];
+	if(s->stack==NULL)
+	{
+		s->stack=s->small_stack;
+		s->maxstack=SMALL_STATES;
+		s->queue=s->small_queue;
+		s->maxqueue=SMALL_STATES;
+	}
+	s->top_stack=0;
+	s->rear_queue=0;
+}
+
+
+/*************************************************
+Function: void add_output(int thread_num, char* p, int len);
+Description: append an output to the state_stack of the related part, the capacity of the output list is doubled when it is full. 
+The output is not copied, it is a span of the XML text in buffFiles, which is kept until the results are printed. With decode-entities, 
+an output which has '&' is marked, and only the marked outputs are decoded when they are printed.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of part; p--the beginning of the output in the XML text; len--the length of the output;
+*************************************************/
+void add_output(int thread_num, char* p, int len)
+{
+	if(aggKind!=agg_none)
+	{
+		aggregate_output(&part_agg[thread_num],p,len);
+		return;
+	}
+	if(state_stack[thread_num].topput==state_stack[thread_num].maxput)
+	{
+		state_stack[thread_num].maxput*=2;
+		state_stack[thread_num].output=(xml_Text*)realloc(state_stack[thread_num].output,state_stack[thread_num].maxput*sizeof(xml_Text));
+		if(columnCount>0) part_columns[thread_num]=(xml_Text*)realloc(part_columns[thread_num],state_stack[thread_num].maxput*columnCount*sizeof(xml_Text));
+	}
+	state_stack[thread_num].output[state_stack[thread_num].topput].p=p;
+	state_stack[thread_num].output[state_stack[thread_num].topput].len=len;
+	state_stack[thread_num].output[state_stack[thread_num].topput].entity=(decodeMode==1&&find_amp(p,len)<len);
+	if(columnCount>0)
+	{
+		memcpy(part_columns[thread_num]+state_stack[thread_num].topput*columnCount,element_columns[thread_num],columnCount*sizeof(xml_Text));
+	}
+	state_stack[thread_num].topput++;
+}
+
+/*************************************************
+Function: void pop(int next, int thread_num);
+Description: if type of the xml element is End Tag(e.g </xxx>) and the content of the tag could be found in the automata, 
+then this function would delete the related state from the stack of state_stack. If no such node exists, the next state will
+be pushed into the queue of state_stack.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: next--the next state;thread_num--the number of thread;
+*************************************************/
+void pop(int next, int thread_num) //pop element due to end_tag e.g</d>
+{
+	int stack_top=-1;
+	int top=state_stack[thread_num].top_stack;
+	if(state_stack[thread_num].top_stack>1)
+	    stack_top=state_stack[thread_num].stack[top-2];  
+	if(stack_top!=-1&&stack_top==next) //for state next
+	{
+		state_stack[thread_num].top_stack--;
+	}
+	else //not in final stack, add it into the start queue
+	{
+		state_stack[thread_num].stack[top-1]=next;
+		enqueue(thread_num,next);
+	}
+}
+
+/*************************************************
+Function: int match_start_tag(char* name, int len, int* begin, int* end);
+Description: look for a start tag in the automata. The compiled matcher is used if there is a specialized lexer, 
+otherwise the start tags in stateMachine are compared from the last one.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: name--the tag name in the XML text(not ended with '\0'); len--the length of the name;
+Output: begin, end--the transition for this tag
+Return: the node in stateMachine for this tag; -1--not in the automata
+*************************************************/
+int match_start_tag(char* name, int len, int* begin, int* end)
+{
+	int j;
+	if(startMatcher!=NULL) return startMatcher(name,len,begin,end);
+	for(j=machineCount-1;j>=1;j=j-2)
+	{
+		if(strncmp(name,stateMachine[j].str,len)==0&&stateMachine[j].str[len]=='\0')
+		{
+			*begin=stateMachine[j].start;
+			*end=stateMachine[j].end;
+			return j;
+		}
+	}
+	return -1;
+}
+
+/*************************************************
+Function: int match_end_tag(char* name, int len, int* begin, int* end);
+Description: look for an end tag(e.g /xxx) in the automata. The compiled matcher is used if there is a specialized lexer, 
+otherwise the end tags in stateMachine are compared from the last one.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: name--the tag name with '/' in the XML text(not ended with '\0'); len--the length of the name;
+Output: begin, end--the transition for this tag
+Return: the node in stateMachine for this tag; -1--not in the automata
+*************************************************/
+int match_end_tag(char* name, int len, int* begin, int* end)
+{
+	int j;
+	if(endMatcher!=NULL) return endMatcher(name,len,begin,end);
+	for(j=machineCount;j>=1;j=j-2)
+	{
+		if(strncmp(name,stateMachine[j].str,len)==0&&stateMachine[j].str[len]=='\0')
+		{
+			*begin=stateMachine[j].start;
+			*end=stateMachine[j].end;
+			return j;
+		}
+	}
+	return -1;
+}
+
+/*************************************************
+Function: int match_ns_tag(int thread_num, char* name, int len, int close, int* begin, int* end);
+Description: look for a tag in the automata with namespaces. The prefix of the tag is resolved in the scope of the part, then the 
+steps are compared by the URI id and the hash of the local name, and the local name is compared at last.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of this part; name--the tag name in the XML text(without '/'); len--the length of the name; 
+close--0 for a start tag 1 for an end tag
+Output: begin, end--the transition for this tag
+Return: the node in stateMachine for this tag; -1--not in the automata
+*************************************************/
+int match_ns_tag(int thread_num, char* name, int len, int close, int* begin, int* end)
+{
+	int j,uri;
+	unsigned int hash;
+	char* colon=(char*)memchr(name,':',len);
+	char* local=(colon!=NULL)?colon+1:name;
+	int local_len=len-(local-name);
+	uri=(colon!=NULL)?resolve_prefix(thread_num,name,colon-name):resolve_prefix(thread_num,NULL,0);
+	if(uri==NS_OTHER) return -1;
+	hash=name_hash(local,local_len);
+	for(j=(close==0)?machineCount-1:machineCount;j>=1;j=j-2)
+	{
+		if(stateMachine[j].uri==uri&&stateMachine[j].hash==hash&&stateMachine[j].local_len==local_len
+			&&memcmp(stateMachine[j].local,local,local_len)==0)
+		{
+			*begin=stateMachine[j].start;
+			*end=stateMachine[j].end;
+			return j;
+		}
+	}
+	return -1;
+}
+
+/*************************************************
+Function: unsigned int name_hash(char* name, int len);
+Description: the hash(FNV-1a) of a local name, for the steps and the tags
+Called By: int match_ns_tag(int thread_num, char* name, int len, int close, int* begin, int* end); int resolve_steps(void);
+Input: name, len--the local name
+Return: the hash
+*************************************************/
+unsigned int name_hash(char* name, int len)
+{
+	unsigned int h=2166136261u;
+	int i;
+	for(i=0;i<len;i++)
+	{
+		h^=(unsigned char)name[i];
+		h*=16777619u;
+	}
+	return h;
+}
+
+/*************************************************
+Function: int intern_uri(char* uri, int len);
+Description: get the id of a URI in the XML text. Only the URIs of the query have their own ids, the others are NS_OTHER, since 
+they never match a step.
+Called By: void declare_namespaces(NsScope* scope, char* p, char* end, int level); int parse_namespaces(char* list);
+Input: uri, len--the URI(not ended with '\0')
+Return: the id of the URI; 0--the URI is empty(no namespace); NS_OTHER--the URI is not in the query
+*************************************************/
+int intern_uri(char* uri, int len)
+{
+	int k;
+	if(len==0) return 0;
+	for(k=1;k<=nsUriCount;k++)
+	{
+		if(strncmp(nsUris[k],uri,len)==0&&nsUris[k][len]=='\0') return k;
+	}
+	return NS_OTHER;
+}
+
+/*************************************************
+Function: void add_binding(NsScope* scope, char* prefix, int prefix_len, int uri, int level);
+Description: append a declaration to a scope, the capacity of the scope is doubled when it is full
+Called By: void declare_namespaces(NsScope* scope, char* p, char* end, int level); void reset_namespaces(int i); 
+int resolve_namespaces(int n, int workers);
+Input: scope--the scope; prefix, prefix_len--the prefix(NULL for the default namespace); uri--the id of the URI; level--the level 
+of the element declaring it
+*************************************************/
+void add_binding(NsScope* scope, char* prefix, int prefix_len, int uri, int level)
+{
+	if(scope->top==scope->max)
+	{
+		scope->max=(scope->max>0)?scope->max*2:SMALL_STATES;
+		scope->bind=(NsBinding*)realloc(scope->bind,scope->max*sizeof(NsBinding));
+	}
+	scope->bind[scope->top].prefix=prefix;
+	scope->bind[scope->top].prefix_len=prefix_len;
+	scope->bind[scope->top].uri=uri;
+	scope->bind[scope->top].level=level;
+	scope->top++;
+}
+
+/*************************************************
+Function: void declare_namespaces(NsScope* scope, char* p, char* end, int level);
+Description: keep the namespace declarations(xmlns="..." and xmlns:p="...") of a start tag. The tag is searched for "xmlns" first, 
+so a tag without declarations is not parsed.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num); 
+void root_namespaces(void);
+Input: scope--the scope; p--the first character after the tag name; end--the end of the XML text; level--the level of the element
+*************************************************/
+void declare_namespaces(NsScope* scope, char* p, char* end, int level)
+{
+	char *close=skip_attributes(p,end),*name,*value;
+	int name_len;
+	char quote;
+	if(find_string(p,close-p,"xmlns",5)==NULL) return;
+	while(p<close)
+	{
+		while(p<close&&(isspace((unsigned char)*p)||*p=='/')) p++;
+		name=p;
+		while(p<close&&*p!='='&&!isspace((unsigned char)*p)) p++;
+		name_len=p-name;
+		while(p<close&&*p!='"'&&*p!='\'') p++;
+		if(p>=close) break;
+		quote=*p++;
+		value=p;
+		while(p<close&&*p!=quote) p++;
+		if(name_len==5&&memcmp(name,"xmlns",5)==0) add_binding(scope,NULL,0,intern_uri(value,p-value),level);
+		else if(name_len>6&&memcmp(name,"xmlns:",6)==0) add_binding(scope,name+6,name_len-6,intern_uri(value,p-value),level);
+		p++;
+	}
+}
+
+/*************************************************
+Function: int scope_uri(NsScope* scope, char* prefix, int prefix_len, int level);
+Description: find the URI of a prefix in a scope, from the inner declarations
+Called By: int resolve_prefix(int thread_num, char* prefix, int prefix_len); int resolve_namespaces(int n, int workers);
+Input: scope--the scope; prefix, prefix_len--the prefix(NULL for the default namespace); level--only the declarations of the 
+elements up to this level are in scope
+Return: the id of the URI; NS_UNBOUND--the prefix is not declared
+*************************************************/
+int scope_uri(NsScope* scope, char* prefix, int prefix_len, int level)
+{
+	int k;
+	NsBinding* b;
+	for(k=scope->top-1;k>=0;k--)
+	{
+		b=&scope->bind[k];
+		if(b->level>level) continue;
+		if(prefix==NULL)
+		{
+			if(b->prefix==NULL) return b->uri;
+		}
+		else if(b->prefix!=NULL&&b->prefix_len==prefix_len&&memcmp(b->prefix,prefix,prefix_len)==0) return b->uri;
+	}
+	return NS_UNBOUND;
+}
+
+/*************************************************
+Function: int resolve_prefix(int thread_num, char* prefix, int prefix_len);
+Description: find the URI of a prefix for the current tag of a part: in the declarations of the part, then in the scope before the 
+part(only the elements which are not closed by the part). A prefix resolved by the assumed scope is kept to be checked later.
+Called By: int match_ns_tag(int thread_num, char* name, int len, int close, int* begin, int* end);
+Input: thread_num--the number of this part; prefix, prefix_len--the prefix(NULL for the default namespace)
+Return: the id of the URI; 0--no namespace; NS_OTHER--the URI is not in the query or the prefix is not declared
+*************************************************/
+int resolve_prefix(int thread_num, char* prefix, int prefix_len)
+{
+	NsPart* s=&ns_part[thread_num];
+	int uri=scope_uri(&s->own,prefix,prefix_len,INT_MAX);
+	if(uri!=NS_UNBOUND) return uri;
+	if(s->exact==1) uri=scope_uri(&s->before,prefix,prefix_len,s->base+s->low);
+	else
+	{
+		uri=scope_uri(&s->before,prefix,prefix_len,INT_MAX);
+		note_lookup(s,prefix,prefix_len,uri);
+	}
+	if(uri!=NS_UNBOUND) return uri;
+	return (prefix==NULL)?0:NS_OTHER;
+}
+
+/*************************************************
+Function: void note_lookup(NsPart* s, char* prefix, int prefix_len, int uri);
+Description: keep a prefix resolved by the assumed scope with the range of the lowest depth of the part when it was resolved, since 
+the real declarations before the part which are in scope depend on the elements closed by the part
+Called By: int resolve_prefix(int thread_num, char* prefix, int prefix_len);
+Input: s--the namespaces of this part; prefix, prefix_len--the prefix; uri--the URI found
+*************************************************/
+void note_lookup(NsPart* s, char* prefix, int prefix_len, int uri)
+{
+	int k;
+	NsLookup* u;
+	for(k=0;k<s->topused;k++)
+	{
+		u=&s->used[k];
+		if(u->prefix_len==prefix_len&&(prefix==NULL)==(u->prefix==NULL)&&(prefix==NULL||memcmp(u->prefix,prefix,prefix_len)==0))
+		{
+			if(s->low<u->low) u->low=s->low;
+			return;
+		}
+	}
+	if(s->topused==s->maxused)
+	{
+		s->maxused=(s->maxused>0)?s->maxused*2:SMALL_STATES;
+		s->used=(NsLookup*)realloc(s->used,s->maxused*sizeof(NsLookup));
+	}
+	u=&s->used[s->topused++];
+	u->prefix=prefix;
+	u->prefix_len=prefix_len;
+	u->uri=uri;
+	u->low=s->low;
+	u->high=s->low;
+}
+
+/*************************************************
+Function: void open_element(int thread_num);
+Description: a start tag opens an element of the part, at the next level
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of this part
+*************************************************/
+void open_element(int thread_num)
+{
+	ns_part[thread_num].depth++;
+}
+
+/*************************************************
+Function: void close_element(int thread_num);
+Description: an element of the part is closed(by its end tag or "/>"), the declarations of the element go out of scope
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of this part
+*************************************************/
+void close_element(int thread_num)
+{
+	NsPart* s=&ns_part[thread_num];
+	s->depth--;
+	if(s->depth<s->low) s->low=s->depth;
+	while(s->own.top>0&&s->own.bind[s->own.top-1].level>s->depth) s->own.top--;
+}
+
+/*************************************************
+Function: void root_namespaces(void);
+Description: keep the declarations of the elements enclosing the head of the file, which are assumed to be in scope at the beginning 
+of the other parts. The tags in the first NS_HEAD bytes of the first part are followed by their depth, and only the elements which are 
+not closed there(the root and the wrappers of the records) are kept. It is done once, by the first part which needs it.
+Called By: void reset_namespaces(int i);
+*************************************************/
+void root_namespaces(void)
+{
+	NsScope head;
+	char *p,*q,*close,*end;
+	int depth=0,low=INT_MAX,k;
+	pthread_mutex_lock(&ns_lock);
+	if(rootScanned==0)
+	{
+		memset(&head,0,sizeof(head));
+		p=buffFiles[0];
+		end=buffFiles[0]+((part_bytes[0]<NS_HEAD)?part_bytes[0]:NS_HEAD);
+		while((p=(char*)memchr(p,'<',end-p))!=NULL&&p+1<end)
+		{
+			if(p[1]=='?'||p[1]=='!')
+			{
+				p++;
+				continue;
+			}
+			for(q=p+1;q<end&&!isspace((unsigned char)*q)&&*q!='>'&&*q!='/';q++);
+			close=skip_attributes(q,end);
+			if(close>=end) break;  //the tag is cut by the head
+			if(p[1]=='/') depth--;
+			else if(close[-1]!='/')
+			{
+				depth++;
+				declare_namespaces(&head,q,end,depth);
+				p=close;
+				continue;
+			}
+			if(depth<low) low=depth;  //an element is closed, the elements above it enclose the others
+			while(head.top>0&&head.bind[head.top-1].level>depth) head.top--;
+			p=close;
+		}
+		for(k=0;k<head.top;k++)
+		{
+			if(head.bind[k].level<=low) add_binding(&rootScope,head.bind[k].prefix,head.bind[k].prefix_len,head.bind[k].uri,head.bind[k].level);
+		}
+		free(head.bind);
+		rootScanned=1;
+	}
+	pthread_mutex_unlock(&ns_lock);
+}
+
+/*************************************************
+Function: void reset_namespaces(int i);
+Description: empty the scope of the elements of a part before it is dealt with. The scope before the first part is empty, the scope 
+before the others is assumed to be the declarations of the elements enclosing the head of the file, unless the real one is known(the 
+part is dealt with again).
+Called By: int deal_part(int i);
+Input: i--the number of this part
+*************************************************/
+void reset_namespaces(int i)
+{
+	NsPart* s=&ns_part[i];
+	int k;
+	s->own.top=0;
+	s->depth=0;
+	s->low=0;
+	s->topused=0;
+	if(s->exact==1) return;
+	s->before.top=0;
+	if(i==0)
+	{
+		s->exact=1;
+		s->base=0;
+		return;
+	}
+	root_namespaces();
+	for(k=0;k<rootScope.top;k++) add_binding(&s->before,rootScope.bind[k].prefix,rootScope.bind[k].prefix_len,rootScope.bind[k].uri,1);
+}
+
+/*************************************************
+Function: int resolve_namespaces(int n, int workers);
+Description: after all the parts are done, fold the scope before each part in document order: the declarations before a part 
+which are still in scope after it(the elements are not closed by it) and the declarations of its elements which are open at its 
+end are the scope before the next part. A part whose prefixes resolved by the assumed scope have other URIs in the real scope is 
+dealt with again by the tasks, with the real scope before it.
+Called By: int main(void);
+Input: n--the number of the last part; workers--the number of threads
+Return: 0--success; -1--a part dealt with again is not correct XML
+*************************************************/
+int resolve_namespaces(int n, int workers)
+{
+	NsScope scope,next,t;
+	NsPart* s;
+	NsLookup* u;
+	int i,k,low,base=0,count=0,same,ret=0;
+	memset(&scope,0,sizeof(scope));
+	memset(&next,0,sizeof(next));
+	nsRedo=(int*)malloc((n+1)*sizeof(int));
+	for(i=0;i<=n;i++)
+	{
+		s=&ns_part[i];
+		if(s->exact==0)
+		{
+			same=1;
+			for(k=0;k<s->topused&&same==1;k++)
+			{
+				u=&s->used[k];
+				for(low=u->low;low<=u->high&&same==1;low++)
+				{
+					if(scope_uri(&scope,u->prefix,u->prefix_len,base+low)!=u->uri) same=0;
+				}
+			}
+			if(same==0)
+			{
+				s->before.top=0;
+				for(k=0;k<scope.top;k++) add_binding(&s->before,scope.bind[k].prefix,scope.bind[k].prefix_len,scope.bind[k].uri,scope.bind[k].level);
+				s->base=base;
+				s->exact=1;
+				nsRedo[count++]=i;
+			}
+		}
+		next.top=0;
+		for(k=0;k<scope.top;k++)
+		{
+			if(scope.bind[k].level<=base+s->low) add_binding(&next,scope.bind[k].prefix,scope.bind[k].prefix_len,scope.bind[k].uri,scope.bind[k].level);
+		}
+		for(k=0;k<s->own.top;k++) add_binding(&next,s->own.bind[k].prefix,s->own.bind[k].prefix_len,s->own.bind[k].uri,base+s->own.bind[k].level);
+		base+=s->depth;
+		t=scope;
+		scope=next;
+		next=t;
+	}
+	if(count>0)
+	{
+		printf("%d parts are dealt with again by the namespaces declared before them.\n",count);
+		taskCount=count;
+		run_tasks(workers,redo_task);
+		for(k=0;k<count;k++)
+		{
+			if(nsRedo[k]==-1) ret=-1;
+		}
+	}
+	free(scope.bind);
+	free(next.bind);
+	free(nsRedo);
+	return ret;
+}
+
+/*************************************************
+Function: void redo_task(int k);
+Description: deal with a part again with the real scope before it, the results of the part are freed first. nsRedo[k] is set to -1 
+if the part fails.
+Called By: int resolve_namespaces(int n, int workers);
+Input: k--the number of the task(the part nsRedo[k])
+*************************************************/
+void redo_task(int k)
+{
+	int i=nsRedo[k];
+	free(state_stack[i].output);
+	free(state_stack[i].frag);
+	free(state_stack[i].openfrag);
+	if(columnCount>0) free(part_columns[i]);
+	if(validateMode==1)
+	{
+		free(part_check[i].open);
+		free(part_check[i].close);
+	}
+	if(deal_part(i)==-1) nsRedo[k]=-1;
+}
+
+/*************************************************
+Function: char* skip_attributes(char* p, char* end);
+Description: jump over the attributes of a tag to its close angle bracket, the angle brackets in the attribute values are skipped
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: p--the first character after the tag name; end--the end of the XML text
+Return: the close angle bracket of this tag; end--the tag is not closed in this part
+*************************************************/
+char* skip_attributes(char* p, char* end)
+{
+	char* q;
+	while(p<end)
+	{
+		if(*p=='>') return p;
+		if(*p=='"')
+		{
+			q=(char*)memchr(p+1,'"',end-p-1);
+			if(q==NULL) return end;
+			p=q;
+		}
+		p++;
+	}
+	return end;
+}
+
+/*************************************************
+Function: void check_attribute(int node, char* name, int name_len, char* value, int value_len, unsigned int* bits);
+Description: check an attribute of a tag against the predicates of its node in the automata, where the attribute is read in place 
+from the XML text. A number is compared after it is converted, and an attribute which is not a number fails all the numeric predicates.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: node--the start tag in the automata; name, name_len--the attribute name; value, value_len--the attribute value(without quotes); 
+bits--the predicates which have been satisfied by the former attributes(bit i%32 of bits[i/32] for predicate i)
+Output: bits--the predicates satisfied by this attribute are added
+*************************************************/
+void check_attribute(int node, char* name, int name_len, char* value, int value_len, unsigned int* bits)
+{
+	int i;
+	Predicate* pred;
+	for(i=0;i<stateMachine[node].predCount;i++)
+	{
+		pred=&stateMachine[node].pred[i];
+		if(pred->name_len!=name_len||memcmp(pred->name,name,name_len)!=0) continue;
+		if(compare_value(pred,value,value_len)==1) bits[i/32]|=1u<<(i%32);
+	}
+}
+
+/*************************************************
+Function: int compare_value(Predicate* pred, char* value, int value_len);
+Description: compare a value in the XML text(an attribute value or the text of a tag) by a predicate. A number is compared after 
+it is converted, and a value which is not a number fails all the numeric predicates. contains() looks for the string by find_string(). 
+With decode-entities, a value which has '&' is compared after it is decoded.
+Called By: void check_attribute(int node, char* name, int name_len, char* value, int value_len, unsigned int* bits); 
+int text_passed(int node, char* text, int len);
+Input: pred--the predicate; value, value_len--the value(not ended with '\0')
+Return: 1--the predicate is satisfied 0--not
+*************************************************/
+int compare_value(Predicate* pred, char* value, int value_len)
+{
+	int cmp,ok=0;
+	double number;
+	char digits[MAX_SIZE],local[DECODE_BUFFER];
+	char *rest,*raw=value;
+	if(pred->op==pred_exist) return 1;
+	value=decode_value(raw,&value_len,local);
+	if(pred->op==pred_contains) ok=(find_string(value,value_len,pred->value,pred->value_len)!=NULL);
+	else if(pred->op==pred_starts) ok=(value_len>=pred->value_len&&memcmp(value,pred->value,pred->value_len)==0);
+	else if(pred->numeric==0)
+	{
+		cmp=(pred->value_len==value_len&&memcmp(pred->value,value,value_len)==0);
+		ok=(pred->op==pred_eq)?cmp:!cmp;
+	}
+	else if(value_len>0&&value_len<MAX_SIZE)
+	{
+		memcpy(digits,value,value_len);
+		digits[value_len]='\0';
+		number=strtod(digits,&rest);
+		if(rest!=digits&&*rest=='\0')
+		{
+			switch(pred->op)
+			{
+				case pred_eq: ok=(number==pred->number); break;
+				case pred_ne: ok=(number!=pred->number); break;
+				case pred_lt: ok=(number<pred->number); break;
+				case pred_le: ok=(number<=pred->number); break;
+				case pred_gt: ok=(number>pred->number); break;
+				case pred_ge: ok=(number>=pred->number); break;
+				default: break;
+			}
+		}
+	}
+	if(value!=raw&&value!=local) free(value);
+	return ok;
+}
+
+/*************************************************
+Function: int text_passed(int node, char* text, int len);
+Description: whether the text of a tag satisfies all its text predicates. The text is read in place when it ends, without the 
+blanks at its end(the blanks at its beginning are removed by the caller), so an output which fails is never kept.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: node--the start tag in the automata; text, len--the text of the tag
+Return: 1--all the predicates are satisfied 0--not
+*************************************************/
+int text_passed(int node, char* text, int len)
+{
+	int i;
+	while(len>0&&isspace((unsigned char)text[len-1])) len--;
+	for(i=0;i<stateMachine[node].textPredCount;i++)
+	{
+		if(compare_value(&stateMachine[node].textPred[i],text,len)==0) return 0;
+	}
+	return 1;
+}
+
+/*************************************************
+Function: int predicates_passed(int node, unsigned int* bits);
+Description: whether all the predicates of a tag are satisfied by its attributes
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: node--the start tag in the automata; bits--the predicates which have been satisfied
+Return: 1--all the predicates are satisfied 0--not
+*************************************************/
+int predicates_passed(int node, unsigned int* bits)
+{
+	int i,count=stateMachine[node].predCount;
+	for(i=0;i+32<=count;i+=32)
+	{
+		if(bits[i/32]!=0xffffffffu) return 0;
+	}
+	return i==count||bits[i/32]==(1u<<(count-i))-1;
+}
+
+/*************************************************
+Function: unsigned int* clear_predicates(unsigned int* bits, unsigned int* small, int* words, int count);
+Description: empty the bits of the predicates of a tag before its attributes are checked. The bits are kept in the small array of 
+xml_process() at first, and move to the heap only for a tag with more predicates than it holds.
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: bits--the bits; small--the small array; words--the capacity of bits; count--the number of predicates of the tag
+Output: words--the new capacity
+Return: the bits, which may be moved
+*************************************************/
+unsigned int* clear_predicates(unsigned int* bits, unsigned int* small, int* words, int count)
+{
+	int need=(count+31)/32;
+	if(need>*words)
+	{
+		if(bits!=small) free(bits);
+		bits=(unsigned int*)malloc(need*sizeof(unsigned int));
+		*words=need;
+	}
+	memset(bits,0,*words*sizeof(unsigned int));
+	return bits;
+}
+
+/*************************************************
+Function: void keep_column(int thread_num, char* name, int name_len, char* value, int value_len);
+Description: keep an attribute of the output element if it is in the columns, it is copied into the columns of the output when the 
+text of the element is output
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: thread_num--the number of this part; name, name_len--the attribute name; value, value_len--the attribute value(without quotes)
+*************************************************/
+void keep_column(int thread_num, char* name, int name_len, char* value, int value_len)
+{
+	int c;
+	for(c=0;c<columnCount;c++)
+	{
+		if(strncmp(columnNames[c],name,name_len)==0&&columnNames[c][name_len]=='\0')
+		{
+			element_columns[thread_num][c].p=value;
+			element_columns[thread_num][c].len=value_len;
+			element_columns[thread_num][c].entity=(decodeMode==1&&find_amp(value,value_len)<value_len);
+		}
+	}
+}
+
+/*************************************************
+Function: char * convertTokenTypeToStr(xml_TokenType type);
+Description: convert the XML token type from digit to the real string for output
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: type--the enumeration for the type of XML
+Return: the output string for this type
+*************************************************/
+char * convertTokenTypeToStr(xml_TokenType type)
+{
+
+	return tokenValue[type];
+	//else return defaultToken;
+}
+
+/*************************************************
+Function: int xml_initText(xml_Text *pText, char *s);
+Description: initiate a xml_Text for a string loading from original XML file
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText--the xml_Text element waiting to be initialized; s--the XML string;
+Output: pText--the initialized xml_Text
+Return: 0--success
+*************************************************/
+int xml_initText(xml_Text *pText, char *s)
+{
+    pText->p = s;
+    pText->len = strlen(s);
+    return 0;
+}
+
+/*************************************************
+Function: xml_initToken(xml_Token *pToken, xml_Text *pText);
+Description: initiate a xml_Token for a initialized xml_Text
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pToken--the xml_Token element waiting to be initialized; pText--input xml_Text;
+Output: pToken--the initialized xml_Token
+Return: 0--success
+*************************************************/
+int xml_initToken(xml_Token *pToken, xml_Text *pText)
+{
+    pToken->text.p = pText->p;
+    pToken->text.len = 0;
+    pToken->type = xml_tt_U;
+    return 0;
+}
+
+/*************************************************
+Function: int xml_print(xml_Text *pText, int begin, int end);
+Description: print the substring of a xml_Text
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText--input xml_Text; begin--start position; end--end position;
+Output: the substring of a xml_Text
+Return: 0--success
+*************************************************/
+int xml_print(xml_Text *pText, int begin, int end)
+{
+    int i;
+    char * temp=pText->p;
+    temp = ltrim(pText->p);
+    int j=0;
+    for (i = begin; i < end; i++)
+    {
+        putchar(temp[i]);
+    }
+    return 0;
+}
+
+/*************************************************
+Function: char* substring(char *pText, int begin, int end);
+Description: print the substring of the original string
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText--the original string; begin--start position; end--end position;
+Return: the final string
+*************************************************/
+char* substring(char *pText, int begin, int end)
+{
+    int i,j;
+    char * temp=pText;
+    temp = ltrim(pText);
+    char* temp1=(char*)malloc((end-begin+1)*sizeof(char));
+    for (j = 0,i = begin; i < end; i++,j++)
+    {
+        temp1[j]=temp[i];
+    }
+    temp1[j]='\0';
+    return temp1;
+}
+
+/*************************************************
+Function: char * ltrim(char *s);
+Description: remove the left blankets of a string
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: s--the original string; 
+Return: the final substring
+*************************************************/
+char * ltrim(char *s)
+{
+     char *temp;
+     temp = s;
+     while((*temp == ' ')&&temp){*temp++;}
+     return temp;
+}
+
+/*************************************************
+Function: char* trim_value(char* s);
+Description: remove the leading blanks of a value in config, and the blanks and the end of line(\n or \r\n) after it
+Called By: int main(void);
+Input: s--the value in config; 
+Return: the value without blanks
+*************************************************/
+char* trim_value(char* s)
+{
+	int len;
+	while(*s==' ') s++;
+	len=strlen(s);
+	while(len>0&&(s[len-1]==' '||s[len-1]=='\n'||s[len-1]=='\r')) s[--len]='\0';
+	return s;
+}
+
+/*************************************************
+Function: int read_config_line(char** buf, int* size, FILE* fp);
+Description: read a line of config as a whole(e.g a long XPath), the buffer is doubled until the line fits. getline() is not 
+used, since it is missing on Windows.
+Called By: int main(void);
+Input: buf--the buffer, NULL for none; size--the size of buf; fp--the config file
+Output: buf, size--the buffer holding the line
+Return: the length of the line; -1--the end of the file
+*************************************************/
+int read_config_line(char** buf, int* size, FILE* fp)
+{
+	int len=0;
+	if(*buf==NULL)
+	{
+		*size=MAX_LINE;
+		*buf=(char*)malloc(*size);
+	}
+	while(fgets(*buf+len,*size-len,fp)!=NULL)
+	{
+		len+=strlen(*buf+len);
+		if((*buf)[len-1]=='\n'||feof(fp)) return len;
+		*size*=2;
+		*buf=(char*)realloc(*buf,*size);
+	}
+	return (len>0)?len:-1;
+}
+
+/*************************************************
+Function: int left_null_count(char *s);
 Description: calculate the number of blanket for each string
 Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
 Input: s--the original string; 
 Return: the number of blanket for each string
 *************************************************/
-int left_null_count(char *s)  
+int left_null_count(char *s)  
+{
+	 int count=0;
+     char *temp;
+     temp = s;
+     while((*temp == ' ')&&temp){*temp++; count++;}
+     return count;
+}
+
+/*************************************************
+Function: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Description: the function could be called by each thread, dealing with each line of the file. Besides, this function could identify the following elements, 
+which include XML head, Start Tag(e.g <xxx>), End Tag(e.g </xxx>), Tag(e.g <xxx/>), Content for the Tag, XML Explanation, Attribute Name for Tag, 
+Attribute Value for Tag, Content for CDATA element. Each element would be processed according to its type. The states are driven by 
+the tables of build_lexer(), and the actions for the ends of the tokens are in one switch. 
+Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
+Input: pText-the content of the xml file; pToken-the type of the current xml element; multilineExp-whether the current line of the xml file is the multiline explanation; 
+multilineCDATA-- whether the current line of the xml file is the multiline CDATA; thread_num-the number of the thread; 
+Return: 0--success -1--error 1--multiline explantion 2--multiline CDATA
+*************************************************/
+int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num)  
+{
+    char *start = pToken->text.p + pToken->text.len;
+    char *p = start;
+    char *end = pText->p + pText->len;
+    int state = 0;
+    int templen = 0;
+    if(multilineExp == 1) state = 10;   //1--multiline explantion  0--single line explantion
+    if(multilineCDATA == 1) state = 17; //1--multiline CDATA 0--single CDATA
+    int j=-1,a; //j--the last tag matched in the automata, -1 for none
+    int tag_begin,tag_end; //the transition for the last tag matched in the automata
+    int attr_node=-1; //the tag whose attributes are checked by predicates or output, -1 for none
+    unsigned int small_bits[SMALL_PRED_WORDS]; //the predicates satisfied by the attributes lexed so far
+    unsigned int *pred_bits=small_bits;        //small_bits, or the heap for a tag with more predicates
+    int pred_words=SMALL_PRED_WORDS;
+    char *attr_name=NULL,*attr_value=NULL; //the name and the value of the current attribute in the XML text
+    int attr_name_len=0;
+    char *pending=NULL; //the attribute to be output when all the predicates are satisfied
+    int pending_len=0;
+    int pushed_node=-1; //the tag pushed by a start tag with attributes, popped again if it ends with "/>"
+    char *frag_open=NULL; //'<' of the start tag of the output, a fragment begins if the start tag is accepted
+    int flag=state_stack[thread_num].exact; //whether the correct start state has been found 0--not found 1--found
+    char *markup=NULL; //'<' of the current markup, for the validation
+    char *vname=NULL;  //the name of the current tag for the validation, NULL--the start tag has been checked
+    int vlen=0;        //the length of the name, -1 until the end of the name is met
+    int ev=-1;         //the event of the current start tag, -1 for none
+    int rule;          //the next state and the action(lexRule) for the current byte
+    int col;
+    int ns_tag=0;      //1--the start tag with attributes has opened its element(with namespaces)
+    unsigned short *row;
+    char *q;
+
+    pToken->text.p = p;
+    pToken->type = xml_tt_U;
+    
+    for (; p < end; p++)
+    {
+        rule = lexRule[state][lexClass[(unsigned char)*p]];
+        if(rule==state)               /* the same state without an action, e.g the text and the names */
+        {
+            row = lexRule[state];
+            while(p+1<end&&row[lexClass[(unsigned char)*(p+1)]]==state) p++;
+            continue;
+        }
+        state = rule&0xff;            /* an action may change the state again */
+        if((rule>>8)==lex_a_none) continue;
+        switch(rule>>8)
+        {
+            case lex_a_open:
+               if(outputLimit>0&&nsMode==0&&(thread_num>=limitPart||state_stack[thread_num].topput>=outputLimit))
+               {
+                   if(pred_bits!=small_bits) free(pred_bits);
+                   return 0;  /* the rest of this part is after the first N outputs */
+               }
+               markup = p;
+               break;
+            case lex_a_name:
+               vname = p;
+               vlen = -1;
+               if(eventMode==1) ev=add_event(thread_num,xml_tt_B,markup,0);
+               break;
+            case lex_a_close_name:
+               vname = p+1;
+               break;
+            case lex_a_head:                          /* Head <?xxx?>*/
+               if(eventMode==1) add_event(thread_num,xml_tt_H,markup,p+1-markup);
+               pToken->text.len = p - start + 1;
+               templen = pToken->text.len;
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_end:                           /* End </xxx> */
+               if(validateMode==1) check_tag(thread_num,vname,p-vname,1);
+               if(eventMode==1)
+               {
+                   part_events[thread_num].depth--;
+                   add_event(thread_num,xml_tt_E,markup,p+1-markup);
+               }
+               pToken->text.len = p - start + 1;
+               a=left_null_count(pToken->text.p);
+               if(nsMode==1)
+               {
+                   j=match_ns_tag(thread_num,pToken->text.p+a+2,pToken->text.len-3-a,1,&tag_begin,&tag_end);
+                   close_element(thread_num);
+               }
+               else j=match_end_tag(pToken->text.p+a+1 , pToken->text.len-2-a , &tag_begin , &tag_end);
+               if(j>=1){
+                   if(flag==0)
+                   {
+                       enqueue(thread_num,tag_begin);
+                       push(thread_num,tag_begin);
+                       flag=1;
+                   }
+                   pop(tag_end,thread_num);
+                   if(fragmentMode==1&&stateMachine[j].isoutput==1)
+                   {
+                       close_fragment(thread_num,p+1);
+                   }
+               }
+               pToken->text.p = start + pToken->text.len;
+               start = pToken->text.p;
+               break;
+            case lex_a_begin:                         /* Begin <xxx> */
+               if(ev>=0)
+               {
+                   end_event(thread_num,ev,xml_tt_B,p+1);
+                   ev=-1;
+               }
+               if(validateMode==1&&vname!=NULL)
+               {
+                   if(vlen==-1) vlen = p-vname;
+                   check_tag(thread_num,vname,vlen,0);
+                   vname = NULL;
+               }
+               pToken->text.len = p - start + 1;
+               if(nsMode==1)
+               {
+                   if(ns_tag==0) open_element(thread_num);  /* <xxx> */
+                   ns_tag=0;
+               }
+               if(pToken->text.len-1 >= 1){
+                   templen = pToken->text.len;
+                   a=left_null_count(pToken->text.p);
+                   if(nsMode==1) j=match_ns_tag(thread_num,pToken->text.p+a+1,pToken->text.len-2-a,0,&tag_begin,&tag_end);
+                   else j=match_start_tag(pToken->text.p+a+1 , pToken->text.len-2-a , &tag_begin , &tag_end);
+                   if(j>=1)
+                   {
+                       if(flag==0)
+                       {
+                           enqueue(thread_num,tag_begin);
+                           push(thread_num,tag_begin);
+                           flag=1;
+                       }
+                       push(thread_num,tag_end);
+                   }
+                   if(fragmentMode==1&&j>=1&&stateMachine[j].isoutput==1)
+                   {
+                       frag_open=pToken->text.p+a;
+                   }
+                   if(j>=1&&(stateMachine[j].predCount>0||stateMachine[j].outputAttr!=NULL))
+                   {
+                       attr_node=j;
+                       pred_bits=clear_predicates(pred_bits,small_bits,&pred_words,stateMachine[j].predCount);
+                       pending=NULL;
+                   }
+                   if(columnCount>0&&j>=1&&stateMachine[j].isoutput==1)   /* the attributes of the output element for the columns */
+                   {
+                       for(col=0;col<columnCount;col++) element_columns[thread_num][col].len=-1;
+                       attr_node=j;
+                       pred_bits=clear_predicates(pred_bits,small_bits,&pred_words,stateMachine[j].predCount);
+                       pending=NULL;
+                   }
+               }
+               else templen = 1;
+               if(attr_node>=1)   /* the start tag ends, all the predicates must be satisfied */
+               {
+                   if(!predicates_passed(attr_node,pred_bits)) j=-1;
+                   else if(pending!=NULL) add_output(thread_num,pending,pending_len);
+                   attr_node=-1;
+               }
+               if(frag_open!=NULL)
+               {
+                   open_fragment(thread_num,frag_open,j>=1);
+                   frag_open=NULL;
+               }
+               pushed_node=-1;
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_name_end:
+               if(vlen==-1) vlen = p-vname;
+               break;
+            case lex_a_attributes:                    /* Begin <xxx with attributes */
+               if(vlen==-1) vlen = p-vname;
+               pToken->text.len = p - start + 1;
+               templen = 0;
+               if(pToken->text.len-1 >= 1)
+               {
+                   templen = pToken->text.len;
+                   a=left_null_count(pToken->text.p);
+                   if(nsMode==1)   /* the declarations of this tag are in scope for its own name */
+                   {
+                       open_element(thread_num);
+                       declare_namespaces(&ns_part[thread_num].own,p+1,end,ns_part[thread_num].depth);
+                       ns_tag=1;
+                   }
+                   if(nsMode==1) j=match_ns_tag(thread_num,pToken->text.p+a+1,pToken->text.len-2-a,0,&tag_begin,&tag_end);
+                   else j=match_start_tag(pToken->text.p+a+1 , pToken->text.len-2-a , &tag_begin , &tag_end);
+                   if(j>=1)
+                   {
+                       if(flag==0)
+                       {
+                           enqueue(thread_num,tag_begin);
+                           push(thread_num,tag_begin);
+                           flag=1;
+                       }
+                       push(thread_num,tag_end);
+                       pushed_node=j;
+                   }
+                   if(fragmentMode==1&&j>=1&&stateMachine[j].isoutput==1)
+                   {
+                       frag_open=pToken->text.p+a;
+                   }
+                   if(j>=1&&(stateMachine[j].predCount>0||stateMachine[j].outputAttr!=NULL))
+                   {
+                       attr_node=j;
+                       pred_bits=clear_predicates(pred_bits,small_bits,&pred_words,stateMachine[j].predCount);
+                       pending=NULL;
+                   }
+                   if(columnCount>0&&j>=1&&stateMachine[j].isoutput==1)   /* the attributes of the output element for the columns */
+                   {
+                       for(col=0;col<columnCount;col++) element_columns[thread_num][col].len=-1;
+                       attr_node=j;
+                       pred_bits=clear_predicates(pred_bits,small_bits,&pred_words,stateMachine[j].predCount);
+                       pending=NULL;
+                   }
+               }
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               if(skipDeadStates==1&&useAttributes==0)   /* the attributes are never used, jump to the end of this tag */
+               {
+                   char* close=skip_attributes(p+1,end);
+                   if(close<end)
+                   {
+                       p=(*(close-1)=='/')?close-2:close-1;
+                       pToken->text.p = p+1;
+                       start = pToken->text.p;
+                       state = 5;
+                   }
+               }
+               break;
+            case lex_a_empty:                         /* Begin End <xxx/> */
+               vname = NULL;  /* the element is closed at once */
+               if(ns_tag==1)
+               {
+                   close_element(thread_num);
+                   ns_tag=0;
+               }
+               if(ev>=0)
+               {
+                   end_event(thread_num,ev,xml_tt_BE,p+1);
+                   ev=-1;
+               }
+               pToken->text.len = p - start + 1;
+               templen = pToken->text.len;
+               if(attr_node>=1)
+               {
+                   if(!predicates_passed(attr_node,pred_bits)) j=-1;
+                   else if(pending!=NULL) add_output(thread_num,pending,pending_len);
+                   attr_node=-1;
+               }
+               if(frag_open!=NULL)   /* the whole element is this tag */
+               {
+                   if(j>=1) add_fragment(thread_num,part_offset[thread_num]+(frag_open-buffFiles[thread_num]),part_offset[thread_num]+(p+1-buffFiles[thread_num]));
+                   frag_open=NULL;
+               }
+               if(pushed_node>=1)   /* <xxx .../> ends the tag at once */
+               {
+                   pop(stateMachine[pushed_node+1].end,thread_num);
+                   pushed_node=-1;
+                   j=-1;
+               }
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_text:                          /* Text xxx */
+               p--;
+               pToken->text.len = p - start + 1;
+               if(eventMode==1) add_event(thread_num,xml_tt_T,pToken->text.p,pToken->text.len);
+               templen = pToken->text.len;
+               if(j>=1&&j<machineCount&&stateMachine[j].isoutput==1&&stateMachine[j].outputAttr==NULL&&fragmentMode==0)
+               {
+                   a=left_null_count(pToken->text.p);
+                   if(stateMachine[j].textPredCount==0||text_passed(j,pToken->text.p+a,pToken->text.len-a))
+                   {
+                       add_output(thread_num,pToken->text.p+a,pToken->text.len-a);
+                   }
+                   j=-1;
+               }
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_skip_text:                     /* jump to the next tag */
+               q=(char*)memchr(p,'<',end-p);
+               p=(q!=NULL)?q-1:end-1;
+               break;
+            case lex_a_cdata_open:
+               if(end-p>5&&memcmp(p+1,"CDATA",5)==0)   /* <![CDATA[ */
+               {
+                   state = 16;
+                   p += 5;
+               }
+               break;
+            case lex_a_skip_comment:                  /* jump to the next '-' of this comment */
+               q=(char*)memchr(p,'-',end-p);
+               p=(q!=NULL)?q-1:end-1;
+               break;
+            case lex_a_comment:                       /* Comment <!--xx-->*/
+               if(eventMode==1) add_event(thread_num,xml_tt_C,markup,p+1-markup);
+               pToken->text.len = p - start + 1;
+               templen = pToken->text.len;
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_attribute_name:                /*attribute name*/
+               pToken->text.len = p - start + 1;
+               templen = pToken->text.len;
+               if(attr_node>=1||eventMode==1)
+               {
+                   attr_name=pToken->text.p;
+                   attr_name_len=pToken->text.len-1;
+                   while(attr_name_len>0&&isspace((unsigned char)*attr_name)) {attr_name++; attr_name_len--;}
+                   while(attr_name_len>0&&isspace((unsigned char)attr_name[attr_name_len-1])) attr_name_len--;
+                   if(eventMode==1) add_event(thread_num,xml_tt_ATN,attr_name,attr_name_len);
+               }
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_value_open:
+               attr_value = p+1;
+               break;
+            case lex_a_attribute_value:               /*attribute value*/
+               if(eventMode==1) add_event(thread_num,xml_tt_ATV,attr_value,p-attr_value);
+               pToken->text.len = p - start + 1;
+               templen = pToken->text.len;
+               if(attr_node>=1)
+               {
+                   check_attribute(attr_node,attr_name,attr_name_len,attr_value,p-attr_value,pred_bits);
+                   if(columnCount>0) keep_column(thread_num,attr_name,attr_name_len,attr_value,p-attr_value);
+                   if(stateMachine[attr_node].outputAttr!=NULL&&strncmp(attr_name,stateMachine[attr_node].outputAttr,attr_name_len)==0
+                       &&stateMachine[attr_node].outputAttr[attr_name_len]=='\0')   /* the attribute to be output */
+                   {
+                       if(stateMachine[attr_node].predCount==0) add_output(thread_num,attr_value,p-attr_value);
+                       else
+                       {
+                           pending=attr_value;
+                           pending_len=p-attr_value;
+                       }
+                   }
+               }
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            case lex_a_skip_cdata:                    /* jump to the next ']' of this CDATA */
+               q=(char*)memchr(p,']',end-p);
+               p=(q!=NULL)?q-1:end-1;
+               break;
+            case lex_a_cdata:                         /* <![CDATA[xxxxx]]>*/
+               if(eventMode==1) add_event(thread_num,xml_tt_CDATA,markup,p+1-markup);
+               pToken->text.len = p - start + 1;
+               templen = pToken->text.len;
+               pToken->text.p = start + templen;
+               start = pToken->text.p;
+               break;
+            default:                                  /* lex_a_fail: the byte before is not correct */
+               if(validateMode==1&&part_check[thread_num].error==-1)
+               {
+                   char reason[MAX_LINE];
+                   snprintf(reason,sizeof(reason),"the markup is not correct at the character '%c'",*(p-1));
+                   check_error(thread_num,p-1,reason);
+               }
+               break;
+        }
+    }
+    if(validateMode==1&&state!=0&&state!=7&&state!=LEX_ERROR&&markup!=NULL)
+    {
+    	part_check[thread_num].unfinished=part_offset[thread_num]+(markup-buffFiles[thread_num]);
+	}
+    if(pred_bits!=small_bits) free(pred_bits);
+    if(state==LEX_ERROR) {return -1;}
+	else if(state == 7)
+	{
+		p--;
+        pToken->text.len = p - start + 1;
+        if(eventMode==1&&pToken->text.len>0) add_event(thread_num,xml_tt_T,pToken->text.p,pToken->text.len);
+        if(pToken->text.len>0)
+        {
+        	//printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
+            //printf("%s","content=");
+            //xml_print(&pToken->text, 0 , pToken->text.len);
+            //printf(";\n\n");
+            if(j>=1&&j<machineCount&&stateMachine[j].isoutput==1&&stateMachine[j].outputAttr==NULL&&fragmentMode==0)
+			{
+				a=left_null_count(pToken->text.p);
+				if(stateMachine[j].textPredCount==0||text_passed(j,pToken->text.p+a,pToken->text.len-a))
+				{
+					add_output(thread_num,pToken->text.p+a,pToken->text.len-a);
+				}
+			}
+        }
+		return 0;
+	}
+    else return 0;
+}
+
+/*************************************************
+Function: ResultSet getresult(int n) ;
+Description: get all the mappings for the state_stack of the related part, then merged them into one final mapping. 
+Called By: int main(void);
+Input: n-total number for all the parts; 
+Return: the final mapping set
+*************************************************/
+ResultSet getresult(int n) 
+{
+	ResultSet final_set;
+	int i;
+	int merged=0; //the number of parts merged into final_set
+	memset(&final_set,0,sizeof(ResultSet));
+    for(i=firstPart;i<=n;i++)
+    {
+    	if(merge_part(&final_set,i,&merged)==-1) break;
+	}
+	if(merged==0) final_set.begin=-1;
+	return final_set;
+}
+
+/*************************************************
+Function: void put_state(int** s, int* top, int* max, int state);
+Description: append a state to a stack of the mapping, the stack is doubled when it is full
+Called By: int merge_part(ResultSet* final_set, int i, int* merged);
+Input: s--the stack; top--the number of states; max--the capacity; state--the state
+Output: s, top, max
+*************************************************/
+void put_state(int** s, int* top, int* max, int state)
+{
+	if(*top==*max) *s=grow_states(*s,NULL,max);
+	(*s)[(*top)++]=state;
+}
+
+/*************************************************
+Function: void free_result(ResultSet* set);
+Description: free the stacks of a mapping made by getresult()
+Called By: int main(void); int batch_main(char* pattern, int workers); void serve_query(char* file_name, char* xpath); 
+int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: set--the mapping
+*************************************************/
+void free_result(ResultSet* set)
+{
+	free(set->begin_stack);
+	free(set->end_stack);
+	set->begin_stack=NULL;
+	set->end_stack=NULL;
+	set->maxbegin=0;
+	set->maxend=0;
+}
+
+/*************************************************
+Function: int merge_part(ResultSet* final_set, int i, int* merged);
+Description: get the mapping for the state_stack of one part, then merge it into the final mapping of the parts before it. 
+A part without any tag of the automata keeps the state unchanged, so it is skipped.
+Called By: ResultSet getresult(int n); char* merge_stream(int k, size_t* size);
+Input: final_set--the mapping of the parts before; i--the number of this part; merged--the number of parts merged into final_set
+Output: final_set, merged
+Return: 0--success; -1--the mappings can not be merged(final_set->begin is -1)
+*************************************************/
+int merge_part(ResultSet* final_set, int i, int* merged)
+{
+	ResultSet set;
+	int k;
+	if(*merged>0&&final_set->begin==-1) return -1;
+	set.begin=(*merged>0)?final_set->end:1;
+	//deal with the start queue
+	if(state_stack[i].top_stack==0)
+	{
+	    return 0;
+    }
+    set.begin_stack=state_stack[i].queue+1;  //the stacks of the part are read as they are
+    set.topbegin=(state_stack[i].rear_queue>1)?state_stack[i].rear_queue-1:0;
+	//deal with the final stack
+	set.end_stack=state_stack[i].stack;
+	set.topend=(state_stack[i].top_stack==1)?1:state_stack[i].top_stack-1;
+	set.end=set.end_stack[set.topend-1];
+	set.topend--;
+	//merge finalset&set
+    if(*merged>0&&final_set->end!=set.begin)
+    {
+	    final_set->begin=-1;
+	    return -1;
+    }
+    final_set->end=set.end;
+    if(*merged==0)
+    {
+        final_set->begin=set.begin;
+        for(k=0;k<set.topbegin;k++)
+        {
+	        put_state(&final_set->begin_stack,&final_set->topbegin,&final_set->maxbegin,set.begin_stack[k]);
+        }
+        for(k=0;k<set.topend;k++)
+        {
+	        put_state(&final_set->end_stack,&final_set->topend,&final_set->maxend,set.end_stack[k]);
+        }
+    }
+    else{
+        int equal_flag=0;
+        if(final_set->topend==set.topbegin)
+        {
+            for(k=0;k<set.topbegin;k++)
+            {
+	            if(final_set->end_stack[set.topbegin-k-1]!=set.begin_stack[k])
+	            {
+		            equal_flag=1;
+		            break;
+	            }
+            }
+        }
+        if(equal_flag==0)
+        {
+        	final_set->topend=0;         //end_stack is equal to the current set
+        	for(k=0;k<set.topend;k++)
+            {
+	            put_state(&final_set->end_stack,&final_set->topend,&final_set->maxend,set.end_stack[k]);
+            }
+        }
+        else
+        {
+        	for(k=0;k<set.topend;k++)
+            {
+	            put_state(&final_set->end_stack,&final_set->topend,&final_set->maxend,set.end_stack[k]);  //merge
+            }
+		}
+    }
+    (*merged)++;
+	return 0;
+}
+
+/*************************************************
+Function: int find_amp(char* s, int len);
+Description: find the first '&' of a span. With SSE2, 16 bytes are compared at a time and the first match is taken from the bit mask.
+Called By: void add_output(int thread_num, char* p, int len); void keep_column(int thread_num, char* name, int name_len, char* value, int value_len);
+int read_summary_parts(FILE* in, int first, int count); int decode_entities(char* s, int len, char* out);
+Input: s--the span(not ended with '\0'); len--the length of the span
+Return: the offset of the first '&', len if there is no '&'
+*************************************************/
+int find_amp(char* s, int len)
+{
+	int i=0;
+#ifdef __SSE2__
+	__m128i pattern=_mm_set1_epi8('&');
+	for(;i+16<=len;i+=16)
+	{
+		int mask=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(s+i)),pattern));
+		if(mask!=0) return i+__builtin_ctz(mask);
+	}
+#endif
+	for(;i<len;i++)
+	{
+		if(s[i]=='&') return i;
+	}
+	return len;
+}
+
+/*************************************************
+Function: int decode_entities(char* s, int len, char* out);
+Description: decode the references(&amp; &lt; &gt; &quot; &apos; &#NN; &#xHH;) of a span. The text between two '&' is found by 
+find_amp() and copied at once, a reference which is not known or not correct is kept as it is.
+Called By: void print_text(FILE* f, xml_Text* t); void column_task(int k); char* decode_value(char* p, int* len, char* local);
+Input: s, len--the span
+Output: out--the decoded span, which is not longer than the span(len bytes are enough)
+Return: the length of the decoded span
+*************************************************/
+int decode_entities(char* s, int len, char* out)
+{
+	int i=0,k=0,run,end,bytes;
+	while(i<len)
+	{
+		run=find_amp(s+i,len-i);
+		memcpy(out+k,s+i,run);
+		k+=run;
+		i+=run;
+		if(i==len) break;
+		for(end=i+1;end<len&&end-i<=MAX_REFERENCE&&s[end]!=';';end++);
+		bytes=(end<len&&s[end]==';')?decode_reference(s+i+1,end-i-1,out+k):0;
+		if(bytes>0)
+		{
+			k+=bytes;
+			i=end+1;
+		}
+		else out[k++]=s[i++];
+	}
+	return k;
+}
+
+/*************************************************
+Function: char* decode_value(char* p, int* len, char* local);
+Description: with decode-entities, a value which is compared by the predicates or folded into the aggregation is decoded first, so 
+it is the same text as the output printed. A value without '&' is used in place.
+Called By: int compare_value(Predicate* pred, char* value, int value_len); void aggregate_output(Aggregate* agg, char* p, int len);
+Input: p, len--the value; local--a buffer of DECODE_BUFFER bytes on the stack of the caller
+Output: len--the length of the decoded value
+Return: p, local or a buffer in the heap for a longer value(free it after use)
+*************************************************/
+char* decode_value(char* p, int* len, char* local)
+{
+	char* out;
+	if(decodeMode==0||find_amp(p,*len)==*len) return p;
+	out=(*len<=DECODE_BUFFER)?local:(char*)malloc(*len);
+	*len=decode_entities(p,*len,out);
+	return out;
+}
+
+/*************************************************
+Function: int decode_reference(char* s, int len, char* out);
+Description: decode one entity reference(amp, lt, gt, quot, apos) or character reference(#NN, #xHH), the character is written as UTF-8
+Called By: int decode_entities(char* s, int len, char* out);
+Input: s, len--the reference without '&' and ';'
+Output: out--the character
+Return: the number of bytes of the character, 0--the reference is not known or not correct
+*************************************************/
+int decode_reference(char* s, int len, char* out)
+{
+	static const char* names[5]={"amp","lt","gt","quot","apos"};
+	static const char chars[5]={'&','<','>','"','\''};
+	unsigned long code=0;
+	int i,digit;
+	if(len<2) return 0;
+	if(s[0]!='#')
+	{
+		for(i=0;i<5;i++)
+		{
+			if((int)strlen(names[i])==len&&memcmp(s,names[i],len)==0)
+			{
+				out[0]=chars[i];
+				return 1;
+			}
+		}
+		return 0;
+	}
+	if(s[1]=='x')
+	{
+		if(len<3) return 0;
+		for(i=2;i<len;i++)
+		{
+			if(isdigit((unsigned char)s[i])) digit=s[i]-'0';
+			else if(s[i]>='a'&&s[i]<='f') digit=s[i]-'a'+10;
+			else if(s[i]>='A'&&s[i]<='F') digit=s[i]-'A'+10;
+			else return 0;
+			code=code*16+digit;
+			if(code>0x10FFFF) return 0;
+		}
+	}
+	else
+	{
+		for(i=1;i<len;i++)
+		{
+			if(!isdigit((unsigned char)s[i])) return 0;
+			code=code*10+(s[i]-'0');
+			if(code>0x10FFFF) return 0;
+		}
+	}
+	if(code==0||(code>=0xD800&&code<=0xDFFF)) return 0;
+	if(code<0x80)
+	{
+		out[0]=(char)code;
+		return 1;
+	}
+	if(code<0x800)
+	{
+		out[0]=(char)(0xC0|(code>>6));
+		out[1]=(char)(0x80|(code&0x3F));
+		return 2;
+	}
+	if(code<0x10000)
+	{
+		out[0]=(char)(0xE0|(code>>12));
+		out[1]=(char)(0x80|((code>>6)&0x3F));
+		out[2]=(char)(0x80|(code&0x3F));
+		return 3;
+	}
+	out[0]=(char)(0xF0|(code>>18));
+	out[1]=(char)(0x80|((code>>12)&0x3F));
+	out[2]=(char)(0x80|((code>>6)&0x3F));
+	out[3]=(char)(0x80|(code&0x3F));
+	return 4;
+}
+
+/*************************************************
+Function: void print_text(FILE* f, xml_Text* t);
+Description: print an output. An output marked when it was saved(it has '&') is decoded into a buffer first, the others are printed 
+as they are, so the text which is not output is never decoded.
+Called By: void print_result(ResultSet set, int n); char* merge_stream(int k, size_t* size); void emit_batches();
+Input: f--the file printed into; t--the output
+*************************************************/
+void print_text(FILE* f, xml_Text* t)
+{
+	char local[DECODE_BUFFER];
+	char* out;
+	if(t->entity==0)
+	{
+		fprintf(f,"%.*s",t->len,t->p);
+		return;
+	}
+	out=(t->len<=DECODE_BUFFER)?local:(char*)malloc(t->len);
+	fwrite(out,1,decode_entities(t->p,t->len,out),f);
+	if(out!=local) free(out);
+}
+
+/*************************************************
+Function: void print_result(ResultSet set, int n);
+Description: print the result mapping set, followed by the outputs(only the first N outputs if there is a limit). With line-numbers, 
+each output is followed by [line:column], the lines before the parts have been taken.
+Called By: int main(void);
+Input: set-result mapping set;n--the number of threads 
+*************************************************/
+void print_result(ResultSet set,int n)
+{
+	if(set.begin==-1)
+	{
+		fprintf(resultFile,"The mapping for this part is null, please check the XPath command.\n");
+		return;
+	}
+	int i;
+	fprintf(resultFile,"The mapping for this part is: %d,  ",set.begin);
+	for(i=0;i<set.topbegin;i++)  
+	{
+		fprintf(resultFile,"%d:",set.begin_stack[i]);
+	}
+    fprintf(resultFile,",  ");
+	fprintf(resultFile,"%d,  ",set.end);
+	for(i=set.topend-1;i>=0;i--)
+	{
+		fprintf(resultFile,"%d:",set.end_stack[i]);
+	}
+	fprintf(resultFile,",  ");
+	int j,count=0;
+	long line,column;
+	LineCursor cursor;
+	for(i=firstPart;i<=n;i++)
+	{
+		if(lineMode==1) init_cursor(&cursor,buffFiles[i],line_base[i],column_base[i]);
+		for(j=0;j<state_stack[i].topput&&(outputLimit==0||count<outputLimit);j++,count++)
+		{
+			if(lineMode==1)
+			{
+				find_position(&cursor,state_stack[i].output[j].p-buffFiles[i],&line,&column);
+				print_text(resultFile,&state_stack[i].output[j]);
+				fprintf(resultFile,"[%ld:%ld] ",line,column);
+			}
+			else
+			{
+				print_text(resultFile,&state_stack[i].output[j]);
+				fputc(' ',resultFile);
+			}
+		}
+	}
+	fprintf(resultFile,"\n");
+}
+
+/*************************************************
+Function: int write_columns(ResultSet set, char* file_name, int n, int workers);
+Description: write the outputs(the first N outputs if there is a limit) and the attributes of their elements into a file by columns. 
+The parts are typed and converted by the tasks, a column is int64 or double if all its values in all the parts are integers or 
+numbers, otherwise it is a string column. Then the columns are written in document order, the parts one after another. 
+If the mappings can not be merged, there is no output like print_result, so the file has no rows.
+Called By: int main(void);
+Input: set--result mapping set; file_name--the file of the columns; n--the number of the last part; workers--the number of threads
+Return: the number of rows; -1--the file can not be written
+*************************************************/
+int write_columns(ResultSet set, char* file_name, int n, int workers)
+{
+	ColumnHeader head;
+	ColumnDesc desc[MAX_COLUMNS+1];
+	long long rows=0,at,offset,buffer[1024];
+	int i,c,r,k,parts=n-firstPart+1;
+	FILE* out;
+	xml_Text* v;
+	for(i=firstPart;i<=n;i++)
+	{
+		column_rows[i]=(set.begin==-1)?0:state_stack[i].topput;
+		if(outputLimit>0&&rows+column_rows[i]>outputLimit) column_rows[i]=outputLimit-rows;
+		rows+=column_rows[i];
+	}
+	taskCount=parts;
+	run_tasks(workers,column_task);
+	memset(&head,0,sizeof(head));
+	strcpy(head.magic,"XPQCOL1");
+	head.rows=rows;
+	head.columns=columnCount+1;
+	memset(desc,0,sizeof(desc));
+	at=sizeof(ColumnHeader)+(columnCount+1)*sizeof(ColumnDesc);
+	for(c=0;c<=columnCount;c++)
+	{
+		int isInt=(rows>0),isNumber=(rows>0);
+		long long bytes=0;
+		for(i=firstPart;i<=n;i++)
+		{
+			isInt&=column_part[i][c].isInt;
+			isNumber&=column_part[i][c].isNumber;
+			bytes+=column_part[i][c].bytes;
+		}
+		desc[c].type=isInt?col_int64:(isNumber?col_double:col_string);
+		if(c>0) snprintf(desc[c].name,COLUMN_NAME,"@%s",columnNames[c-1]);
+		else if(stateMachine[machineCount-1].outputAttr!=NULL) snprintf(desc[c].name,COLUMN_NAME,"@%s",stateMachine[machineCount-1].outputAttr);
+		else snprintf(desc[c].name,COLUMN_NAME,"%s",stateMachine[machineCount-1].str);
+		at=(at+7)&~7LL;
+		if(desc[c].type==col_string)
+		{
+			desc[c].offsets=at;
+			at+=(rows+1)*sizeof(long long);
+			desc[c].bytes=bytes;
+		}
+		else desc[c].bytes=rows*8;
+		desc[c].data=at;
+		at+=desc[c].bytes;
+	}
+	out=fopen(file_name,"wb");
+	if(out!=NULL)
+	{
+		fwrite(&head,sizeof(head),1,out);
+		fwrite(desc,sizeof(ColumnDesc),columnCount+1,out);
+		at=sizeof(ColumnHeader)+(columnCount+1)*sizeof(ColumnDesc);
+		for(c=0;c<=columnCount;c++)
+		{
+			for(;at<((desc[c].type==col_string)?desc[c].offsets:desc[c].data);at++) fputc(0,out);  //align to 8 bytes
+			for(i=firstPart;i<=n;i++)
+			{
+				if(desc[c].type==col_int64) fwrite(column_part[i][c].ints,sizeof(long long),column_rows[i],out);
+				else if(desc[c].type==col_double) fwrite(column_part[i][c].reals,sizeof(double),column_rows[i],out);
+			}
+			if(desc[c].type==col_string)
+			{
+				offset=0;
+				k=0;
+				buffer[k++]=0;
+				for(i=firstPart;i<=n;i++)
+				{
+					for(r=0;r<column_rows[i];r++)
+					{
+						v=(c==0)?&state_stack[i].output[r]:&part_columns[i][r*columnCount+c-1];
+						if(v->len>0) offset+=v->len;
+						buffer[k++]=offset;
+						if(k==1024)
+						{
+							fwrite(buffer,sizeof(long long),k,out);
+							k=0;
+						}
+					}
+				}
+				fwrite(buffer,sizeof(long long),k,out);
+				for(i=firstPart;i<=n;i++)
+				{
+					for(r=0;r<column_rows[i];r++)
+					{
+						v=(c==0)?&state_stack[i].output[r]:&part_columns[i][r*columnCount+c-1];
+						if(v->len>0) fwrite(v->p,1,v->len,out);
+					}
+				}
+			}
+			at=desc[c].data+desc[c].bytes;
+		}
+		if(fclose(out)!=0) out=NULL;
+	}
+	for(i=firstPart;i<=n;i++)
+	{
+		for(c=0;c<=columnCount;c++)
+		{
+			free(column_part[i][c].ints);
+			free(column_part[i][c].reals);
+			free(column_part[i][c].decoded);
+		}
+		free(part_columns[i]);
+		part_columns[i]=NULL;
+	}
+	return (out==NULL)?-1:(int)rows;
+}
+
+/*************************************************
+Function: void column_task(int k);
+Description: type and convert the columns of one part. The values are converted while all of them are numbers, an attribute which is 
+missing or a value which is not a number makes the column a string column in this part.
+Called By: int write_columns(ResultSet set, char* file_name, int n, int workers);
+Input: k--the number of the task(the part firstPart+k)
+*************************************************/
+void column_task(int k)
+{
+	int i=firstPart+k,c,r,kind;
+	long size;
+	ColumnPart* cp;
+	xml_Text* v;
+	for(c=0;c<=columnCount;c++)
+	{
+		cp=&column_part[i][c];
+		cp->isInt=1;
+		cp->isNumber=1;
+		cp->bytes=0;
+		cp->ints=(long long*)malloc((column_rows[i]+1)*sizeof(long long));
+		cp->reals=(double*)malloc((column_rows[i]+1)*sizeof(double));
+		for(r=0,size=0;r<column_rows[i];r++)
+		{
+			v=(c==0)?&state_stack[i].output[r]:&part_columns[i][r*columnCount+c-1];
+			if(v->len>0&&v->entity==1) size+=v->len;
+		}
+		cp->decoded=(size>0)?(char*)malloc(size):NULL;  //a value is not longer after it is decoded
+		for(r=0,size=0;r<column_rows[i];r++)
+		{
+			v=(c==0)?&state_stack[i].output[r]:&part_columns[i][r*columnCount+c-1];
+			if(v->len>0&&v->entity==1)   /* the span points to its decoded value from now on */
+			{
+				v->len=decode_entities(v->p,v->len,cp->decoded+size);
+				v->p=cp->decoded+size;
+				v->entity=0;
+				size+=v->len;
+			}
+			if(v->len>0) cp->bytes+=v->len;
+			if(cp->isNumber==0) continue;
+			kind=(v->len<0)?0:parse_number(v->p,v->len,&cp->ints[r],&cp->reals[r]);
+			if(kind==0) cp->isNumber=0;
+			if(kind!=2) cp->isInt=0;
+		}
+	}
+}
+
+/*************************************************
+Function: int parse_number(char* p, int len, long long* integer, double* real);
+Description: convert a value in the XML text(not ended with '\0', the blanks at both ends are ignored) into an integer or a number
+Called By: void column_task(int k);
+Input: p, len--the value
+Output: integer--the value if it is an integer; real--the value if it is a number
+Return: 2--an integer 1--a number which is not an integer 0--not a number
+*************************************************/
+int parse_number(char* p, int len, long long* integer, double* real)
+{
+	char digits[MAX_SIZE];
+	char* rest;
+	while(len>0&&isspace((unsigned char)*p)) {p++; len--;}
+	while(len>0&&isspace((unsigned char)p[len-1])) len--;
+	if(len==0||len>=MAX_SIZE) return 0;
+	memcpy(digits,p,len);
+	digits[len]='\0';
+	*integer=strtoll(digits,&rest,10);
+	if(*rest=='\0')
+	{
+		*real=(double)*integer;
+		return 2;
+	}
+	*real=strtod(digits,&rest);
+	return (*rest=='\0')?1:0;
+}
+
+/*************************************************
+Function: int parse_columns(char* list);
+Description: get the attributes in the columns from the list in config, e.g @age,@sex
+Called By: int main(void);
+Input: list--the attributes separated by ','
+Output: columnNames, columnCount
+Return: 0--success -1--wrong format
+*************************************************/
+int parse_columns(char* list)
+{
+	char* name=strtok(list,",");
+	while(name!=NULL)
+	{
+		name=trim_value(name);
+		if(name[0]!='@'||name[1]=='\0'||strlen(name)>=COLUMN_NAME-1||columnCount>=MAX_COLUMNS) return -1;
+		columnNames[columnCount++]=strdup(name+1);
+		name=strtok(NULL,",");
+	}
+	return (columnCount>0)?0:-1;
+}
+
+/*************************************************
+Function: int parse_namespaces(char* list);
+Description: get the prefixes of the query and their URIs from the list in config, e.g ns=http://x.com/a,=http://x.com/b where 
+the empty prefix is the namespace of the steps without prefix. The URIs are interned as ids from 1.
+Called By: int main(void);
+Input: list--the declarations separated by ','
+Output: nsPrefixes, nsPrefixUri, nsUris
+Return: 0--success -1--wrong format
+*************************************************/
+int parse_namespaces(char* list)
+{
+	char* item=strtok(list,",");
+	char* eq;
+	int k;
+	while(item!=NULL)
+	{
+		item=trim_value(item);
+		eq=strchr(item,'=');
+		if(eq==NULL||eq[1]=='\0'||nsPrefixCount>=MAX_NAMESPACES) return -1;
+		*eq='\0';
+		for(k=0;k<nsPrefixCount;k++)
+		{
+			if(strcmp(nsPrefixes[k],item)==0) return -1;
+		}
+		nsPrefixes[nsPrefixCount]=strdup(item);
+		nsPrefixUri[nsPrefixCount]=intern_uri(eq+1,strlen(eq+1));
+		if(nsPrefixUri[nsPrefixCount]==NS_OTHER)
+		{
+			nsUris[++nsUriCount]=strdup(eq+1);
+			nsPrefixUri[nsPrefixCount]=nsUriCount;
+		}
+		nsPrefixCount++;
+		item=strtok(NULL,",");
+	}
+	return (nsPrefixCount>0)?0:-1;
+}
+
+/*************************************************
+Function: int resolve_steps(void);
+Description: find the URI id, the local name and its hash of each step of the automata. A step p:name has the URI of p, a step 
+without prefix has the URI of the empty prefix, or no namespace.
+Called By: int main(void);
+Return: 0--success -1--a prefix of XPath is not in namespaces
+*************************************************/
+int resolve_steps(void)
+{
+	int j,k,len;
+	char *name,*colon;
+	for(j=1;j<=machineCount;j++)
+	{
+		name=stateMachine[j].str;
+		if(name[0]=='/') name++;  //an end tag
+		colon=strchr(name,':');
+		len=(colon!=NULL)?colon-name:0;
+		stateMachine[j].uri=0;
+		for(k=0;k<nsPrefixCount;k++)
+		{
+			if((int)strlen(nsPrefixes[k])==len&&strncmp(nsPrefixes[k],name,len)==0) break;
+		}
+		if(k<nsPrefixCount) stateMachine[j].uri=nsPrefixUri[k];
+		else if(colon!=NULL)
+		{
+			printf("The prefix %.*s in XPath is not in the namespaces, please open the config and check it again!\n",len,name);
+			return -1;
+		}
+		stateMachine[j].local=(colon!=NULL)?colon+1:name;
+		stateMachine[j].local_len=strlen(stateMachine[j].local);
+		stateMachine[j].hash=name_hash(stateMachine[j].local,stateMachine[j].local_len);
+	}
+	return 0;
+}
+
+/*************************************************
+Function: char* parse_aggregate(char* xpath);
+Description: get the aggregation over XPath, e.g count(/company/develop/programmer) or sum(/company/develop/programmer/@age). 
+aggKind is set to agg_none if there is no aggregation.
+Called By: int main(void);
+Input: xpath--XPath Query command
+Return: the path inside the aggregation(xpath is cut), or xpath itself; NULL--the aggregation is not closed
+*************************************************/
+char* parse_aggregate(char* xpath)
+{
+	int k,len;
+	char* close;
+	for(k=agg_count;k<=agg_distinct;k++)
+	{
+		len=strlen(aggName[k]);
+		if(strncmp(xpath,aggName[k],len)==0&&xpath[len]=='(')
+		{
+			close=strrchr(xpath,')');
+			if(close==NULL||close[1]!='\0')
+			{
+				printf("The aggregation %s in XPath is not closed, please open the config and check it again!\n",aggName[k]);
+				return NULL;
+			}
+			*close='\0';
+			aggKind=(agg_Kind)k;
+			return trim_value(xpath+len+1);
+		}
+	}
+	aggKind=agg_none;
+	return xpath;
+}
+
+/*************************************************
+Function: int merge_aggregates(ResultSet set, int n, Aggregate* total);
+Description: combine the partial aggregations of all the parts. The partials are counted over the same outputs as print_result, 
+so they are only combined when the mappings of the parts are merged into one final mapping.
+Called By: void print_aggregate(ResultSet set, int n);
+Input: set--result mapping set; n--the number of parts(start with 0)
+Output: total--the aggregation for the whole file
+Return: 0--success; -1--the mappings can not be merged
+*************************************************/
+int merge_aggregates(ResultSet set, int n, Aggregate* total)
+{
+	int i;
+	memset(total,0,sizeof(Aggregate));
+	if(set.begin==-1) return -1;
+	for(i=firstPart;i<=n;i++)
+	{
+		add_aggregate(total,&part_agg[i]);
+	}
+	return 0;
+}
+
+/*************************************************
+Function: void add_aggregate(Aggregate* total, Aggregate* part);
+Description: combine the partial aggregation of one part into the aggregation of the parts before it
+Called By: int merge_aggregates(ResultSet set, int n, Aggregate* total); char* merge_stream(int k, size_t* size);
+Input: total--the aggregation of the parts before; part--the partial aggregation of this part
+Output: total
+*************************************************/
+void add_aggregate(Aggregate* total, Aggregate* part)
+{
+	int k;
+	total->count+=part->count;
+	if(part->numbers>0)
+	{
+		if(total->numbers==0||part->min<total->min) total->min=part->min;
+		if(total->numbers==0||part->max>total->max) total->max=part->max;
+		total->sum+=part->sum;
+		total->numbers+=part->numbers;
+	}
+	if(aggKind==agg_distinct)
+	{
+		for(k=0;k<HLL_REGISTERS;k++)
+		{
+			if(part->hll[k]>total->hll[k]) total->hll[k]=part->hll[k];
+		}
+		if(part->exact==-1) total->exact=-1;
+		for(k=0;k<part->exact&&total->exact!=-1;k++)
+		{
+			add_hash(total,part->hashes[k]);
+		}
+	}
+}
+
+/*************************************************
+Function: void add_hash(Aggregate* agg, unsigned long long h);
+Description: keep a hash for distinct() if it is not kept yet. Once there are more than DISTINCT_EXACT distinct hashes, none is kept 
+any more and distinct() is estimated by the registers.
+Called By: void aggregate_output(Aggregate* agg, char* p, int len); void add_aggregate(Aggregate* total, Aggregate* part);
+Input: agg--the aggregation; h--the hash of an output
+*************************************************/
+void add_hash(Aggregate* agg, unsigned long long h)
+{
+	int k;
+	if(agg->exact==-1) return;
+	for(k=0;k<agg->exact;k++)
+	{
+		if(agg->hashes[k]==h) return;
+	}
+	if(agg->exact==DISTINCT_EXACT) agg->exact=-1;
+	else agg->hashes[agg->exact++]=h;
+}
+
+/*************************************************
+Function: void print_aggregate(ResultSet set, int n);
+Description: merge the partial aggregations and print the aggregation for the whole file
+Called By: int main(void); int batch_main(char* pattern, int workers);
+Input: set--result mapping set; n--the number of parts(start with 0)
+*************************************************/
+void print_aggregate(ResultSet set, int n)
+{
+	Aggregate total;
+	print_total(merge_aggregates(set,n,&total)==-1?NULL:&total);
+}
+
+/*************************************************
+Function: void print_total(Aggregate* total);
+Description: print the aggregation for the whole file. distinct() is exact while there are no more than DISTINCT_EXACT distinct 
+outputs, otherwise it is an estimation, which is more than DISTINCT_EXACT and no more than the number of outputs.
+Called By: void print_aggregate(ResultSet set, int n); int main(void);
+Input: total--the aggregation for the whole file, NULL--the mappings can not be merged
+*************************************************/
+void print_total(Aggregate* total)
+{
+	double estimate,harmonic=0;
+	int k,zeros=0;
+	if(total==NULL)
+	{
+		fprintf(resultFile,"The %s() for this file is null, please check the XPath command.\n",aggName[aggKind]);
+		return;
+	}
+	switch(aggKind)
+	{
+		case agg_count:
+			fprintf(resultFile,"The count() for this file is %lld\n",total->count);
+			break;
+		case agg_sum:
+			fprintf(resultFile,"The sum() for this file is %.15g(%lld numbers)\n",total->sum,total->numbers);
+			break;
+		case agg_min:
+		case agg_max:
+			if(total->numbers==0) fprintf(resultFile,"The %s() for this file is null, no output is a number.\n",aggName[aggKind]);
+			else fprintf(resultFile,"The %s() for this file is %.15g\n",aggName[aggKind],aggKind==agg_min?total->min:total->max);
+			break;
+		case agg_distinct:
+			if(total->exact!=-1)
+			{
+				fprintf(resultFile,"The distinct() for this file is %d(%lld outputs)\n",total->exact,total->count);
+				break;
+			}
+			for(k=0;k<HLL_REGISTERS;k++)
+			{
+				harmonic+=ldexp(1.0,-total->hll[k]);
+				if(total->hll[k]==0) zeros++;
+			}
+			estimate=0.7213/(1+1.079/HLL_REGISTERS)*HLL_REGISTERS*HLL_REGISTERS/harmonic;
+			if(estimate<=2.5*HLL_REGISTERS&&zeros>0)
+			{
+				estimate=HLL_REGISTERS*log((double)HLL_REGISTERS/zeros);  //linear counting for a small number
+			}
+			if(estimate<DISTINCT_EXACT+1) estimate=DISTINCT_EXACT+1;
+			if(estimate>total->count) estimate=total->count;
+			fprintf(resultFile,"The distinct() for this file is about %.0f(%lld outputs)\n",estimate,total->count);
+			break;
+		default:
+			break;
+	}
+}
+
+/*************************************************
+Function: void init_check(TagCheck* check);
+Description: empty a check of the tags, for the parts merged in document order
+Called By: int main(void); int batch_main(char* pattern, int workers); int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: check--the check to be emptied
+*************************************************/
+void init_check(TagCheck* check)
+{
+	memset(check,0,sizeof(TagCheck));
+	check->maxopen=INIT_OUTPUT;
+	check->open=(TagName*)malloc(INIT_OUTPUT*sizeof(TagName));
+	check->owned=1;
+	check->error=-1;
+	check->unfinished=-1;
+}
+
+/*************************************************
+Function: void merge_check(TagCheck* set, int i);
+Description: merge the check of one part into the check of the parts before it. The close tags kept by the part are met before its 
+start tags not closed, so each of them must match the start tag on the top of the stack of the parts before; then the error of the 
+part is taken if there is no earlier one, and the start tags not closed are copied onto the stack, since the part may be freed. 
+The lists of the part are freed.
+Called By: int main(void); char* merge_stream(int k, size_t* size); int batch_main(char* pattern, int workers); 
+int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: set--the check of the parts before; i--the number of this part
+Output: set
+*************************************************/
+void merge_check(TagCheck* set, int i)
+{
+	TagCheck* c=&part_check[i];
+	TagName* t;
+	LineCursor cursor;
+	int k;
+	set->parts++;
+	for(k=0;k<c->topclose&&set->error==-1;k++)
+	{
+		if(set->topopen==0)
+		{
+			set->error=c->close[k].at;
+			if(lineMode==1) part_position(i,set->error,&set->line,&set->column);
+			snprintf(set->reason,sizeof(set->reason),"the close tag </%.*s> has no start tag",
+				c->close[k].len>40?40:c->close[k].len,c->close[k].p);
+			break;
+		}
+		t=&set->open[set->topopen-1];
+		if(t->len!=c->close[k].len||memcmp(t->p,c->close[k].p,t->len)!=0)
+		{
+			set->error=c->close[k].at;
+			snprintf(set->reason,sizeof(set->reason),"the close tag </%.*s> does not match the start tag <%.*s> at %ld",
+				c->close[k].len>40?40:c->close[k].len,c->close[k].p,t->len>40?40:t->len,t->p,t->at);
+			if(lineMode==1)
+			{
+				part_position(i,set->error,&set->line,&set->column);
+				snprintf(set->reason+strlen(set->reason),sizeof(set->reason)-strlen(set->reason),"(line %ld, column %ld)",t->line,t->column);
+			}
+			break;
+		}
+		free(t->p);
+		set->topopen--;
+	}
+	if(set->error==-1&&c->error!=-1)
+	{
+		set->error=c->error;
+		memcpy(set->reason,c->reason,sizeof(set->reason));
+		if(lineMode==1) part_position(i,set->error,&set->line,&set->column);
+	}
+	if(lineMode==1) init_cursor(&cursor,buffFiles[i],line_base[i],column_base[i]);
+	for(k=0;k<c->topopen&&set->error==-1;k++)
+	{
+		if(set->topopen==set->maxopen)
+		{
+			set->maxopen*=2;
+			set->open=(TagName*)realloc(set->open,set->maxopen*sizeof(TagName));
+		}
+		t=&set->open[set->topopen++];
+		*t=c->open[k];
+		t->p=(char*)malloc(t->len);
+		memcpy(t->p,c->open[k].p,t->len);
+		if(lineMode==1) find_position(&cursor,t->at-part_offset[i],&t->line,&t->column);  //the start tags are in document order
+	}
+	set->unfinished=c->unfinished;
+	if(lineMode==1&&set->unfinished!=-1) find_position(&cursor,set->unfinished-part_offset[i],&set->endline,&set->endcolumn);
+	if(c->owned==1)
+	{
+		for(k=0;k<c->topopen;k++) free(c->open[k].p);
+		for(k=0;k<c->topclose;k++) free(c->close[k].p);
+	}
+	free(c->open);
+	free(c->close);
+	c->open=NULL;
+	c->close=NULL;
+	c->topopen=0;
+	c->topclose=0;
+}
+
+/*************************************************
+Function: void print_check(TagCheck* set);
+Description: print whether the file is well-formed, or its first error: the first error met in document order, then the innermost 
+start tag not closed at the end of the file, then the markup not finished at the end of the file. The check is freed.
+Called By: int main(void); int batch_main(char* pattern, int workers); int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: set--the check of all the parts
+*************************************************/
+void print_check(TagCheck* set)
+{
+	int k;
+	TagName* t;
+	if(set->error!=-1)
+	{
+		fprintf(resultFile,"The XML is not well-formed at %ld",set->error);
+		print_position(set->line,set->column);
+		fprintf(resultFile,": %s.\n",set->reason);
+	}
+	else if(set->topopen>0)
+	{
+		t=&set->open[set->topopen-1];
+		fprintf(resultFile,"The XML is not well-formed: the start tag <%.*s> at %ld",t->len>40?40:t->len,t->p,t->at);
+		print_position(t->line,t->column);
+		fprintf(resultFile," is not closed at the end of the file.\n");
+	}
+	else if(set->unfinished!=-1)
+	{
+		fprintf(resultFile,"The XML is not well-formed at %ld",set->unfinished);
+		print_position(set->endline,set->endcolumn);
+		fprintf(resultFile,": the markup is not finished at the end of the file.\n");
+	}
+	else
+	{
+		fprintf(resultFile,"The XML is well-formed: the tags are balanced(%d parts are checked).\n",set->parts);
+	}
+	for(k=0;k<set->topopen;k++) free(set->open[k].p);
+	free(set->open);
+	set->open=NULL;
+	set->topopen=0;
+}
+
+/*************************************************
+Function: void stitch_fragments(int n);
+Description: join the fragments which begin and end in different parts. In each part, the close tags without a start tag are met 
+before the start tags without a close tag, so the parts are walked in document order with a stack of the fragments not ended yet: 
+a close tag ends the fragment(or FRAG_REJECTED marker) on the top of the stack.
+Called By: int main(void);
+Input: n--the number of parts(start with 0)
+*************************************************/
+void stitch_fragments(int n)
+{
+	int i,k,top=0,max=INIT_OUTPUT;
+	Fragment** open=(Fragment**)malloc(max*sizeof(Fragment*));
+	Fragment* f;
+	for(i=firstPart;i<=n;i++)
+	{
+		for(k=0;k<state_stack[i].topfrag;k++)
+		{
+			f=&state_stack[i].frag[k];
+			if(f->begin==-1)
+			{
+				if(top>0) open[--top]->end=f->end;
+			}
+			else if(f->end==-1)
+			{
+				if(top==max)
+				{
+					max*=2;
+					open=(Fragment**)realloc(open,max*sizeof(Fragment*));
+				}
+				open[top++]=f;
+			}
+		}
+	}
+	free(open);
+}
+
+/*************************************************
+Function: int print_fragments(char* file_name, int n);
+Description: print the fragments in document order. The file is mapped into memory, so each fragment is printed from the file 
+without being copied, even if it crosses the parts. A compressed(or transcoded) file is loaded again instead, so is every file on Windows.
+Called By: int main(void);
+Input: file_name--the name for the xml file; n--the number of parts(start with 0)
+Return: 0--success; -1--can't map the XML file
+*************************************************/
+int print_fragments(char* file_name, int n)
+{
+	int fd;
+	struct stat st;
+	char* map;
+	if(must_load(file_name))  /* the fragments are in the decompressed(or transcoded) content */
+	{
+		long size;
+		map=load_content(file_name,&size);
+		if(map==NULL) return -1;
+		st.st_size=size;
+		fd=-1;
+	}
+#ifndef _WIN32
+	else
+	{
+		fd=open(file_name,O_RDONLY);
+		if(fd==-1) return -1;
+		if(fstat(fd,&st)==-1||st.st_size==0)
+		{
+			close(fd);
+			return -1;
+		}
+		map=(char*)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if(map==MAP_FAILED) return -1;
+	}
+#endif
+	write_fragments(map,st.st_size,n);
+	if(fd==-1) free(map);
+#ifndef _WIN32
+	else munmap(map,st.st_size);
+#endif
+	return 0;
+}
+
+/*************************************************
+Function: void write_fragments(char* map, long size, int n);
+Description: print the fragments of all the parts from the content of the file, a fragment not closed in the file is counted only. 
+With line-numbers, each fragment is led by [line:column].
+Called By: int print_fragments(char* file_name, int n); void serve_query(char* file_name, char* xpath);
+Input: map--the content of the file; size--the size of the content; n--the number of parts(start with 0)
+*************************************************/
+void write_fragments(char* map, long size, int n)
+{
+	int i,k;
+	long count=0,unclosed=0,line,column;
+	Fragment* f;
+	LineCursor cursor;
+	fprintf(resultFile,"The fragments for this file are:\n");
+	for(i=firstPart;i<=n;i++)
+	{
+		if(lineMode==1) init_cursor(&cursor,map+part_offset[i],line_base[i],column_base[i]);  //a fragment begins in its part
+		for(k=0;k<state_stack[i].topfrag;k++)
+		{
+			f=&state_stack[i].frag[k];
+			if(f->begin==-1||f->begin==FRAG_REJECTED) continue;
+			if(f->end==-1||f->end>size)
+			{
+				unclosed++;
+				continue;
+			}
+			if(lineMode==1)
+			{
+				find_position(&cursor,f->begin-part_offset[i],&line,&column);
+				fprintf(resultFile,"[%ld:%ld] ",line,column);
+			}
+			fprintf(resultFile,"%.*s\n",(int)(f->end-f->begin),map+f->begin);
+			count++;
+		}
+	}
+	fprintf(resultFile,"%ld fragments",count);
+	if(unclosed>0) fprintf(resultFile,", %ld fragments are not closed in the file",unclosed);
+	fprintf(resultFile,"\n");
+}
+
+/*************************************************
+Function: int sample_file(char* file_name, FileSample* fs);
+Description: estimate the features of an XML file for the cost model. A small file is scanned completely, while a large file is 
+sampled at its head, middle and tail, counting the open angle brackets(tags) and the bytes outside markup(text). The bytes of a compressed 
+or transcoded file are sampled as they are, so the plan for it is only a guess and the run does not calibrate the cost model.
+Called By: int main(void);
+Input: file_name--the name for the xml file; fs--the sample waiting to be filled
+Output: fs--the size, tag density and text fraction of the file
+Return: 0--success; -1--can't open the XML file
+*************************************************/
+int sample_file(char* file_name, FileSample* fs)
+{
+	FILE *fp;
+	long offset[3];
+	long bytes=0,tags=0,text=0;
+	int i,k,count,intag;
+	fp = fopen (file_name,"rb");
+	if (fp==NULL) { return -1;}
+	fseek (fp, 0, SEEK_END);
+	fs->size=ftell (fp);
+	count=3;
+	offset[0]=0;
+	offset[1]=fs->size/2-SAMPLE_SIZE/2;
+	offset[2]=fs->size-SAMPLE_SIZE;
+	if(fs->size<=3*SAMPLE_SIZE) count=1;
+	char* buff=(char*)malloc((count==1?fs->size+1:SAMPLE_SIZE)*sizeof(char));
+	for(i=0;i<count;i++)
+	{
+		fseek (fp, offset[i], SEEK_SET);
+		int len=fread (buff,1,count==1?fs->size:SAMPLE_SIZE,fp);
+		intag=0;
+		for(k=0;k<len;k++)
+		{
+			if(buff[k]=='<') {tags++; intag=1;}
+			else if(buff[k]=='>') intag=0;
+			else if(intag==0) text++;
+		}
+		bytes+=len;
+	}
+	free(buff);
+	fclose(fp);
+	fs->tag_density=bytes>0?(double)tags/bytes:0;
+	fs->text_fraction=bytes>0?(double)text/bytes:0;
+	return 0;
+}
+
+/*************************************************
+Function: double predict_cost(FileSample* fs, int workers, int parts);
+Description: predict the duration for dealing with the file. The sequential version only pays for lexing the bytes and tags, 
+while the parallel version divides this cost among the threads, pays for each thread and each part, and waits for the last part.
+Called By: void choose_plan(FileSample* fs, int* choose, int* workers, int* parts); void calibrate(...);
+Input: fs--the sample of the file; workers--the number of threads, 0 for the sequential version; parts--the number of parts
+Return: the predicted duration in seconds
+*************************************************/
+double predict_cost(FileSample* fs, int workers, int parts)
+{
+	double lex=fs->size*(fs->text_fraction*costModel.text_cost+(1-fs->text_fraction)*costModel.markup_cost)
+		+fs->size*fs->tag_density*costModel.tag_cost;
+	if(workers==0) return lex+costModel.part_cost;
+	return workers*costModel.thread_cost+parts*costModel.part_cost+lex/workers+PART_IMBALANCE*lex/parts;
+}
+
+/*************************************************
+Function: void choose_plan(FileSample* fs, int* choose, int* workers, int* parts);
+Description: choose the cheapest plan by the cost model. The number of threads is no more than the number of processors 
+(and the number-of-threads in config if it is given), and each part is no smaller than MIN_PART_SIZE.
+Called By: int main(void);
+Input: fs--the sample of the file; workers--the upper bound for the number of threads, -1 if there is none
+Output: choose--0 for the sequential version, 1 for the parallel version; workers--the number of threads; parts--the number of parts
+*************************************************/
+void choose_plan(FileSample* fs, int* choose, int* workers, int* parts)
+{
+	int w,c,maxw;
+	double cost,best;
+#ifdef _WIN32
+	maxw=pthread_num_processors_np();  //there is no sysconf, the processors are counted by winpthreads
+#else
+	maxw=sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(maxw<1) maxw=1;
+	if(maxw>MAX_THREAD) maxw=MAX_THREAD;
+	if(*workers>=1&&*workers<maxw) maxw=*workers;
+	best=predict_cost(fs,0,1);
+	*choose=0; *workers=1; *parts=1;
+	for(w=2;w<=maxw;w++)
+	{
+		for(c=w;c<=MAX_PART&&fs->size/c>=MIN_PART_SIZE;c*=2)
+		{
+			cost=predict_cost(fs,w,c);
+			if(cost<best)
+			{
+				best=cost;
+				*choose=1; *workers=w; *parts=c;
+			}
+		}
+	}
+	if(*choose==0)
+		printf("The auto version chooses the sequential version, the predicted duration is %lf\n",best);
+	else
+		printf("The auto version chooses the parallel version with %d threads and %d parts(about %ld bytes for each part), the predicted duration is %lf\n",
+			*workers,*parts,fs->size/(*parts),best);
+}
+
+/*************************************************
+Function: void load_calibration(char* name);
+Description: load the calibrated cost model and the weight of a tag for balancing the parts, which are saved as "key=value" lines like config. 
+The default model is kept if the file does not exist.
+Called By: int main(void);
+Input: name--the name for the calibration file
+*************************************************/
+void load_calibration(char* name)
+{
+	FILE *fp;
+	char buf[MAX_LINE];
+	char *key,*value;
+	if((fp = fopen(name,"r")) == NULL) return;
+	while(fgets(buf,MAX_LINE,fp) != NULL)
+	{
+		key=strtok(buf,"=");
+		value=strtok(NULL,"=");
+		if(key==NULL||value==NULL) continue;
+		if(strcmp(key,"text_cost")==0) sscanf(value,"%lf",&costModel.text_cost);
+		else if(strcmp(key,"markup_cost")==0) sscanf(value,"%lf",&costModel.markup_cost);
+		else if(strcmp(key,"tag_cost")==0) sscanf(value,"%lf",&costModel.tag_cost);
+		else if(strcmp(key,"thread_cost")==0) sscanf(value,"%lf",&costModel.thread_cost);
+		else if(strcmp(key,"part_cost")==0) sscanf(value,"%lf",&costModel.part_cost);
+		else if(strcmp(key,"runs")==0) sscanf(value,"%d",&costModel.runs);
+		else if(strcmp(key,"tag_weight")==0) sscanf(value,"%lf",&tagWeight);
+	}
+	fclose(fp);
+	printf("The cost model has been calibrated with %d runs before.\n",costModel.runs);
+}
+
+/*************************************************
+Function: void save_calibration(char* name);
+Description: save the calibrated cost model, so that the next run starts with it
+Called By: int main(void);
+Input: name--the name for the calibration file
+*************************************************/
+void save_calibration(char* name)
+{
+	FILE *fp;
+	if((fp = fopen(name,"w")) == NULL)
+	{
+		printf("The calibration can not be saved into %s.\n",name);
+		return;
+	}
+	fprintf(fp,"text_cost=%.6e\n",costModel.text_cost);
+	fprintf(fp,"markup_cost=%.6e\n",costModel.markup_cost);
+	fprintf(fp,"tag_cost=%.6e\n",costModel.tag_cost);
+	fprintf(fp,"thread_cost=%.6e\n",costModel.thread_cost);
+	fprintf(fp,"part_cost=%.6e\n",costModel.part_cost);
+	fprintf(fp,"runs=%d\n",costModel.runs);
+	fprintf(fp,"tag_weight=%lf\n",tagWeight);
+	fclose(fp);
+}
+
+/*************************************************
+Function: void calibrate(FileSample* fs, int choose, int workers, int parts, double duration);
+Description: tune the cost model by the measured durations. The lexing costs are scaled by the ratio between the measured lexing time of all 
+the parts and the predicted one, the cost of a part is the mean time for preparing a part before it is lexed, and for the parallel version 
+the time which is not spent in any part is charged to the threads. Each run moves the model by CALIBRATION_RATE towards the measurement.
+Called By: int main(void);
+Input: fs--the sample of the file; choose--0 for the sequential version, 1 for the parallel version; workers--the number of threads; 
+parts--the number of parts; duration--the measured duration for dealing with the file
+*************************************************/
+void calibrate(FileSample* fs, int choose, int workers, int parts, double duration)
+{
+	int i;
+	double busy=0,setup=0,lex,scale;
+	for(i=0;i<parts;i++)
+	{
+		busy+=part_time[i];
+		setup+=part_setup[i];
+	}
+	lex=predict_cost(fs,0,1)-costModel.part_cost;
+	if(lex>0&&busy>setup)
+	{
+		scale=1+CALIBRATION_RATE*((busy-setup)/lex-1);
+		if(scale<0.25) scale=0.25;
+		if(scale>4) scale=4;
+		costModel.text_cost*=scale;
+		costModel.markup_cost*=scale;
+		costModel.tag_cost*=scale;
+	}
+	if(parts>0)
+	{
+		costModel.part_cost+=CALIBRATION_RATE*(setup/parts-costModel.part_cost);
+	}
+	if(choose==1&&duration>busy/workers)
+	{
+		costModel.thread_cost+=CALIBRATION_RATE*((duration-busy/workers)/workers-costModel.thread_cost);
+	}
+	costModel.runs++;
+}
+
+/*************************************************
+Function: void perf_start(PerfCounter *pc);
+Description: open the hardware performance counters (cycles, instructions, branches, branch misses, cache references and cache misses) 
+for the calling thread as one group and enable them. If the kernel denies the access or the machine has no such counters, 
+the counters are marked as not available and the program goes on without them.
+Called By: void *main_thread(void *arg); void main_function(); int main(void);
+Input: pc--the counters for this phase
+*************************************************/
+void perf_start(PerfCounter *pc)
+{
+	int i;
+	pc->enabled=0;
+	for(i=0;i<PERF_COUNTERS;i++)
+	{
+		pc->fd[i]=-1;
+		pc->value[i]=-1;
+	}
+	if(perfMode==0) return;
+#ifdef __linux__
+	unsigned long long config[PERF_COUNTERS]={PERF_COUNT_HW_CPU_CYCLES,PERF_COUNT_HW_INSTRUCTIONS,PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+		PERF_COUNT_HW_BRANCH_MISSES,PERF_COUNT_HW_CACHE_REFERENCES,PERF_COUNT_HW_CACHE_MISSES};
+	struct perf_event_attr attr;
+	for(i=0;i<PERF_COUNTERS;i++)
+	{
+		memset(&attr,0,sizeof(attr));
+		attr.type=PERF_TYPE_HARDWARE;
+		attr.size=sizeof(attr);
+		attr.config=config[i];
+		attr.disabled=(i==0);  //the leader starts all the group
+		attr.exclude_kernel=1;
+		attr.exclude_hv=1;
+		attr.read_format=PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+		pc->fd[i]=syscall(__NR_perf_event_open,&attr,0,-1,i==0?-1:pc->fd[0],0);
+		if(pc->fd[i]==-1&&i==0)
+		{
+			if(perfWarned==0)
+			{
+				printf("The hardware performance counters are not available (%s), please check /proc/sys/kernel/perf_event_paranoid. Continue without them.\n",strerror(errno));
+				perfWarned=1;
+			}
+			return;
+		}
+	}
+	pc->enabled=1;
+	ioctl(pc->fd[0],PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+	ioctl(pc->fd[0],PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+#else
+	if(perfWarned==0)
+	{
+		printf("The hardware performance counters are only supported on Linux. Continue without them.\n");
+		perfWarned=1;
+	}
+#endif
+}
+
+/*************************************************
+Function: void perf_stop(PerfCounter *pc);
+Description: disable the counters opened by perf_start, read their values and close them. The values are scaled 
+if the kernel had to multiplex the counters.
+Called By: void *main_thread(void *arg); void main_function(); int main(void);
+Input: pc--the counters for this phase
+Output: pc->value--the counts for this phase, -1 for the counters which are not available
+*************************************************/
+void perf_stop(PerfCounter *pc)
+{
+	if(pc->enabled==0) return;
+#ifdef __linux__
+	int i;
+	unsigned long long data[3];  //value, time enabled, time running
+	ioctl(pc->fd[0],PERF_EVENT_IOC_DISABLE,PERF_IOC_FLAG_GROUP);
+	for(i=0;i<PERF_COUNTERS;i++)
+	{
+		if(pc->fd[i]==-1) continue;
+		if(read(pc->fd[i],data,sizeof(data))==sizeof(data)&&data[2]>0)
+		{
+			pc->value[i]=(long long)((double)data[0]*data[1]/data[2]);
+		}
+		close(pc->fd[i]);
+		pc->fd[i]=-1;
+	}
+#endif
+}
+
+/*************************************************
+Function: void perf_print(char *phase, PerfCounter *pc);
+Description: print the counts of one phase, together with instructions per cycle, the branch miss rate and the cache miss rate
+Called By: int main(void);
+Input: phase--the name for this phase; pc--the counters for this phase
+*************************************************/
+void perf_print(char *phase, PerfCounter *pc)
+{
+	int i;
+	if(perfMode==0) return;
+	if(pc->enabled==0)
+	{
+		printf("The hardware counters for %s: not available\n",phase);
+		return;
+	}
+	printf("The hardware counters for %s:",phase);
+	for(i=0;i<PERF_COUNTERS;i++)
+	{
+		if(pc->value[i]==-1) printf(" %s=n/a",perfName[i]);
+		else printf(" %s=%lld",perfName[i],pc->value[i]);
+	}
+	if(pc->value[0]>0&&pc->value[1]>=0)
+		printf(", IPC=%.2lf",(double)pc->value[1]/pc->value[0]);
+	if(pc->value[2]>0&&pc->value[3]>=0)
+		printf(", branch-miss-rate=%.2lf%%",100.0*pc->value[3]/pc->value[2]);
+	if(pc->value[4]>0&&pc->value[5]>=0)
+		printf(", cache-miss-rate=%.2lf%%",100.0*pc->value[5]/pc->value[4]);
+	printf("\n");
+}
+
+/*************************************************
+Function: int deal_part(int i);
+Description: initialize the state stack for one part of the file and deal with it
+Called By: void *main_thread(void *arg); void main_function();
+Input: i--the number of this part; 
+Return: 0--success -1--error
+*************************************************/
+int deal_part(int i)
+{
+	struct timeval begin,end;
+	int ret = 0;
+    xml_Text xml;
+    xml_Token token;               
+    int multiExp = 0; //0--single line explanation 1-- multiline explanation
+    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
+    
+    gettimeofday(&begin,NULL);
+    state_stack[i].hasOutput=0;
+    reset_states(i);
+    state_stack[i].exact=0;
+    state_stack[i].topput=0;
+    state_stack[i].maxput=INIT_OUTPUT;
+    state_stack[i].output=(xml_Text*)malloc(INIT_OUTPUT*sizeof(xml_Text));
+    memset(&part_agg[i],0,sizeof(Aggregate));
+    state_stack[i].topfrag=0;
+    state_stack[i].topopen=0;
+    state_stack[i].maxfrag=INIT_OUTPUT;
+    state_stack[i].frag=(Fragment*)malloc(INIT_OUTPUT*sizeof(Fragment));
+    state_stack[i].openfrag=(int*)malloc(INIT_OUTPUT*sizeof(int));
+    if(validateMode==1)
+    {
+    	memset(&part_check[i],0,sizeof(TagCheck));
+    	part_check[i].maxopen=INIT_OUTPUT;
+    	part_check[i].open=(TagName*)malloc(INIT_OUTPUT*sizeof(TagName));
+    	part_check[i].maxclose=INIT_OUTPUT;
+    	part_check[i].close=(TagName*)malloc(INIT_OUTPUT*sizeof(TagName));
+    	part_check[i].error=-1;
+    	part_check[i].unfinished=-1;
+	}
+    if(lineMode==1) count_lines(i);
+    part_events[i].top=0;
+    part_events[i].depth=0;
+    if(columnCount>0) part_columns[i]=(xml_Text*)malloc(INIT_OUTPUT*columnCount*sizeof(xml_Text));
+    if(nsMode==1) reset_namespaces(i);
+    xml_initText(&xml,"");
+    xml.p=buffFiles[i];
+    xml.len=part_bytes[i];  //a part of the query server is a span of the mapped file, which is not ended with '\0'
+    xml_initToken(&token, &xml);
+    gettimeofday(&end,NULL);
+    part_setup[i]=(end.tv_sec-begin.tv_sec)+(end.tv_usec-begin.tv_usec)/1000000.0;
+    ret = xml_process(&xml, &token, multiExp, multiCDATA, i);
+    gettimeofday(&end,NULL);
+    part_time[i]=(end.tv_sec-begin.tv_sec)+(end.tv_usec-begin.tv_usec)/1000000.0;
+    if(ret==-1)
+    {
+    	printf("There is something wrong with your XML format in part %d, please check it!\n",i);
+	}
+	return ret;
+}
+
+/*************************************************
+Function: void event_task(int k);
+Description: deal with one part for xpq_events(), a part which is not correct XML fails the tasks. The part is marked as done for 
+the delivery, and a part is skipped once the events are not needed any more.
+Called By: int xpq_events(const char* content, long size, int threads, int batch, XpqEventHandler handler, void* user);
+Input: k--the number of this part
+*************************************************/
+void event_task(int k)
+{
+	if(eventStop==0)
+	{
+		part_events[k].failed=(deal_part(k)==-1);
+		free(state_stack[k].output);
+		free(state_stack[k].frag);
+		free(state_stack[k].openfrag);
+	}
+	pthread_mutex_lock(&part_lock);
+	part_events[k].done=1;
+	pthread_cond_broadcast(&event_ready);
+	pthread_mutex_unlock(&part_lock);
+}
+
+/*************************************************
+Function: int xpq_events(const char* content, long size, int threads, int batch, XpqEventHandler handler, void* user);
+Description: the event API(XML_parallel.h). The content is cut into one part for each thread at open angle brackets, the parts are 
+lexed by the threads with the tokens kept as events, while the calling thread delivers the events in document order: as soon as a 
+part and all the parts before it are done, the depth before it is the sum of the depths at the ends of the parts before, and its 
+events are copied with it into one buffer of batch events, which is given to handler each time it is full. No XPath is needed: the 
+automata is hidden while the parts are lexed, and the attributes are always lexed.
+Called By: the programs embedding the lexer
+Input: content--the XML content; size--the size of content; threads--the number of threads; batch--the events for each call of 
+handler; handler--the consumer of the events; user--given to handler
+Return: 0--all the events are delivered; 1--the handler stopped it; -1--the content is not correct XML(the events of the parts 
+before the part with the error are delivered) or the arguments are not correct
+*************************************************/
+int xpq_events(const char* content, long size, int threads, int batch, XpqEventHandler handler, void* user)
+{
+	long* cut;
+	XpqEvent* buffer;
+	pthread_t th[MAX_THREAD];
+	void (*task)(int)=event_task;
+	int i,k,count,top=0,ret=0,base=0,workers;
+	int attributes=useAttributes,nodes=machineCount,skip=skipDeadStates;
+	if(content==NULL||size<=0||threads<1||batch<1||handler==NULL) return -1;
+	if(threads>MAX_THREAD) threads=MAX_THREAD;
+	cut=cut_points((char*)content,size,threads,&count);
+	for(i=0;i<count;i++)
+	{
+		buffFiles[i]=(char*)content+cut[i];  //the parts are spans of the content, which is not ended with '\0'
+		part_bytes[i]=cut[i+1]-cut[i];
+		part_offset[i]=cut[i];
+		state_stack[i].exact=0;
+		part_events[i].failed=0;
+		part_events[i].done=0;
+	}
+	skipDeadStates=0;  //every token is an event
+	build_lexer();
+	eventMode=1;
+	useAttributes=1;
+	machineCount=0;  //no tag is matched, only the tokens are kept
+	eventStop=0;
+	taskCount=count;
+	nextTask=0;
+	for(workers=0;workers<threads&&workers<count;workers++)
+	{
+		if(pthread_create(&th[workers],NULL,task_thread,&task)!=0) break;
+	}
+	if(workers==0) task_thread(&task);  //no thread can be started, the parts are lexed before they are delivered
+	buffer=(XpqEvent*)malloc(batch*sizeof(XpqEvent));
+	for(i=0;i<count&&ret==0;i++)
+	{
+		pthread_mutex_lock(&part_lock);
+		while(part_events[i].done==0)
+		{
+			pthread_cond_wait(&event_ready,&part_lock);
+		}
+		pthread_mutex_unlock(&part_lock);
+		if(part_events[i].failed==1)
+		{
+			ret=-1;
+			break;
+		}
+		for(k=0;k<part_events[i].top&&ret==0;k++)
+		{
+			buffer[top]=part_events[i].event[k];
+			buffer[top].depth+=base;
+			if(++top==batch)
+			{
+				if(handler(buffer,top,content,user)!=0) ret=1;
+				top=0;
+			}
+		}
+		base+=part_events[i].depth;
+		free(part_events[i].event);  //the events of a part are freed once they are delivered
+		part_events[i].event=NULL;
+		part_events[i].max=0;
+		part_events[i].top=0;
+	}
+	if(ret==0&&top>0&&handler(buffer,top,content,user)!=0) ret=1;
+	eventStop=1;
+	for(k=0;k<workers;k++)
+	{
+		pthread_join(th[k],NULL);
+	}
+	eventMode=0;
+	useAttributes=attributes;
+	machineCount=nodes;
+	skipDeadStates=skip;
+	build_lexer();
+	for(i=0;i<count;i++)
+	{
+		free(part_events[i].event);
+		part_events[i].event=NULL;
+		part_events[i].max=0;
+		part_events[i].top=0;
+	}
+	free(buffer);
+	free(cut);
+	return ret;
+}
+
+/*************************************************
+Function: void publish_part(int i);
+Description: publish the number of outputs of a part which has been dealt with. The parts are confirmed in document order, 
+and once the confirmed parts have the first N outputs, the parts after them are not needed: a thread stops taking parts 
+and a part being dealt with stops at its next tag. Called with part_lock held. With namespaces no part is cancelled, since a part 
+may be dealt with again after all the parts are done.
+Called By: void *main_thread(void *arg); void main_function();
+Input: i--the number of this part; 
+*************************************************/
+void publish_part(int i)
+{
+	part_done[i]=1;
+	while(nsMode==0&&confirmedPart<partCount&&part_done[confirmedPart]==1&&limitPart==MAX_PART)
+	{
+		confirmedCount+=state_stack[confirmedPart].topput;
+		if(confirmedCount>=outputLimit)
+		{
+			limitPart=confirmedPart+1;
+			break;
+		}
+		confirmedPart++;
+	}
+}
+
+/*************************************************
+Function: char* merge_stream(int k, size_t* size);
+Description: merge the parts read from stdin in document order as soon as they are done. Each part which has been dealt with and 
+follows the merged parts is merged into streamSet, its outputs(only the first N outputs if there is a limit) are copied into a 
+buffer and its slot is freed for a later part, the buffer is printed by print_stream() after part_lock is released. Once the mapping 
+of a part can not be merged, no more outputs are copied, as print_result() prints none. The lines before the part are taken from the 
+parts merged, since their slots may be taken again. Called with part_lock held. There is no open_memstream on Windows, so the outputs 
+are copied through a temporary file there.
+Called By: void *main_thread(void *arg);
+Input: k--the number of the part which has been dealt with
+Output: size--the size of the outputs copied
+Return: the outputs copied(freed by print_stream)
+*************************************************/
+char* merge_stream(int k, size_t* size)
+{
+	int i,j,printed=0;
+	long line,column;
+	LineCursor cursor;
+	char* text=NULL;
+#ifdef _WIN32
+	FILE* out=tmpfile();
+#else
+	FILE* out=open_memstream(&text,size);
+#endif
+	part_done[k%MAX_PART]=1;
+	while(mergedParts<partCount&&part_done[mergedParts%MAX_PART]==1)
+	{
+		i=mergedParts%MAX_PART;
+		if(lineMode==1)
+		{
+			next_line_base(i);
+			init_cursor(&cursor,buffFiles[i],line_base[i],column_base[i]);
+		}
+		if(merge_part(&streamSet,i,&streamMerged)==-1&&streamFailed==0)
+		{
+			streamFailed=1;
+			if(printed>0) fprintf(out,"\n");
+			fprintf(out,"The mapping for this part is null, please check the XPath command.\n");
+			printed=0;
+		}
+		if(aggKind!=agg_none) add_aggregate(&streamTotal,&part_agg[i]);
+		if(validateMode==1) merge_check(&checkSet,i);  //the names are copied before the slot is freed
+		for(j=0;streamFailed==0&&j<state_stack[i].topput&&(outputLimit==0||streamOutputs<outputLimit);j++,streamOutputs++,printed++)
+		{
+			if(lineMode==1)
+			{
+				find_position(&cursor,state_stack[i].output[j].p-buffFiles[i],&line,&column);
+				print_text(out,&state_stack[i].output[j]);
+				fprintf(out,"[%ld:%ld] ",line,column);
+			}
+			else
+			{
+				print_text(out,&state_stack[i].output[j]);
+				fputc(' ',out);
+			}
+		}
+		if(outputLimit>0&&streamOutputs>=outputLimit) stopInput=1;
+		free(buffFiles[i]);  //the outputs are spans of the part
+		free(state_stack[i].output);
+		free(state_stack[i].frag);
+		free(state_stack[i].openfrag);
+		part_done[i]=0;
+		mergedParts++;
+	}
+	if(printed>0) fprintf(out,"\n");
+#ifdef _WIN32
+	*size=ftell(out);
+	text=(char*)malloc(*size+1);
+	rewind(out);
+	*size=fread(text,1,*size,out);
+#endif
+	fclose(out);
+	pthread_cond_broadcast(&part_ready);  //the slots are free for the reader of stdin
+	return text;
+}
+
+/*************************************************
+Function: void print_stream(char* text, size_t size, long ticket);
+Description: print the outputs copied by merge_stream() without part_lock. The copies are numbered under part_lock, so they are 
+printed in the order they were merged.
+Called By: void *main_thread(void *arg);
+Input: text, size--the outputs copied; ticket--the number of the copy
+*************************************************/
+void print_stream(char* text, size_t size, long ticket)
+{
+	pthread_mutex_lock(&print_lock);
+	while(printTicket!=ticket)
+	{
+		pthread_cond_wait(&print_turn,&print_lock);
+	}
+	if(size>0)
+	{
+		fwrite(text,1,size,resultFile);
+		fflush(resultFile);
+	}
+	printTicket++;
+	pthread_cond_broadcast(&print_turn);
+	pthread_mutex_unlock(&print_lock);
+	free(text);
+}
+
+/*************************************************
+Function: void *main_thread(void *arg);
+Description: main function for each thread. The thread takes the next part which is not dealt with until all the parts are done. 
+With the decompression pipeline or stdin, the thread waits until the part is published or the input ends.
+Called By: int main(void);
+Input: arg--the number of this thread; 
+*************************************************/
+void *main_thread(void *arg)
+{
+	int t=(int)(*((int*)arg));
+	int i;
+	char* text;
+	size_t size;
+	long ticket;
+	printf("start to deal with thread %d.\n",t);
+	perf_start(&perf_process[t]);
+	while(1)
+	{
+		pthread_mutex_lock(&part_lock);
+		i=nextPart++;
+		while(i>=partCount&&inputDone==0)  /* wait for the decompression pipeline or stdin */
+		{
+			pthread_cond_wait(&part_ready,&part_lock);
+		}
+		pthread_mutex_unlock(&part_lock);
+		if(i>=partCount||(stdinInput==0&&i>=limitPart)||stopInput==1) break;
+		deal_part(i%MAX_PART);
+		if(stdinInput==1)
+		{
+			pthread_mutex_lock(&part_lock);
+			text=merge_stream(i,&size);
+			ticket=streamTicket++;
+			pthread_mutex_unlock(&part_lock);
+			print_stream(text,size,ticket);
+		}
+		else if(outputLimit>0)
+		{
+			pthread_mutex_lock(&part_lock);
+			publish_part(i);
+			pthread_mutex_unlock(&part_lock);
+		}
+	}
+	perf_stop(&perf_process[t]);
+    finish_args[t]=1;
+    printf("finish dealing with thread %d.\n",t);
+	return NULL;
+}
+
+/*************************************************
+Function: void thread_wait(int n);
+Description: waiting for all the threads finish their tasks. 
+Called By: int main(void);
+Input: n--the number of all threads; 
+*************************************************/
+void thread_wait(int n)
+{
+	int t;
+	while(1){
+		for( t = 0; t <= n; t++)
+	    {
+	    	if(finish_args[t]==0)
+	    	{
+	    		break;
+			}
+	    }
+	    if(t>n) break;
+	   usleep(10000);
+	}   
+}
+
+/*************************************************
+Function: void main_function();
+Description: main function for sequential version. 
+Called By: int main(void);
+*************************************************/
+void main_function()
+{
+	printf("begin dealing with the state tree.\n");
+	perf_start(&perf_process[0]);
+	deal_part(0);
+	if(outputLimit>0) publish_part(0);
+	perf_stop(&perf_process[0]);
+    finish_args[0]=1;
+    printf("finish dealing with the state tree.\n");
+}
+
+/*************************************************
+Function: long find_records(char* content, long size);
+Description: find the records in the file. In record-mode 1, the records are separated by recordDelimiter. In record-mode 2, a record 
+ends with the close tag of a top-level element, the XML head, comments, DOCTYPE and CDATA are skipped as a whole and the quoted 
+values of attributes are jumped over. A record with only blanks is dropped.
+Called By: int record_main(int workers);
+Input: content--the whole file; size--the size of the file
+Return: the number of records
+*************************************************/
+long find_records(char* content, long size)
+{
+	long max=RECORD_BATCH,count=0,begin=-1;
+	long dlen=strlen(recordDelimiter);
+	int depth=0,element;
+	char *p=content,*end=content+size,*next,*q;
+	record_begin=(long*)malloc(max*sizeof(long));
+	record_len=(long*)malloc(max*sizeof(long));
+	while(p<end)
+	{
+		if(recordMode==1)
+		{
+			next=find_string(p,end-p,recordDelimiter,dlen);
+			if(next==NULL) next=end;
+			begin=p-content;
+			q=next;
+			p=(next==end)?end:next+dlen;
+		}
+		else
+		{
+			next=(char*)memchr(p,'<',end-p);
+			if(next==NULL) break;
+			if(depth==0&&begin==-1) begin=next-content;
+			q=next+1;
+			element=0;
+			if(q<end&&*q=='?') q=find_string(q,end-q,"?>",2);
+			else if(end-q>=3&&strncmp(q,"!--",3)==0) q=find_string(q,end-q,"-->",3);
+			else if(end-q>=8&&strncmp(q,"![CDATA[",8)==0) q=find_string(q,end-q,"]]>",3);
+			else if(q<end&&*q=='!')
+			{
+				while(q<end&&*q!='>'&&*q!='[') q++;
+				if(q<end&&*q=='[') q=find_string(q,end-q,"]>",2);
+			}
+			else
+			{
+				element=1;
+				if(q<end&&*q=='/') depth--;
+				else depth++;
+				q=skip_attributes(q,end);
+				if(q<end&&*(q-1)=='/') depth--;  //<xxx/>
+			}
+			if(q==NULL||q>=end) break;
+			p=(char*)memchr(q,'>',end-q)+1;
+			if(element==0||depth>0) continue;
+			depth=0;  //the top-level element is closed
+			q=p;
+		}
+		while(begin<q-content&&isspace((unsigned char)content[begin])) begin++;
+		if(begin<q-content)
+		{
+			if(count==max)
+			{
+				max*=2;
+				record_begin=(long*)realloc(record_begin,max*sizeof(long));
+				record_len=(long*)realloc(record_len,max*sizeof(long));
+			}
+			record_begin[count]=begin;
+			record_len[count]=q-content-begin;
+			count++;
+		}
+		begin=-1;
+	}
+	return count;
+}
+
+/*************************************************
+Function: char* find_string(char* s, long len, char* sub, long sublen);
+Description: look for a string in a buffer which may not end with '\0'. With SSE2, 16 places are checked at a time: the first and 
+the last characters of the string are compared with two blocks, and only the places where both are equal are compared by memcmp. 
+The places left(and a string of one character) are found by memchr.
+Called By: long find_records(char* content, long size); int compare_value(Predicate* pred, char* value, int value_len);
+Input: s--the buffer; len--the length of the buffer; sub--the string; sublen--the length of the string
+Return: the first place of the string in the buffer; NULL--not found
+*************************************************/
+char* find_string(char* s, long len, char* sub, long sublen)
+{
+	char *p=s,*end=s+len;
+	if(sublen<=0) return s;
+#ifdef __SSE2__
+	if(sublen>=2)
+	{
+		__m128i first=_mm_set1_epi8(sub[0]);
+		__m128i last=_mm_set1_epi8(sub[sublen-1]);
+		unsigned int mask;
+		for(;p+sublen-1+16<=end;p+=16)
+		{
+			__m128i head=_mm_loadu_si128((__m128i*)p);
+			__m128i tail=_mm_loadu_si128((__m128i*)(p+sublen-1));
+			mask=_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head,first),_mm_cmpeq_epi8(tail,last)));
+			while(mask!=0)
+			{
+				int k=__builtin_ctz(mask);
+				if(memcmp(p+k+1,sub+1,sublen-2)==0) return p+k;
+				mask&=mask-1;
+			}
+		}
+	}
+#endif
+	while(end-p>=sublen)
+	{
+		p=(char*)memchr(p,sub[0],end-p-sublen+1);
+		if(p==NULL) return NULL;
+		if(memcmp(p,sub,sublen)==0) return p;
+		p++;
+	}
+	return NULL;
+}
+
+/*************************************************
+Function: int deal_record(int t, long r);
+Description: deal with one record. A record is a whole document, so the state stack begins with the start state of the automata 
+and nothing is speculated. The outputs are appended to the outputs of the batch being dealt with by this thread.
+Called By: void *record_thread(void *arg); int record_main(int workers);
+Input: t--the number of thread; r--the number of record
+Return: 0--success -1--error
+*************************************************/
+int deal_record(int t, long r)
+{
+	xml_Text xml;
+	xml_Token token;
+	int ret;
+	record_taken[r]=record_time();
+	reset_states(t);
+	push(t,stateMachine[1].start);
+	enqueue(t,stateMachine[1].start);
+	state_stack[t].exact=1;
+	if(nsMode==1)   /* nothing is declared before a record */
+	{
+		ns_part[t].exact=1;
+		ns_part[t].base=0;
+		ns_part[t].before.top=0;
+		reset_namespaces(t);
+	}
+	xml.p=buffFiles[0]+record_begin[r];
+	xml.len=record_len[r];
+	xml_initToken(&token,&xml);
+	ret=xml_process(&xml,&token,0,0,t);
+	record_out[r]=state_stack[t].topput;
+	if(ret==-1) record_out[r]=-1;
+	return ret;
+}
+
+/*************************************************
+Function: void *record_thread(void *arg);
+Description: main function for each thread in the record mode. The thread takes the next batch of records until all of them are done, 
+then it outputs the batches which are ready in order.
+Called By: int record_main(int workers);
+Input: arg--the number of this thread; 
+*************************************************/
+void *record_thread(void *arg)
+{
+	int t=(int)(*((int*)arg));
+	long b,r;
+	perf_start(&perf_process[t]);
+	while(1)
+	{
+		pthread_mutex_lock(&part_lock);
+		b=nextBatch++;
+		pthread_mutex_unlock(&part_lock);
+		if(b>=batchCount) break;
+		state_stack[t].topput=0;
+		state_stack[t].maxput=INIT_OUTPUT;
+		state_stack[t].output=(xml_Text*)malloc(INIT_OUTPUT*sizeof(xml_Text));
+		for(r=b*RECORD_BATCH;r<(b+1)*RECORD_BATCH&&r<recordCount;r++)
+		{
+			deal_record(t,r);
+		}
+		pthread_mutex_lock(&part_lock);
+		batch_out[b]=state_stack[t].output;
+		batch_done[b]=1;
+		emit_batches();
+		pthread_mutex_unlock(&part_lock);
+	}
+	perf_stop(&perf_process[t]);
+	finish_args[t]=1;
+	return NULL;
+}
+
+/*************************************************
+Function: void emit_batches();
+Description: output the batches which are done, from the next batch waiting to be output, so the records are output in the order of 
+the file. Each record is a line, a record with a wrong format is marked. The latency of a record ends when it is output, so it counts 
+the time waiting for the records before it. Called with part_lock held.
+Called By: void *record_thread(void *arg);
+*************************************************/
+void emit_batches()
+{
+	long r;
+	int k,first;
+	while(emitBatch<batchCount&&batch_done[emitBatch]==1)
+	{
+		first=0;
+		for(r=emitBatch*RECORD_BATCH;r<(emitBatch+1)*RECORD_BATCH&&r<recordCount;r++)
+		{
+			if(aggKind==agg_none&&record_out[r]==-1) printf("record %ld: the XML format is wrong\n",r);
+			else if(aggKind==agg_none)  /* only the aggregation is output otherwise */
+			{
+				printf("record %ld:",r);
+				for(k=first;k<record_out[r];k++)
+				{
+					putchar(' ');
+					print_text(stdout,&batch_out[emitBatch][k]);
+				}
+				printf("\n");
+				first=record_out[r];
+			}
+			record_latency[r]=record_time()-record_taken[r];
+		}
+		free(batch_out[emitBatch]);
+		emitBatch++;
+	}
+}
+
+/*************************************************
+Function: double record_time(void);
+Description: the time from the beginning of the record mode, by the monotonic clock
+Called By: int deal_record(int t, long r); void emit_batches();
+Return: the time in microseconds
+*************************************************/
+double record_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (now.tv_sec-recordClock.tv_sec)*1e6+(now.tv_nsec-recordClock.tv_nsec)/1e3;
+}
+
+/*************************************************
+Function: int compare_float(const void* a, const void* b);
+Description: compare two floats for qsort
+Called By: int record_main(int workers);
+*************************************************/
+int compare_float(const void* a, const void* b)
+{
+	float x=*(const float*)a,y=*(const float*)b;
+	return (x>y)-(x<y);
+}
+
+/*************************************************
+Function: int record_main(int workers);
+Description: deal with the file in the record mode. The records are found in the file loaded by load_file, dealt with by the threads 
+in batches of RECORD_BATCH records and output in order. The throughput and the latency of each record(p50, p99 and max), from being 
+taken by a thread until being output, are printed.
+Called By: int main(void);
+Input: workers--the number of threads
+Return: 0--success -1--no record in the file
+*************************************************/
+int record_main(int workers)
+{
+	struct timeval begin,end;
+	double duration;
+	int i,rc;
+	long size=strlen(buffFiles[0]);
+	recordCount=find_records(buffFiles[0],size);
+	printf("There are %ld records in the file.\n",recordCount);
+	if(recordCount==0) return -1;
+	batchCount=(recordCount+RECORD_BATCH-1)/RECORD_BATCH;
+	if(workers>batchCount) workers=batchCount;
+	record_out=(int*)malloc(recordCount*sizeof(int));
+	record_latency=(float*)malloc(recordCount*sizeof(float));
+	record_taken=(double*)malloc(recordCount*sizeof(double));
+	batch_out=(xml_Text**)malloc(batchCount*sizeof(xml_Text*));
+	batch_done=(int*)calloc(batchCount,sizeof(int));
+	for(i=0;i<workers;i++)
+	{
+		memset(&part_agg[i],0,sizeof(Aggregate));
+	}
+	gettimeofday(&begin,NULL);
+	clock_gettime(CLOCK_MONOTONIC,&recordClock);
+	for(i=0;i<workers;i++)
+	{
+		thread_args[i]=i;
+		finish_args[i]=0;
+		rc=pthread_create(&thread[i], NULL, record_thread, &thread_args[i]);
+		if (rc)
+		{
+			printf("ERROR; return code is %d\n", rc);
+			exit(1);
+		}
+	}
+	thread_wait(workers-1);
+	gettimeofday(&end,NULL);
+	duration=(end.tv_sec-begin.tv_sec)+(end.tv_usec-begin.tv_usec)/1000000.0;
+	if(aggKind!=agg_none)
+	{
+		ResultSet set;
+		memset(&set,0,sizeof(ResultSet));
+		set.begin=stateMachine[1].start;
+		print_aggregate(set,workers-1);
+	}
+	qsort(record_latency,recordCount,sizeof(float),compare_float);
+	printf("The duration for dealing with the records is %lf, %.0f records for each second\n",duration,recordCount/(duration>0?duration:1e-6));
+	printf("The latency for each record from being read to being output(microseconds): p50 %.2f, p99 %.2f, max %.2f\n",record_latency[recordCount/2],
+		record_latency[(long)(recordCount*0.99)],record_latency[recordCount-1]);
+	if(perfMode==1)
+	{
+		char phase[MAX_LINE];
+		for(i=0;i<workers;i++)
+		{
+			sprintf(phase,"the process phase of thread %d",i);
+			perf_print(phase,&perf_process[i]);
+		}
+	}
+	free(record_begin);
+	free(record_len);
+	free(record_out);
+	free(record_latency);
+	free(record_taken);
+	free(batch_out);
+	free(batch_done);
+	return 0;
+}
+
+/*************************************************
+Function: int compare_batch_size(const void* a, const void* b);
+Description: compare two files by size(the larger one first) for qsort
+Called By: long load_round(BatchFile* files, BatchFile** order, long from, long count, int base, int* end);
+*************************************************/
+int compare_batch_size(const void* a, const void* b)
+{
+	long x=(*(BatchFile* const*)a)->size,y=(*(BatchFile* const*)b)->size;
+	return (x<y)-(x>y);
+}
+
+/*************************************************
+Function: int batch_main(char* pattern, int workers);
+Description: deal with many files by one scheduler, the automata is created only once. The files are taken in rounds of at most 
+BATCH_ROUND_PARTS parts and BATCH_ROUND_SIZE bytes. In each round, a file smaller than BATCH_SPLIT_SIZE is one part, and a larger file 
+is split into parts for several threads; the parts of the larger files are numbered first, so that they are taken first and the small 
+files fill the threads at the end. The threads of the pool are started once for all the rounds, and the rounds take the two halves of 
+the parts by turns, so the next round is loaded while the threads deal with this one. The results are merged for each file and printed 
+in the order of the list, tagged with the name of the file. There is no glob on Windows, so only @ with a file of names is taken there.
+Called By: int main(void);
+Input: pattern--a glob, or @ with a file of names; workers--the number of threads
+Return: the number of files which can't be dealt with; -1--no file is found
+*************************************************/
+int batch_main(char* pattern, int workers)
+{
+#ifndef _WIN32
+	glob_t g;
+#endif
+	FILE* fp;
+	char line[MAX_SIZE*8];
+	BatchFile* files;
+	BatchFile** order;
+	struct stat st;
+	struct timeval begin,end;
+	long count=0,max=64,f,from,to,next;
+	int i,base,last,next_last,failed=0;
+	ResultSet set;
+	files=(BatchFile*)malloc(max*sizeof(BatchFile));
+	if(pattern[0]=='@')
+	{
+		if((fp=fopen(pattern+1,"r"))==NULL) return -1;
+		while(fgets(line,sizeof(line),fp)!=NULL)
+		{
+			char* name=trim_value(line);
+			if(name[0]=='\0') continue;
+			if(count==max)
+			{
+				max*=2;
+				files=(BatchFile*)realloc(files,max*sizeof(BatchFile));
+			}
+			files[count++].name=strdup(name);
+		}
+		fclose(fp);
+	}
+	else
+	{
+#ifdef _WIN32
+		printf("The globs are not supported on this system, please give the files by @ with a file of names.\n");
+		return -1;
+#else
+		if(glob(pattern,0,NULL,&g)!=0) return -1;
+		files=(BatchFile*)realloc(files,(g.gl_pathc+1)*sizeof(BatchFile));
+		for(f=0;f<(long)g.gl_pathc;f++)
+		{
+			files[count++].name=strdup(g.gl_pathv[f]);
+		}
+		globfree(&g);
+#endif
+	}
+	if(count==0) return -1;
+	printf("There are %ld files in the batch.\n",count);
+	order=(BatchFile**)malloc(count*sizeof(BatchFile*));
+	for(f=0;f<count;f++)
+	{
+		files[f].size=(stat(files[f].name,&st)==0)?st.st_size:-1;
+		files[f].parts=1;
+		if(files[f].size>BATCH_SPLIT_SIZE)
+		{
+			files[f].parts=files[f].size/BATCH_SPLIT_SIZE+1;
+			if(files[f].parts>workers) files[f].parts=workers;
+		}
+	}
+	gettimeofday(&begin,NULL);
+	limitPart=MAX_PART;
+	start_pool(workers);
+	base=0;
+	to=load_round(files,order,0,count,base,&last);
+	for(from=0;from<count;from=to,to=next,last=next_last)
+	{
+		/*deal with the parts of this round, while the next round is loaded into the other half of the parts*/
+		if(last>=base) pool_job(base,last);
+		next=to;
+		next_last=BATCH_ROUND_PARTS-base-1;
+		if(to<count) next=load_round(files,order,to,count,BATCH_ROUND_PARTS-base,&next_last);
+		if(last>=base) pool_wait();
+		/*merge and print the results of each file in the order of the list*/
+		for(f=from;f<to;f++)
+		{
+			printf("The result for %s:\n",files[f].name);
+			if(files[f].first==-1)
+			{
+				printf("There are something wrong with the xml file, we can not load it.\n");
+				failed++;
+				continue;
+			}
+			firstPart=files[f].first;
+			if(lineMode==1) line_bases(files[f].first,files[f].last);
+			set=getresult(files[f].last);
+			print_result(set,files[f].last);
+			if(aggKind!=agg_none)
+			{
+				print_aggregate(set,files[f].last);
+			}
+			free_result(&set);
+			if(fragmentMode==1)
+			{
+				stitch_fragments(files[f].last);
+				if(print_fragments(files[f].name,files[f].last)==-1)
+				{
+					printf("There are something wrong with the xml file, we can not map it for the fragments.\n");
+				}
+			}
+			if(validateMode==1)
+			{
+				init_check(&checkSet);
+				for(i=files[f].first;i<=files[f].last;i++)
+				{
+					merge_check(&checkSet,i);
+				}
+				print_check(&checkSet);
+			}
+			free(buffFiles[files[f].first]);  //the parts of a file are spans of the content of its first part
+			for(i=files[f].first;i<=files[f].last;i++)
+			{
+				free(state_stack[i].output);
+				free(state_stack[i].frag);
+				free(state_stack[i].openfrag);
+			}
+		}
+		firstPart=0;
+		base=BATCH_ROUND_PARTS-base;
+	}
+	gettimeofday(&end,NULL);
+	printf("The duration for dealing with %ld files is %lf\n",count,(end.tv_sec-begin.tv_sec)+(end.tv_usec-begin.tv_usec)/1000000.0);
+	for(f=0;f<count;f++)
+	{
+		free(files[f].name);
+	}
+	free(files);
+	free(order);
+	return failed;
+}
+
+/*************************************************
+Function: long load_round(BatchFile* files, BatchFile** order, long from, long count, int base, int* end);
+Description: take the files of a round from the list and load them into the parts from base, the larger files first
+Called By: int batch_main(char* pattern, int workers);
+Input: files--the files of the list; order--the space to sort the files of the round; from--the first file of the round; count--the 
+number of files; base--the first part of the round
+Output: end--the last part of the round(base-1 if no file can be loaded)
+Return: the file after the round
+*************************************************/
+long load_round(BatchFile* files, BatchFile** order, long from, long count, int base, int* end)
 {
-	 int count=0;
-     char *temp;
-     temp = s;
-     while((*temp == ' ')&&temp){*temp++; count++;}
-     return count;
+	long to,bytes=0,f;
+	int parts=0;
+	for(to=from;to<count;to++)
+	{
+		if(to>from&&(parts+files[to].parts>BATCH_ROUND_PARTS||bytes+files[to].size>BATCH_ROUND_SIZE)) break;
+		parts+=files[to].parts;
+		bytes+=files[to].size;
+		order[to-from]=&files[to];
+	}
+	qsort(order,to-from,sizeof(BatchFile*),compare_batch_size);
+	parts=base;
+	for(f=0;f<to-from;f++)
+	{
+		BatchFile* bf=order[f];
+		if(bf->parts==1) bf->last=load_file(bf->name,parts);
+		else bf->last=split_file(bf->name,bf->parts,parts);
+		bf->first=(bf->last==-1)?-1:parts;
+		if(bf->last!=-1) parts=bf->last+1;
+	}
+	*end=parts-1;
+	return to;
 }
 
 /*************************************************
-Function: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Description: the function could be called by each thread, dealing with each line of the file. Besides, this function could identify the following elements, 
-which include XML head, Start Tag(e.g <xxx>), End Tag(e.g </xxx>), Tag(e.g <xxx/>), Content for the Tag, XML Explanation, Attribute Name for Tag, 
-Attribute Value for Tag, Content for CDATA element. Each element would be processed according to its type. 
-Called By: int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num);
-Input: pText-the content of the xml file; pToken-the type of the current xml element; multilineExp-whether the current line of the xml file is the multiline explanation; 
-multilineCDATA-- whether the current line of the xml file is the multiline CDATA; thread_num-the number of the thread; 
-Return: 0--success -1--error 1--multiline explantion 2--multiline CDATA
+Function: void free_automata(Automata* machine, int count);
+Description: free the names, predicates and attributes of the nodes of an automata
+Called By: int compile_query(char* xpath);
+Input: machine--the nodes of the automata; count--the number of nodes
 *************************************************/
-int xml_process(xml_Text *pText, xml_Token *pToken, int multilineExp, int multilineCDATA, int thread_num)  
+void free_automata(Automata* machine, int count)
 {
-    char *start = pToken->text.p + pToken->text.len;
-    char *p = start;
-    char *end = pText->p + pText->len;
-    int state = 0;
-    int templen = 0;
-    if(multilineExp == 1) state = 10;   //1--multiline explantion  0--single line explantion
-    if(multilineCDATA == 1) state = 17; //1--multiline CDATA 0--single CDATA
-    int j,a;
-    int flag=0; //whether the correct start state has been found 0--not found 1--found
+	int k,j;
+	for(k=0;k<count;k++)
+	{
+		free(machine[k].str);
+		if(machine[k].pred!=NULL)
+		{
+			for(j=0;j<machine[k].predCount;j++)
+			{
+				free(machine[k].pred[j].name);
+				free(machine[k].pred[j].value);
+			}
+			free(machine[k].pred);
+		}
+		if(machine[k].textPred!=NULL)
+		{
+			for(j=0;j<machine[k].textPredCount;j++)
+			{
+				free(machine[k].textPred[j].name);
+				free(machine[k].textPred[j].value);
+			}
+			free(machine[k].textPred);
+		}
+		free(machine[k].outputAttr);
+	}
+	memset(machine,0,count*sizeof(Automata));
+}
 
-    pToken->text.p = p;
-    pToken->type = xml_tt_U;
-    
-    for (; p < end; p++)
-    {
-    	//printf("p %s\n",p);
-        switch(state)
-        {
-            case 0:
-               switch(*p)
-               {
-                   case '<':
-                   	   
-                       state = 1;
-                       break;
-                   case ' ':
-                   	   state = 0;
-                   	   break;
-                   default:
-                       state = 7;
-                       break; 
-               }
-            break;
-            case 1:
-               switch(*p)
-               {
-                   case '?':
-                       state = 2;
-                       break;
-                   case '/':
-                       state = 4;
-                       break;
-                   case '!':
-                   	   state = 8;
-                   	   break;
-                   case ' ':
-                   	   state = -1;
-                   	   break;
-                   default:
-                       state = 5;
-                       break;
-               }
-            break;
-            case 2:
-               switch(*p)
-               {
-                   case '?':
-                       state = 3;
-                       break;
-                   default:
-                       state = 2;
-                       break;
-               }
-            break;
-            case 3:
-               switch(*p)
-               {
-               	   putchar(*p);
-                   case '>':                        /* Head <?xxx?>*/
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_H;
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       //printf("%s","content=");
-                       templen = pToken->text.len;
-                       //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       //xml_print(&pToken->text, 0 ,pToken->text.len);
-                       //printf(";\n\n");
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       state = 0;
-                       break;
-                   default:
-                       state = -1;
-                       break;
-               }
-               break;
-            case 4:
-                switch(*p)
-                {
-                   case '>':              /* End </xxx> */
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_E;
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       //printf("%s","content=");
-                       //xml_print(&pToken->text, 2 , pToken->text.len-1);
-                       //printf(";\n\n");
-                       
-                       char* subs=substring(pToken->text.p , 1 , pToken->text.len-1-left_null_count(pToken->text.p));
-					   if(subs!=NULL){
-					       for(j=machineCount;j>=1;j=j-2)
-                           {
-                               if(strcmp(subs,stateMachine[j].str)==0)
-                                  break;
-	                       }
-	                       if(j>=1){
-	                       	   int begin=stateMachine[j].start;
-	                       	   int end=stateMachine[j].end;
-	                       	   if(flag==0)
-	                       	   {
-                                   state_stack[thread_num].queue[state_stack[thread_num].rear_queue++]=begin;
-                                   state_stack[thread_num].stack[state_stack[thread_num].top_stack++]=begin;
-	                       	       flag=1;
-							   }
-							   pop(end,thread_num);
-                           }
-                           free(subs);
-                       }
-                       pToken->text.p = start + pToken->text.len;
-                       start = pToken->text.p;
-                       state = 0;
-                       break;
-                   case ' ':
-                   	   state = -1;
-                   	   break;
-                   default:
-                       state = 4;
-                       break;
-                }
-                break;
-            case 5:
-                switch(*p)
-                {
-                   case '>':               /* Begin <xxx> */
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_B;
-                       if(pToken->text.len-1 >= 1){
-                       	   //layer++;
-                       	   //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                           //printf("%s","content=");
-                           templen = pToken->text.len;
-                           //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                           
-                       	   //xml_print(&pToken->text , 1 , pToken->text.len-1);
-                       	   
-                           //printf(";\n\n");
-                           char* sub=substring(pToken->text.p , 1 , pToken->text.len-1-left_null_count(pToken->text.p));
-                           
-                           for(j=machineCount-1;j>=1;j=j-2)
-                           {
-                           	   if(strcmp(sub,stateMachine[j].str)==0)
-                           	   {
-                           	      break;
-							   }
-						   }
-                            if(sub!=NULL)  free(sub);
-						   if(j>=1)  
-						   {
-						   	    int begin=stateMachine[j].start;
-								int end=stateMachine[j].end;
-								
-						   	    if(flag==0)
-	                       	    {
-                                    state_stack[thread_num].queue[state_stack[thread_num].rear_queue++]=begin;
-                                    state_stack[thread_num].stack[state_stack[thread_num].top_stack++]=begin;
-	                       	        flag=1;
-							    }
-							    push(thread_num,end);								
-						   }
-					   }
-					   else templen = 1;
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       
-                       state = 0;
-                       break;
-                   case '/':
-                       state = 6;
-                       break;
-                   case ' ':                 /* Begin <xxx> */
-                   	   pToken->text.len = p - start + 1;
-                   	   templen = 0;
-                      // pToken->type = xml_tt_B;
-                       if(pToken->text.len-1 >= 1)
-                       {
-                       	   //layer++;
-                       	   //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       	   //printf("%s","content=");
-                       	   templen = pToken->text.len;
-                       	   //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       	   //xml_print(&pToken->text , 1 , pToken->text.len-1);
-                       	   //printf(";\n\n");
-                       	   char* sub=substring(pToken->text.p , 1 , pToken->text.len-1-left_null_count(pToken->text.p));  
-                       	   
-                           for(j=machineCount-1;j>=1;j=j-2)
-                           {
-                           	   if(strcmp(sub,stateMachine[j].str)==0)
-                           	   {
-                           	      break;
-							   }
-						   }
-						   if(sub) free(sub);
-						   if(j>=1)   
-						   {
-						   	    int begin=stateMachine[j].start;
-								int end=stateMachine[j].end;
-						   	    if(flag==0)
-	                       	    {
-                                    state_stack[thread_num].queue[state_stack[thread_num].rear_queue++]=begin;
-                                    state_stack[thread_num].stack[state_stack[thread_num].top_stack++]=begin;
-	                       	        flag=1;
-							    }
-							    push(thread_num,end);
-						   }
-					   }
-					    
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                   	   state = 13;
-                   	   break;
-                   default:
-                       state = 5;
-                   break;
-                }
-                break;
-            case 6:
-                switch(*p)
-                {
-                   case '>':   /* Begin End <xxx/> */
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_BE;
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer+1);
-                       //printf("%s","content=");
-                       templen = pToken->text.len;
-                       //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                       //xml_print(&pToken->text , 1 , pToken->text.len-2);
-                       //printf(";\n\n");
-                       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       state = 0;
-                       break;
-                   default:
-                       state = -1;
-                   break;
-                } 
-                break;
-            case 7:
-                switch(*p)
-                {
-                   case '<':     /* Text xxx */
-                       p--;
-                       pToken->text.len = p - start + 1;
-                       //pToken->type = xml_tt_T;
-                       
-                       //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                       //printf("%s","content=");
-                       
-                       templen = pToken->text.len;
-                       if(j>=1&&j<machineCount&&stateMachine[j].isoutput==1)
-					   {
-					        char* sub=substring(pToken->text.p , 0 , pToken->text.len-left_null_count(pToken->text.p));
-					        state_stack[thread_num].output[state_stack[thread_num].topput]=(char*)malloc((strlen(sub)+1)*sizeof(char));
-					        state_stack[thread_num].output[state_stack[thread_num].topput]=strcpy(state_stack[thread_num].output[state_stack[thread_num].topput],sub);
-					        state_stack[thread_num].topput++;
-					        if(sub!=NULL) free(sub);
-					        j=-1;
-					   }
-				       pToken->text.p = start + templen;
-                       start = pToken->text.p;
-                       state = 0;
-				       
-                       break;
-                   
-                   default:
-                       state = 7;
-                       break;
-                }
-                break;
-            case 8:
-            	switch(*p)
-            	{
-            		case '-':
-            			state = 9;
-            			break;
-            		case '[':
-            			if(*(p+1)=='C'&&*(p+2)=='D'&&*(p+3)=='A'&&*(p+4)=='T'&&*(p+5)=='A')
-            			{
-            				state = 16;
-            				p += 5;
-            				break;
-						}
-						else
-						{
-							state = -1;
-							break;
-						}
-            		default:
-            			state = -1;
-            			break;
-				}
-			    break;
-			case 9:
-				switch(*p)
-				{
-					case '-':
-						state = 10;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;
-			case 10:
-				switch(*p)
-				{
-					case '-':
-						state = 11;
-						break;
-					default:
-						state = 10;
-						break;
-				}
-			    break;
-			case 11:
-				switch(*p)
-				{
-					case '-':
-						state = 12;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;
-			case 12:
-				switch(*p)
-				{
-					case '>':                            /* Comment <!--xx-->*/
-					    pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_C;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        if(multilineExp == 1)
-                        {
-                        	strcat(multiExpContent[thread_num],pToken->text.p);
-                            //printf("%s",ltrim(multiExpContent[thread_num]));
-                            //printf("\n");
-                            memset(multiExpContent[thread_num], 0 , sizeof(multiExpContent[thread_num]));
-						}
-						/*else{
-							xml_print(&pToken->text , 0 , pToken->text.len);
-                            printf(";\n\n");
-						}*/
-						
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-                        state = 0;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;
-			case 13:
-				switch(*p)
-				{
-					case '>':
-						state = -1;
-						break;
-					case '=':                       /*attribute name*/
-					    pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_ATN;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        //xml_print(&pToken->text, 0 , pToken->text.len-1);
-                        //printf(";\n\n");
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-						state = 14;
-						break;
-					default:
-						state = 13;
-						break;
-				}
-			    break;
-			case 14:
-				switch(*p)
-				{
-					case '"':                                       
-                   	    state = 15;
-						break;
-					case ' ':
-						state = 14;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-			case 15:
-				switch(*p)
-				{
-					case '"':                        /*attribute value*/
-						pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_ATV;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        //xml_print(&pToken->text, 1 , pToken->text.len-1);
-                        //printf(";\n\n");
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-                        state = 5;
-						break;
-					default:
-						state = 15;
-						break;
-				}
-			    break;
-			case 16:
-				switch(*p)
-				{
-					case '[':                                       
-                   	    state = 17;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-			case 17:
-				switch(*p)
-				{
-					case ']':                                       
-                   	    state = 18;
-						break;
-					default:
-						state = 17;
-						break;
-				}
-			    break;	
-			case 18:
-				switch(*p)
-				{
-					case ']':                                       
-                   	    state = 19;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-			case 19:
-				switch(*p)
-				{
-					case '>':                                       
-                   	    pToken->text.len = p - start + 1;
-                        //pToken->type = xml_tt_CDATA;
-                        //printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-                        //printf("%s","content=");
-                        templen = pToken->text.len;
-                        //pToken->text.len -= strlen(pToken->text.p)-strlen(ltrim(pToken->text.p));
-                        if(multilineCDATA == 1)
-                        {
-                        	strcat(multiCDATAContent[thread_num],pToken->text.p);
-                        	/*for( j = 10;j < strlen(multiCDATAContent[thread_num]) - 3;j++)
-                        	{
-                        		if(multiCDATAContent[thread_num][j] == ']' && multiCDATAContent[thread_num][j+1] == ']') break;
-                        		putchar(multiCDATAContent[thread_num][j]);
-							}
-                            printf("\n");*/
-                            memset(multiCDATAContent[thread_num], 0 , sizeof(multiCDATAContent[thread_num]));
-						}
-						/*else{
-							xml_print(&pToken->text , 9 , pToken->text.len-3);
-                            printf(";\n\n");
-						}*/
-						
-                        pToken->text.p = start + templen;
-                        start = pToken->text.p;
-                        state = 0;
-						break;
-					default:
-						state = -1;
-						break;
-				}
-			    break;	
-				
-            default:  
-                state = -1;
-                break;
-        }
-    }
-    if(state==-1) {return -1;}
-    /*else if(state == 10)
+/*************************************************
+Function: int compile_query(char* xpath);
+Description: get the automata of XPath from the cache, or create it and keep it in the cache instead of the least recently used one. 
+stateMachine is the automata kept by the cache, and aggKind is copied.
+Called By: void serve_query(char* file_name, char* xpath);
+Input: xpath--XPath Query command(with the aggregation)
+Return: 0--success; -1--XPath is not correct
+*************************************************/
+int compile_query(char* xpath)
+{
+	int k,lru=0;
+	char* text;
+	char* path;
+	CachedQuery* q;
+	for(k=0;k<SERVER_QUERIES;k++)
 	{
-		strcat(multiExpContent[thread_num],ltrim(pToken->text.p));
-		return 1;
-	} 
-	else if(state == 17)
+		if(queryCache[k].xpath!=NULL&&strcmp(queryCache[k].xpath,xpath)==0) break;
+		if(queryCache[lru].xpath!=NULL&&(queryCache[k].xpath==NULL||queryCache[k].used<queryCache[lru].used)) lru=k;
+	}
+	if(k<SERVER_QUERIES)
 	{
-		strcat(multiCDATAContent[thread_num],ltrim(pToken->text.p));
-		return 2;
-	}*/
-	else if(state == 7)
+		q=&queryCache[k];
+		stateMachine=q->machine;  //the nodes of the cached automata are kept by the cache
+		maxMachine=q->maxMachine;
+		machineCount=q->machineCount;
+		stateCount=q->stateCount;
+		useAttributes=q->useAttributes;
+		aggKind=q->aggKind;
+		q->used=serverClock;
+		return 0;
+	}
+	stateMachine=NULL;  //a new automata, the automata of the last query is kept by the cache
+	maxMachine=0;
+	machineCount=1;
+	stateCount=0;
+	useAttributes=0;
+	text=strdup(xpath);
+	path=parse_aggregate(text);
+	if(path==NULL||createAutoMachine(path)==-1)
 	{
-		p--;
-        pToken->text.len = p - start + 1;
-        if(pToken->text.len>1)
-        {
-        	//printf("type=%s;  depth=%d;  ", convertTokenTypeToStr(pToken->type) , layer);
-            //printf("%s","content=");
-            //xml_print(&pToken->text, 0 , pToken->text.len);
-            //printf(";\n\n");
-            if(j>=1&&j<machineCount&&stateMachine[j].isoutput==1)
+		free(text);
+		free_automata(stateMachine,maxMachine);
+		free(stateMachine);
+		stateMachine=NULL;
+		maxMachine=0;
+		return -1;
+	}
+	free(text);
+	q=&queryCache[lru];
+	if(q->xpath!=NULL)
+	{
+		free_automata(q->machine,q->maxMachine);
+		free(q->machine);
+		free(q->xpath);
+	}
+	q->machine=stateMachine;
+	q->maxMachine=maxMachine;
+	q->machineCount=machineCount;
+	q->stateCount=stateCount;
+	q->useAttributes=useAttributes;
+	q->aggKind=aggKind;
+	q->xpath=strdup(xpath);
+	q->used=serverClock;
+	return 0;
+}
+
+/*the query server is built on the UNIX sockets and the mapped files, so it is not built on Windows*/
+#ifndef _WIN32
+/*************************************************
+Function: CachedFile* lookup_file(char* file_name, int parts);
+Description: get the file from the cache, or load it instead of the least recently used one. The file is mapped into memory(a 
+compressed file is decompressed, a file in another encoding is transcoded and UTF-8 is validated if encoding-mode is 1), and it 
+is loaded again once its size or modified time is changed. The beginnings of its parts are kept as the structural index, found 
+again only when the number of parts is changed.
+Called By: void serve_query(char* file_name, char* xpath);
+Input: file_name--the name for the xml file; parts--the number of parts
+Return: the entry of the file; NULL--can't load the file
+*************************************************/
+CachedFile* lookup_file(char* file_name, int parts)
+{
+	struct stat st;
+	int k,lru=0,fd;
+	CachedFile* f;
+	if(stat(file_name,&st)!=0) return NULL;
+	for(k=0;k<SERVER_FILES;k++)
+	{
+		if(fileCache[k].name!=NULL&&strcmp(fileCache[k].name,file_name)==0) break;
+		if(fileCache[lru].name!=NULL&&(fileCache[k].name==NULL||fileCache[k].used<fileCache[lru].used)) lru=k;
+	}
+	f=(k<SERVER_FILES)?&fileCache[k]:&fileCache[lru];
+	if(f->name==NULL||k==SERVER_FILES||f->dev!=st.st_dev||f->ino!=st.st_ino||f->size!=st.st_size||f->mtime!=st.st_mtime)
+	{
+		if(f->name!=NULL)
+		{
+			if(f->mapped==1) munmap(f->content,f->length);
+			else free(f->content);
+			free(f->point);
+			free(f->name);
+			f->name=NULL;
+		}
+		if(must_load(file_name))
+		{
+			f->content=load_content(file_name,&f->length);
+			f->mapped=0;
+		}
+		else
+		{
+			f->content=NULL;
+			fd=open(file_name,O_RDONLY);
+			if(fd!=-1&&st.st_size>0)
+			{
+				f->content=(char*)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+				if(f->content==MAP_FAILED) f->content=NULL;
+			}
+			if(fd!=-1) close(fd);
+			f->length=st.st_size;
+			f->mapped=1;
+			if(f->content!=NULL&&encodingMode==1&&validate_utf8(f->content,f->length)!=-1)
+			{
+				munmap(f->content,f->length);  //the file is not valid UTF-8
+				f->content=NULL;
+			}
+		}
+		if(f->content==NULL) return NULL;
+		f->name=strdup(file_name);
+		f->dev=st.st_dev;
+		f->ino=st.st_ino;
+		f->size=st.st_size;
+		f->mtime=st.st_mtime;
+		f->parts=0;
+		f->point=NULL;
+	}
+	if(f->parts!=parts)
+	{
+		free(f->point);
+		f->point=cut_points(f->content,f->length,parts,&f->count);
+		f->parts=parts;
+	}
+	f->used=serverClock;
+	return f;
+}
+#endif
+
+/*************************************************
+Function: void *pool_thread(void *arg);
+Description: main function for each thread of the pool. The thread waits for the next job(a query of the server, or a round of the 
+batch mode), then takes the parts of the job like void *main_thread(void *arg) until all the parts are done.
+Called By: void start_pool(int workers);
+Input: arg--the number of this thread; 
+*************************************************/
+void *pool_thread(void *arg)
+{
+	int job=0,i;
+	while(1)
+	{
+		pthread_mutex_lock(&part_lock);
+		while(poolJob==job)
+		{
+			pthread_cond_wait(&job_ready,&part_lock);
+		}
+		job=poolJob;
+		pthread_mutex_unlock(&part_lock);
+		while(1)
+		{
+			pthread_mutex_lock(&part_lock);
+			i=nextPart++;
+			pthread_mutex_unlock(&part_lock);
+			if(i>=partCount||i>=limitPart) break;
+			deal_part(i);
+			if(outputLimit>0)
+			{
+				pthread_mutex_lock(&part_lock);
+				publish_part(i);
+				pthread_mutex_unlock(&part_lock);
+			}
+		}
+		pthread_mutex_lock(&part_lock);
+		poolBusy--;
+		if(poolBusy==0) pthread_cond_signal(&job_done);
+		pthread_mutex_unlock(&part_lock);
+	}
+	return NULL;
+}
+
+/*************************************************
+Function: void start_pool(int workers);
+Description: start the threads of the pool, they wait for the jobs until the program exits
+Called By: int server_main(char* socket_name, int workers); int batch_main(char* pattern, int workers);
+Input: workers--the number of threads
+*************************************************/
+void start_pool(int workers)
+{
+	int i,rc;
+	poolSize=workers;
+	for(i=0;i<workers;i++)
+	{
+		thread_args[i]=i;
+		rc=pthread_create(&thread[i], NULL, pool_thread, &thread_args[i]);
+		if (rc)
+		{
+			printf("ERROR; return code is %d\n", rc);
+			exit(1);
+		}
+	}
+}
+
+/*************************************************
+Function: void pool_job(int first, int last);
+Description: give the parts of a job to the pool, the threads take them from the first one
+Called By: void serve_query(char* file_name, char* xpath); int batch_main(char* pattern, int workers);
+Input: first, last--the parts of the job
+*************************************************/
+void pool_job(int first, int last)
+{
+	pthread_mutex_lock(&part_lock);
+	partCount=last+1;
+	nextPart=first;
+	poolBusy=poolSize;
+	poolJob++;
+	pthread_cond_broadcast(&job_ready);
+	pthread_mutex_unlock(&part_lock);
+}
+
+/*************************************************
+Function: void pool_wait(void);
+Description: wait until all the threads of the pool have finished the job
+Called By: void serve_query(char* file_name, char* xpath); int batch_main(char* pattern, int workers);
+*************************************************/
+void pool_wait(void)
+{
+	pthread_mutex_lock(&part_lock);
+	while(poolBusy>0)
+	{
+		pthread_cond_wait(&job_done,&part_lock);
+	}
+	pthread_mutex_unlock(&part_lock);
+}
+
+#ifndef _WIN32
+/*************************************************
+Function: void serve_query(char* file_name, char* xpath);
+Description: deal with one query by the pool with the cached automata and file, then merge and print the results into resultFile. 
+The parts are spans of the cached file, so nothing is copied.
+Called By: int server_main(char* socket_name, int workers);
+Input: file_name--the name for the xml file; xpath--XPath Query command
+*************************************************/
+void serve_query(char* file_name, char* xpath)
+{
+	CachedFile* f;
+	ResultSet set;
+	int i,n,last;
+	serverClock++;
+	if(compile_query(xpath)==-1)
+	{
+		fprintf(resultFile,"The XPath %s is not correct, please check it again.\n",xpath);
+		return;
+	}
+	outputLimit=serverLimit;
+	fragmentMode=serverFragment;
+	if(aggKind!=agg_none)
+	{
+		outputLimit=0;
+		fragmentMode=0;
+	}
+	if(stateMachine[machineCount-1].outputAttr!=NULL||stateMachine[machineCount-1].textPredCount>0) fragmentMode=0;
+	if(fragmentMode==1) outputLimit=0;
+	f=lookup_file(file_name,(outputLimit>0)?serverWorkers*LIMIT_PARTS:serverWorkers);
+	if(f==NULL)
+	{
+		fprintf(resultFile,"There are something wrong with the xml file %s, we can not load it.\n",file_name);
+		return;
+	}
+	n=f->count-1;
+	for(i=0;i<=n;i++)
+	{
+		buffFiles[i]=f->content+f->point[i];
+		part_offset[i]=f->point[i];
+		part_bytes[i]=f->point[i+1]-f->point[i];
+		part_tags[i]=0;
+		part_done[i]=0;
+	}
+	firstPart=0;
+	limitPart=MAX_PART;
+	confirmedPart=0;
+	confirmedCount=0;
+	pool_job(0,n);
+	pool_wait();
+	last=(limitPart<partCount)?limitPart-1:n;
+	if(lineMode==1) line_bases(0,last);
+	set=getresult(last);
+	print_result(set,last);
+	if(aggKind!=agg_none)
+	{
+		print_aggregate(set,n);
+	}
+	free_result(&set);
+	if(fragmentMode==1)
+	{
+		stitch_fragments(n);
+		write_fragments(f->content,f->length,n);
+	}
+	for(i=0;i<=n;i++)
+	{
+		free(state_stack[i].output);  //the parts skipped for the limit keep NULL
+		free(state_stack[i].frag);
+		free(state_stack[i].openfrag);
+		state_stack[i].output=NULL;
+		state_stack[i].frag=NULL;
+		state_stack[i].openfrag=NULL;
+	}
+}
+
+/*************************************************
+Function: int read_frame(int fd, char** data, unsigned int* len, unsigned int max);
+Description: read a frame of the protocol: 4 bytes of length in network order, then the bytes. It waits for the whole frame, so the 
+server receives its requests by receive_frame() instead.
+Called By: int query_server(char* socket_name, char* file_name, char* xpath);
+Input: fd--the socket; max--the largest length allowed
+Output: data--the bytes ended with '\0'(free it after use); len--the length of the bytes
+Return: 0--success; -1--the socket is closed or the frame is too large
+*************************************************/
+int read_frame(int fd, char** data, unsigned int* len, unsigned int max)
+{
+	unsigned int head;
+	long done=0,k;
+	char* p=(char*)&head;
+	while(done<4)
+	{
+		k=read(fd,p+done,4-done);
+		if(k<0&&errno==EINTR) continue;
+		if(k<=0) return -1;
+		done+=k;
+	}
+	*len=ntohl(head);
+	if(*len>max) return -1;
+	*data=(char*)malloc(*len+1);
+	for(done=0;done<*len;done+=k)
+	{
+		k=read(fd,*data+done,*len-done);
+		if(k<0&&errno==EINTR) { k=0; continue; }
+		if(k<=0)
+		{
+			free(*data);
+			return -1;
+		}
+	}
+	(*data)[*len]='\0';
+	return 0;
+}
+
+/*************************************************
+Function: int write_frame(int fd, char* data, unsigned int len);
+Description: write a frame of the protocol: 4 bytes of length in network order, then the bytes
+Called By: int serve_client(Connection* c); int query_server(char* socket_name, char* file_name, char* xpath);
+Input: fd--the socket; data--the bytes; len--the length of the bytes
+Return: 0--success; -1--the socket is closed
+*************************************************/
+int write_frame(int fd, char* data, unsigned int len)
+{
+	unsigned int head=htonl(len);
+	long done,k;
+	for(done=0;done<4;done+=k)
+	{
+		k=write(fd,(char*)&head+done,4-done);
+		if(k<0&&errno==EINTR) { k=0; continue; }
+		if(k<=0) return -1;
+	}
+	for(done=0;done<len;done+=k)
+	{
+		k=write(fd,data+done,len-done);
+		if(k<0&&errno==EINTR) { k=0; continue; }
+		if(k<=0) return -1;
+	}
+	return 0;
+}
+
+/*************************************************
+Function: int receive_frame(Connection* c, unsigned int max);
+Description: receive the bytes of a frame which are ready on a connection, without waiting for the rest of the frame. The bytes 
+are kept in the connection until the frame is complete, so a client which sends a part of a frame only keeps its own connection.
+Called By: int serve_client(Connection* c);
+Input: c--the connection; max--the largest length allowed
+Output: c--the bytes received are added
+Return: 1--the frame is complete in c->data(ended with '\0'); 0--more bytes are needed; -1--the socket is closed or the frame is too large
+*************************************************/
+int receive_frame(Connection* c, unsigned int max)
+{
+	long k;
+	if(c->got<4) k=recv(c->fd,(char*)&c->head+c->got,4-c->got,MSG_DONTWAIT);
+	else k=recv(c->fd,c->data+(c->got-4),c->len-(c->got-4),MSG_DONTWAIT);
+	if(k<0&&(errno==EINTR||errno==EAGAIN||errno==EWOULDBLOCK)) return 0;
+	if(k<=0) return -1;
+	c->got+=k;
+	if(c->got==4&&c->data==NULL)
+	{
+		c->len=ntohl(c->head);
+		if(c->len>max) return -1;
+		c->data=(char*)malloc(c->len+1);
+	}
+	if(c->got<4||c->got-4<c->len) return 0;
+	c->data[c->len]='\0';
+	return 1;
+}
+
+/*************************************************
+Function: int serve_client(Connection* c);
+Description: receive the bytes of a query which are ready on a connection. Once the query is complete, deal with it by the pool and 
+send the reply into the same connection. A client which does not read its reply within CLIENT_TIMEOUT seconds is dropped.
+Called By: int server_main(char* socket_name, int workers);
+Input: c--the connection
+Return: 0--success, or the query is not complete yet; -1--the connection is closed(or broken)
+*************************************************/
+int serve_client(Connection* c)
+{
+	struct timeval begin,end;
+	int rc;
+	char *request,*line,*next,*file_name,*xpath;
+	char* reply;
+	size_t reply_len;
+	rc=receive_frame(c,MAX_REQUEST);
+	if(rc!=1) return rc;
+	request=c->data;  //the next frame is received from the beginning
+	c->data=NULL;
+	c->got=0;
+	gettimeofday(&begin,NULL);
+	file_name=NULL;
+	xpath=NULL;
+	for(line=request;line!=NULL;line=next)
+	{
+		next=strchr(line,'\n');
+		if(next!=NULL) *next++='\0';
+		if(strncmp(line,"File_Name=",10)==0) file_name=trim_value(line+10);
+		else if(strncmp(line,"XPath=",6)==0) xpath=trim_value(line+6);
+	}
+	resultFile=open_memstream(&reply,&reply_len);
+	if(file_name==NULL||xpath==NULL) fprintf(resultFile,"The query must have the File_Name and the XPath, please check it again.\n");
+	else serve_query(file_name,xpath);
+	fclose(resultFile);
+	resultFile=stdout;
+	gettimeofday(&end,NULL);
+	printf("The query %s on %s is done in %lf seconds.\n",xpath==NULL?"":xpath,file_name==NULL?"":file_name,
+		(end.tv_sec-begin.tv_sec)+(end.tv_usec-begin.tv_usec)/1000000.0);
+	fflush(stdout);
+	rc=write_frame(c->fd,reply,reply_len);
+	free(reply);
+	free(request);
+	return rc;
+}
+
+/*************************************************
+Function: int server_main(char* socket_name, int workers);
+Description: serve the queries over a UNIX socket until the server is killed. The threads of the pool are started once and wait for 
+each query, and the files and the automata are kept in the caches, so a query on a file in the cache costs only its own work. 
+The listening socket and the connections are polled together, and the bytes ready on each connection are received in a round, a 
+query is served once it is complete, so an idle client or a client which sends a part of a query keeps its connection without 
+blocking the others. The queries are dealt with one by one, each by all the threads, 
+and a client could send several queries on one connection.
+Called By: int main(void);
+Input: socket_name--the path of the UNIX socket; workers--the number of threads
+Return: -1--can't listen on the socket
+*************************************************/
+int server_main(char* socket_name, int workers)
+{
+	struct sockaddr_un addr;
+	struct pollfd fds[MAX_CLIENTS+1];
+	Connection conns[MAX_CLIENTS+1];  //conns[k] is the connection polled by fds[k]
+	struct timeval timeout={CLIENT_TIMEOUT,0};
+	int fd,client,k,count=1;
+	signal(SIGPIPE,SIG_IGN);  //a client which is gone must not stop the server
+	if(strlen(socket_name)>=sizeof(addr.sun_path)) return -1;
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strcpy(addr.sun_path,socket_name);
+	unlink(socket_name);
+	fd=socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd==-1||bind(fd,(struct sockaddr*)&addr,sizeof(addr))==-1||listen(fd,16)==-1) return -1;
+	serverWorkers=workers;
+	start_pool(workers);
+	printf("The query server is listening on %s with %d threads.\n",socket_name,workers);
+	fflush(stdout);
+	fds[0].fd=fd;
+	fds[0].events=POLLIN;
+	while(1)
+	{
+		fds[0].events=(count<=MAX_CLIENTS)?POLLIN:0;  //a new connection waits in the backlog while all the slots are taken
+		if(poll(fds,count,-1)==-1) continue;
+		for(k=1;k<count;k++)
+		{
+			if(fds[k].revents==0) continue;
+			if((fds[k].revents&POLLIN)==0||serve_client(&conns[k])==-1)
+			{
+				close(fds[k].fd);
+				free(conns[k].data);
+				count--;
+				conns[k]=conns[count];
+				fds[k--]=fds[count];  //the last connection takes the slot, and it is checked in this round too
+			}
+		}
+		if(fds[0].revents&POLLIN)
+		{
+			client=accept(fd,NULL,NULL);
+			if(client!=-1)
 			{
-				char* sub=substring(pToken->text.p , 0 , pToken->text.len-left_null_count(pToken->text.p));
-				state_stack[thread_num].output[state_stack[thread_num].topput]=(char*)malloc((strlen(sub)+1)*sizeof(char));
-			    state_stack[thread_num].output[state_stack[thread_num].topput]=strcpy(state_stack[thread_num].output[state_stack[thread_num].topput],sub);
-				state_stack[thread_num].topput++;
-				if(sub!=NULL) free(sub);
+				setsockopt(client,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));  //a client which does not read its reply is dropped
+				memset(&conns[count],0,sizeof(Connection));
+				conns[count].fd=client;
+				fds[count].fd=client;
+				fds[count].events=POLLIN;
+				fds[count++].revents=0;
 			}
-        }
-		return 0;
+		}
 	}
-    else return 0;
+	return 0;
 }
 
 /*************************************************
-Function: ResultSet getresult(int n) ;
-Description: get all the mappings for the state_stack of the related thread, then merged them into one final mapping. 
+Function: int query_server(char* socket_name, char* file_name, char* xpath);
+Description: send the query to the server and print the reply. The file name is sent as an absolute path, since the server may 
+run in another directory.
 Called By: int main(void);
-Input: n-total number for all the threads; 
-Return: the final mapping set
+Input: socket_name--the path of the UNIX socket; file_name--the name for the xml file; xpath--XPath Query command
+Return: 0--success; -1--can't connect to the server or the reply is broken
 *************************************************/
-ResultSet getresult(int n) 
+int query_server(char* socket_name, char* file_name, char* xpath)
 {
-	ResultSet final_set,set;
-	int i,j,k;
-	final_set.topbegin=0;
-	final_set.topend=0;
-    final_set.begin=0;final_set.end=0;
-    int start=1;
-    set.begin=start;
-    for(i=0;i<=n;i++)
-    {
-    	set.begin=start;set.end=0;
-    	set.topbegin=0;set.topend=0;
-		j=0;
-		//deal with the start queue
-		if(state_stack[i].top_stack==0)
-		{
-			final_set.begin=-1;
-		    break;
-	    }
-	    for(j=1;j<state_stack[i].rear_queue;j++)
-	    {
-	    	set.begin_stack[set.topbegin++]=state_stack[i].queue[j];
-		}
-		//deal with the final stack
-		if(state_stack[i].top_stack==1)
-		    set.end_stack[set.topend++]=state_stack[i].stack[0];
-		for(j=1;j<state_stack[i].top_stack;j++)
-		{
-			set.end_stack[set.topend++]=state_stack[i].stack[j-1];
-		}
-		set.end=set.end_stack[set.topend-1];
-		set.topend--;
-		//merge finalset&set
-	    if(i>0&&final_set.end!=set.begin)
-	    {
-		    final_set.begin=-1;
-		    break;
-	    }
-	    else{
-	        final_set.end=set.end;
-	        if(i==0)
-	        {
-		        final_set.begin=set.begin;
-		        for(k=0;k<set.topbegin;k++)
-		        {
-			        final_set.begin_stack[final_set.topbegin++]=set.begin_stack[k];
-		        }
-		        for(k=0;k<set.topend;k++)
-		        {
-			        final_set.end_stack[final_set.topend++]=set.end_stack[k];
-		        }
-            }
-            else{
-	            int equal_flag=0;
-	            if(final_set.topend==set.topbegin)
-	            {
-		            for(k=0;k<set.topbegin;k++)
-		            {
-			            if(final_set.end_stack[set.topbegin-k-1]!=set.begin_stack[k])
-			            {
-				            equal_flag=1;
-				            break;
-			            }
-		            }
-	            }
-                if(equal_flag==0)
-                {
-                	final_set.topend=set.topend;         //end_stack is equal to the current set
-	            	for(k=0;k<set.topend;k++)
-    	            {
-    		            final_set.end_stack[k]=set.end_stack[k];  
-		            }
-	            }
-	            else
-	            {
-	            	for(k=0;k<set.topend;k++)
-    	            {
-    		            final_set.end_stack[final_set.topend++]=set.end_stack[k];  //merge
-		            }
-				}
-            }
-
-            start=final_set.end;
-    	}
+	struct sockaddr_un addr;
+	struct timeval begin,end;
+	int fd;
+	unsigned int len;
+	char* path=realpath(file_name,NULL);
+	char* request;
+	char* reply;
+	if(strlen(socket_name)>=sizeof(addr.sun_path)) return -1;
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strcpy(addr.sun_path,socket_name);
+	gettimeofday(&begin,NULL);
+	fd=socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd==-1||connect(fd,(struct sockaddr*)&addr,sizeof(addr))==-1)
+	{
+		if(fd!=-1) close(fd);
+		free(path);
+		return -1;
 	}
-	return final_set;
+	request=(char*)malloc(strlen(path==NULL?file_name:path)+strlen(xpath)+32);
+	sprintf(request,"File_Name=%s\nXPath=%s\n",path==NULL?file_name:path,xpath);
+	free(path);
+	if(write_frame(fd,request,strlen(request))==-1||read_frame(fd,&reply,&len,0xffffffff)==-1)
+	{
+		free(request);
+		close(fd);
+		return -1;
+	}
+	gettimeofday(&end,NULL);
+	fwrite(reply,1,len,stdout);
+	printf("The duration for the query is %lf\n",(end.tv_sec-begin.tv_sec)+(end.tv_usec-begin.tv_usec)/1000000.0);
+	free(reply);
+	free(request);
+	close(fd);
+	return 0;
 }
+#endif
+
+/*the workers of the sharded execution are forked and map the file, so only the summaries are merged on Windows*/
+#ifndef _WIN32
 /*************************************************
-Function: void print_result(ResultSet set, int n);
-Description: print the result mapping set. 
-Called By: int main(void);
-Input: set-result mapping set;n--the number of threads 
+Function: int shard_worker(char* file_name, long begin, long end, FILE* out, int workers, int parts);
+Description: the worker of the sharded execution. The byte range starts and ends at the first open angle bracket after each end(0 is 
+kept), so the ranges of the workers do not overlap and no byte is lost. The range is cut into parts dealt with by the threads, then 
+the summary of the parts is written for the coordinator.
+Called By: int main(void); int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: file_name--the name for the xml file; begin, end--the byte range(end 0--the end of the file); out--the file or pipe for the 
+summary; workers--the number of threads; parts--the number of parts
+Return: 0--success; -1--can't load the file or write the summary
 *************************************************/
-void print_result(ResultSet set,int n)
+int shard_worker(char* file_name, long begin, long end, FILE* out, int workers, int parts)
 {
-	if(set.begin==-1)
+	long size;
+	long* point;
+	char* content=NULL;
+	int fd=-1,i,k,count=0,rc;
+	long bad;
+	struct stat st;
+	outputLimit=0;  //a worker does not know the outputs before its range, the limit is for the coordinator
+	if(must_load(file_name))
 	{
-		printf("The mapping for this part is null, please check the XPath command.\n");
-		return;
+		content=load_content(file_name,&size);  //the range is in the decompressed(or transcoded) content
+		if(content==NULL) return -1;
 	}
-	int i;
-	printf("The mapping for this part is: %d,  ",set.begin);
-	for(i=0;i<set.topbegin;i++)  
+	else
 	{
-		printf("%d:",set.begin_stack[i]);
+		fd=open(file_name,O_RDONLY);
+		if(fd==-1||fstat(fd,&st)==-1)
+		{
+			if(fd!=-1) close(fd);
+			return -1;
+		}
+		size=st.st_size;
+		if(size>0) content=(char*)mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if(content==MAP_FAILED) return -1;
 	}
-    printf(",  ");
-	printf("%d,  ",set.end);
-	for(i=set.topend-1;i>=0;i--)
+	if(end<=0||end>size) end=size;
+	if(begin<0) begin=0;
+	if(begin>0)
 	{
-		printf("%d:",set.end_stack[i]);
+		while(begin<size&&content[begin]!='<') begin++;
 	}
-	printf(",  ");
-	int j;
-	for(i=0;i<=n;i++)
+	while(end<size&&content[end]!='<') end++;
+	if(fd!=-1&&encodingMode==1&&begin<end&&(bad=validate_utf8(content+begin,end-begin))!=-1)
 	{
-		for(j=0;j<state_stack[i].topput;j++)
+		printf("The XML %s is not valid UTF-8 at %ld.\n",file_name,begin+bad);
+		munmap(content,size);
+		return -1;
+	}
+	if(begin<end)
+	{
+		point=cut_points(content+begin,end-begin,parts,&count);
+		for(i=0;i<count;i++)
+		{
+			buffFiles[i]=content+begin+point[i];  //the parts are spans of the mapped file
+			part_offset[i]=begin+point[i];
+			part_bytes[i]=point[i+1]-point[i];
+			part_tags[i]=0;
+		}
+		free(point);
+		partCount=count;
+		nextPart=0;
+		k=(workers>count)?count:workers;
+		for(i=0;i<k;i++)
 		{
-			printf("%s ",state_stack[i].output[j]);
+			thread_args[i]=i;
+			finish_args[i]=0;
+			rc=pthread_create(&thread[i], NULL, main_thread, &thread_args[i]);
+			if (rc)
+			{
+				printf("ERROR; return code is %d\n", rc);
+				exit(1);
+			}
 		}
+		thread_wait(k-1);
 	}
-	printf("\n");
+	rc=write_summary(out,begin,end,count);
+	if(fd==-1) free(content);
+	else if(size>0) munmap(content,size);
+	return rc;
 }
+#endif
 
 /*************************************************
-Function: void *main_thread(void *arg);
-Description: main function for each thread. 
-Called By: int main(void);
-Input: arg--the number of this thread; 
+Function: int write_summary(FILE* out, long begin, long end, int count);
+Description: write the summary of the parts of a worker: SHARD_MAGIC, the range and the number of parts, then for each part its state 
+stack and queue(the mapping), the partial aggregation, its offset, the outputs and the fragments. The summary is in the binary format 
+of this build, so the coordinator must be the same program.
+Called By: int shard_worker(char* file_name, long begin, long end, FILE* out, int workers, int parts);
+Input: out--the file or pipe for the summary; begin, end--the range of the worker; count--the number of parts
+Return: 0--success; -1--can't write the summary
 *************************************************/
-void *main_thread(void *arg)
+int write_summary(FILE* out, long begin, long end, int count)
 {
-	int i=(int)(*((int*)arg));
-	printf("start to deal with thread %d.\n",i);
-	int ret = 0;
-    xml_Text xml;
-    xml_Token token;               
-    int multiExp = 0; //0--single line explanation 1-- multiline explanation
-    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
-    
-    int j;
-    state_stack[i].hasOutput=0;
-    state_stack[i].top_stack=0;
-    state_stack[i].rear_queue=0;
-    state_stack[i].topput=0;
-    state_stack[i].output=(char**)malloc(MAX_OUTPUT*sizeof(char*));
-	printf("State stack has been initialized for thread %d.\n",i);
-    xml_initText(&xml,buffFiles[i]);
-    xml_initToken(&token, &xml);
-    ret = xml_process(&xml, &token, multiExp, multiCDATA, i);
-    free(buffFiles[i]);
-    if(ret==-1)
-    {
-    	printf("There is something wrong with your XML format, please check it!\n");
-    	printf("finish dealing with thread %d.\n",i);
-    	return NULL;
+	int i,j;
+	status* s;
+	fwrite(SHARD_MAGIC,1,8,out);
+	fwrite(&begin,sizeof(long),1,out);
+	fwrite(&end,sizeof(long),1,out);
+	fwrite(&count,sizeof(int),1,out);
+	for(i=0;i<count;i++)
+	{
+		s=&state_stack[i];
+		fwrite(&s->top_stack,sizeof(int),1,out);
+		fwrite(s->stack,sizeof(int),s->top_stack,out);
+		fwrite(&s->rear_queue,sizeof(int),1,out);
+		fwrite(s->queue,sizeof(int),s->rear_queue,out);
+		fwrite(&part_agg[i],sizeof(Aggregate),1,out);
+		fwrite(&part_offset[i],sizeof(long),1,out);
+		fwrite(&s->topput,sizeof(int),1,out);
+		for(j=0;j<s->topput;j++)
+		{
+			fwrite(&s->output[j].len,sizeof(int),1,out);
+			fwrite(s->output[j].p,1,s->output[j].len,out);
+		}
+		fwrite(&s->topfrag,sizeof(int),1,out);
+		fwrite(s->frag,sizeof(Fragment),s->topfrag,out);
+		fwrite(&validateMode,sizeof(int),1,out);
+		if(validateMode==1)
+		{
+			TagCheck* c=&part_check[i];
+			fwrite(&c->error,sizeof(long),1,out);
+			fwrite(c->reason,1,sizeof(c->reason),out);
+			fwrite(&c->unfinished,sizeof(long),1,out);
+			write_names(out,c->close,c->topclose);
+			write_names(out,c->open,c->topopen);
+		}
 	}
-    finish_args[i]=1;
-    printf("finish dealing with thread %d.\n",i);
-	return NULL;
+	if(fflush(out)!=0||ferror(out)) return -1;
+	return 0;
 }
 
 /*************************************************
-Function: void thread_wait(int n);
-Description: waiting for all the threads finish their tasks. 
-Called By: int main(void);
-Input: n--the number of all threads; 
+Function: int read_summary_head(FILE* in, long* begin, long* end, int* count);
+Description: read the beginning of the summary of a worker
+Called By: int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: in--the file or pipe of the summary
+Output: begin, end--the range of the worker; count--the number of parts
+Return: 0--success; -1--it is not a summary
 *************************************************/
-void thread_wait(int n)
+int read_summary_head(FILE* in, long* begin, long* end, int* count)
 {
-	int t;
-	while(1){
-		for( t = 0; t <= n; t++)
-	    {
-	    	if(finish_args[t]==0)
-	    	{
-	    		break;
+	char magic[8];
+	if(fread(magic,1,8,in)!=8||memcmp(magic,SHARD_MAGIC,8)!=0||fread(begin,sizeof(long),1,in)!=1
+		||fread(end,sizeof(long),1,in)!=1||fread(count,sizeof(int),1,in)!=1||*count<0) return -1;
+	return 0;
+}
+
+/*************************************************
+Function: int read_summary_parts(FILE* in, int first, int count);
+Description: read the parts of the summary of a worker into the state stacks from first. The outputs of a part are kept in 
+buffFiles of the part, and the outputs are spans of it as before.
+Called By: int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Input: in--the file or pipe of the summary; first--the number of the first part; count--the number of parts
+Return: 0--success; -1--the summary is broken
+*************************************************/
+int read_summary_parts(FILE* in, int first, int count)
+{
+	int i,j,k,len,depth;
+	long size,max;
+	long* offset;
+	status* s;
+	TagCheck* c;
+	int checked; //1--the worker has checked the tags of the part
+	for(i=first;i<first+count;i++)
+	{
+		s=&state_stack[i];
+		reset_states(i);
+		if(fread(&depth,sizeof(int),1,in)!=1||depth<0) return -1;
+		while(s->maxstack<depth) s->stack=grow_states(s->stack,s->small_stack,&s->maxstack);
+		s->top_stack=depth;
+		if(fread(s->stack,sizeof(int),depth,in)!=(size_t)depth||fread(&depth,sizeof(int),1,in)!=1||depth<0) return -1;
+		while(s->maxqueue<depth) s->queue=grow_states(s->queue,s->small_queue,&s->maxqueue);
+		s->rear_queue=depth;
+		if(fread(s->queue,sizeof(int),depth,in)!=(size_t)depth
+			||fread(&part_agg[i],sizeof(Aggregate),1,in)!=1||fread(&part_offset[i],sizeof(long),1,in)!=1
+			||fread(&s->topput,sizeof(int),1,in)!=1||s->topput<0) return -1;
+		s->maxput=(s->topput>0)?s->topput:1;
+		s->output=(xml_Text*)malloc(s->maxput*sizeof(xml_Text));
+		offset=(long*)malloc(s->maxput*sizeof(long));
+		size=0;
+		max=INIT_OUTPUT;
+		buffFiles[i]=(char*)malloc(max);
+		for(j=0;j<s->topput;j++)
+		{
+			if(fread(&len,sizeof(int),1,in)!=1||len<0) break;
+			while(size+len>max)
+			{
+				max*=2;
+				buffFiles[i]=(char*)realloc(buffFiles[i],max);
 			}
-	    }
-	    if(t>n) break;
-	   usleep(10000);
-	}   
+			if(fread(buffFiles[i]+size,1,len,in)!=(size_t)len) break;
+			offset[j]=size;
+			s->output[j].len=len;
+			s->output[j].entity=(decodeMode==1&&find_amp(buffFiles[i]+size,len)<len);
+			size+=len;
+		}
+		for(k=0;k<j;k++)
+		{
+			s->output[k].p=buffFiles[i]+offset[k];  //buffFiles does not move any more
+		}
+		free(offset);
+		if(j<s->topput) return -1;
+		if(fread(&s->topfrag,sizeof(int),1,in)!=1||s->topfrag<0) return -1;
+		s->maxfrag=(s->topfrag>0)?s->topfrag:1;
+		s->frag=(Fragment*)malloc(s->maxfrag*sizeof(Fragment));
+		s->openfrag=NULL;
+		s->topopen=0;
+		if(fread(s->frag,sizeof(Fragment),s->topfrag,in)!=(size_t)s->topfrag||fread(&checked,sizeof(int),1,in)!=1) return -1;
+		c=&part_check[i];
+		memset(c,0,sizeof(TagCheck));
+		c->owned=1;
+		c->error=-1;
+		c->unfinished=-1;
+		if(checked==1)
+		{
+			if(fread(&c->error,sizeof(long),1,in)!=1||fread(c->reason,1,sizeof(c->reason),in)!=sizeof(c->reason)
+				||fread(&c->unfinished,sizeof(long),1,in)!=1||read_names(in,&c->close,&c->topclose)==-1
+				||read_names(in,&c->open,&c->topopen)==-1) return -1;
+			c->reason[sizeof(c->reason)-1]='\0';
+		}
+		else if(validateMode==1)
+		{
+			c->error=part_offset[i];
+			snprintf(c->reason,sizeof(c->reason),"the tags are not checked by the worker, please set the validate in its config");
+		}
+	}
+	return 0;
 }
 
 /*************************************************
-Function: void main_function();
-Description: main function for sequential version. 
+Function: int write_names(FILE* out, TagName* name, int count);
+Description: write the tags kept by a part for the validation into the summary: the number of tags, then the offset, the length 
+and the name of each tag
+Called By: int write_summary(FILE* out, long begin, long end, int count);
+Input: out--the file or pipe for the summary; name--the tags; count--the number of tags
+Return: 0--success
+*************************************************/
+int write_names(FILE* out, TagName* name, int count)
+{
+	int k;
+	fwrite(&count,sizeof(int),1,out);
+	for(k=0;k<count;k++)
+	{
+		fwrite(&name[k].at,sizeof(long),1,out);
+		fwrite(&name[k].len,sizeof(int),1,out);
+		fwrite(name[k].p,1,name[k].len,out);
+	}
+	return 0;
+}
+
+/*************************************************
+Function: int read_names(FILE* in, TagName** name, int* count);
+Description: read the tags kept by a part for the validation from the summary, each name is a copy
+Called By: int read_summary_parts(FILE* in, int first, int count);
+Input: in--the file or pipe of the summary
+Output: name--the tags; count--the number of tags
+Return: 0--success; -1--the summary is broken
+*************************************************/
+int read_names(FILE* in, TagName** name, int* count)
+{
+	int k;
+	if(fread(count,sizeof(int),1,in)!=1||*count<0) return -1;
+	*name=(TagName*)malloc((*count>0?*count:1)*sizeof(TagName));
+	for(k=0;k<*count;k++)
+	{
+		TagName* t=&(*name)[k];
+		if(fread(&t->at,sizeof(long),1,in)!=1||fread(&t->len,sizeof(int),1,in)!=1||t->len<0)
+		{
+			*count=k;  //the names read are freed with the check
+			return -1;
+		}
+		t->p=(char*)malloc(t->len>0?t->len:1);
+		if(fread(t->p,1,t->len,in)!=(size_t)t->len)
+		{
+			*count=k+1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*************************************************
+Function: int shard_main(char* file_name, int shards, int workers, int parts, char* summaries);
+Description: the coordinator of the sharded execution. The file is divided into shards byte ranges, each dealt with by a worker 
+process forked from this one, whose summary comes back through a pipe. With summaries, the summaries written by the workers(e.g on 
+other hosts with a shared filesystem) are merged instead. The summaries are put in document order by their ranges, and the mappings 
+of all the parts are merged by getresult() as if the parts were dealt with by the threads of one process. There is no fork or glob on 
+Windows, so only the summaries are merged there, given by @ with a file of names.
 Called By: int main(void);
+Input: file_name--the name for the xml file; shards--the number of worker processes; workers--the number of threads in each worker; 
+parts--the number of parts in each worker; summaries--a glob of the summary files, NULL--launch the workers
+Return: 0--success; -1--a worker failed or a summary is broken
 *************************************************/
-void main_function()
+int shard_main(char* file_name, int shards, int workers, int parts, char* summaries)
 {
-	printf("begin dealing with the state tree.\n");
-	int ret = 0;
-    xml_Text xml;
-    xml_Token token;               
-    int multiExp = 0; //0--single line explanation 1-- multiline explanation
-    int multiCDATA = 0; //0--single line CDATA 1-- multiline CDATA
-    int i=0;
-    int j;
-    state_stack[i].hasOutput=0;
-    state_stack[i].top_stack=0;
-    state_stack[i].rear_queue=0;
-    state_stack[i].topput=0;
-    state_stack[i].output=(char**)malloc(MAX_OUTPUT*sizeof(char*));
-	printf("State stack has been initialized.\n");
-    xml_initText(&xml,buffFiles[i]);
-    xml_initToken(&token, &xml);
-    ret = xml_process(&xml, &token, multiExp, multiCDATA, i);
-    free(buffFiles[i]);
-    if(ret==-1)
-    {
-    	printf("There is something wrong with your XML format, please check it!\n");
-    	printf("finish dealing with the state tree.\n");
-    	return;
+	FILE* in[MAX_PART];
+	long begin[MAX_PART],end[MAX_PART];
+	int count[MAX_PART],order[MAX_PART];
+	int i,j,k,first,ret=0;
+	ResultSet set;
+#ifdef _WIN32
+	FILE* list;
+	char line[MAX_LINE];
+	char* name;
+	if(summaries==NULL||summaries[0]!='@'||(list=fopen(summaries+1,"r"))==NULL) return -1;
+	shards=0;
+	while(shards<MAX_PART&&fgets(line,sizeof(line),list)!=NULL)
+	{
+		name=trim_value(line);
+		if(name[0]=='\0') continue;
+		in[shards]=fopen(name,"rb");
+		if(in[shards++]==NULL)
+		{
+			printf("The summary %s can not be opened.\n",name);
+			ret=-1;
+		}
 	}
-    finish_args[i]=1;
-    printf("finish dealing with the state tree.\n");
+	fclose(list);
+#else
+	long size;
+	pid_t pid[MAX_PART];
+	int fd[2],status;
+	struct stat st;
+	glob_t gl;
+	if(summaries!=NULL)
+	{
+		if(glob(summaries,0,NULL,&gl)!=0) return -1;
+		shards=(gl.gl_pathc>MAX_PART)?MAX_PART:gl.gl_pathc;
+		for(k=0;k<shards;k++)
+		{
+			in[k]=fopen(gl.gl_pathv[k],"rb");
+			pid[k]=-1;
+			if(in[k]==NULL)
+			{
+				printf("The summary %s can not be opened.\n",gl.gl_pathv[k]);
+				ret=-1;
+			}
+		}
+		globfree(&gl);
+	}
+	else
+	{
+		if(stat(file_name,&st)!=0) return -1;
+		size=st.st_size;
+		if(must_load(file_name))
+		{
+			shards=1;  //the ranges are in the decompressed(or transcoded) content, whose size is not known before
+		}
+		for(k=0;k<shards;k++)
+		{
+			if(pipe(fd)==-1) return -1;
+			fflush(stdout);  //the child must not print what is buffered again
+			pid[k]=fork();
+			if(pid[k]==0)
+			{
+				close(fd[0]);
+				for(j=0;j<k;j++)
+				{
+					if(in[j]!=NULL) close(fileno(in[j]));  //a worker must not keep the pipes of the others, which are closed early if a summary is broken
+				}
+				FILE* out=fdopen(fd[1],"wb");
+				status=shard_worker(file_name,(size/shards)*k,(k+1==shards)?0:(size/shards)*(k+1),out,workers,parts);
+				fclose(out);
+				fflush(stdout);
+				_exit(status==-1?1:0);
+			}
+			close(fd[1]);
+			in[k]=(pid[k]==-1)?NULL:fdopen(fd[0],"rb");
+			if(in[k]==NULL) ret=-1;
+		}
+	}
+#endif
+	/*read the beginning of the summaries and put them in document order*/
+	for(k=0;k<shards;k++)
+	{
+		order[k]=k;
+		begin[k]=0;
+		count[k]=0;
+		if(in[k]!=NULL&&read_summary_head(in[k],&begin[k],&end[k],&count[k])==-1)
+		{
+			printf("The summary of shard %d is broken.\n",k);
+			ret=-1;
+		}
+		for(j=k;j>0&&begin[order[j-1]]>begin[order[j]];j--)
+		{
+			i=order[j];
+			order[j]=order[j-1];
+			order[j-1]=i;
+		}
+	}
+	first=0;
+	for(j=0;j<shards&&ret==0;j++)
+	{
+		k=order[j];
+		if(j>0&&begin[k]!=end[order[j-1]])
+		{
+			printf("The shards do not cover the file from %ld to %ld, the mapping may be null.\n",end[order[j-1]],begin[k]);
+		}
+		if(first+count[k]>MAX_PART||read_summary_parts(in[k],first,count[k])==-1)
+		{
+			printf("The summary of shard %d is broken.\n",k);
+			ret=-1;
+			break;
+		}
+		first+=count[k];
+	}
+	for(k=0;k<shards;k++)
+	{
+		if(in[k]!=NULL) fclose(in[k]);
+#ifndef _WIN32
+		if(pid[k]>0&&(waitpid(pid[k],&status,0)==-1||!WIFEXITED(status)||WEXITSTATUS(status)!=0))
+		{
+			printf("The worker of shard %d failed.\n",k);
+			ret=-1;
+		}
+#endif
+	}
+	if(ret==-1) return -1;
+	printf("\nThe summaries of %d shards(%d parts) are merged.\n",shards,first);
+	set=getresult(first-1);
+	printf("The mappings for text.xml is:\n");
+	print_result(set,first-1);
+	if(aggKind!=agg_none)
+	{
+		print_aggregate(set,first-1);
+	}
+	free_result(&set);
+	if(fragmentMode==1)
+	{
+		stitch_fragments(first-1);
+		if(print_fragments(file_name,first-1)==-1)
+		{
+			printf("There are something wrong with the xml file, we can not map it for the fragments.\n");
+		}
+	}
+	if(validateMode==1)
+	{
+		init_check(&checkSet);
+		for(i=0;i<first;i++)
+		{
+			merge_check(&checkSet,i);
+		}
+		print_check(&checkSet);
+	}
+	for(i=0;i<first;i++)
+	{
+		free(buffFiles[i]);
+	}
+	return 0;
 }
 
 /*********************************************************************************************/
+#ifndef XPQ_LIBRARY  //the programs using the event API(XML_parallel.h) have their own main
 int main(void)
 {
 	struct timeval begin,end;
 	double duration;
     int ret = 0;
+    resultFile=stdout;
+    build_lexer();
    
     char * xpath_name=malloc(MAX_SIZE*sizeof(char));
     xpath_name=strcpy(xpath_name,"config");
     int choose=-1;
     int n=-1;
+    int workers=-1; //the number of threads
+    int parts=-1;   //the number of parts
+    FileSample sample;
+    char* codegen_name=NULL; //the C source of the specialized lexer to be generated
+    char* plugin_name=NULL;  //the plugin of the specialized lexer
+    char* columnList=NULL;   //the attributes in the columns after the output
+    char* namespaceList=NULL;//the prefixes of XPath and their URIs
     char* file_name=NULL;
     char* xmlPath=NULL;
     //read some parameters from config
 	FILE *fp;
-	char* buf=(char*)malloc(MAX_LINE*sizeof(char));
+	char* buf=NULL;
+	int bufSize=0;  //a line of config(e.g a long XPath) is read as a whole
 	char seps[] = "="; 
 	char *token_line=NULL; 
 	int line=0;
@@ -1256,7 +7794,7 @@ int main(void)
     	exit(1);
     }
     else{
-    	while(fgets(buf,MAX_LINE,fp) != NULL)
+    	while(read_config_line(&buf,&bufSize,fp) != -1)
     	{
     		token_line = strtok(buf, seps); 
     		if(strcmp(token_line,"File_Name")==0)
@@ -1264,35 +7802,223 @@ int main(void)
     			token_line=strtok(NULL,seps);
     			if(token_line!=NULL)
     			{
-    				file_name=malloc(MAX_SIZE*sizeof(char));
-    				file_name=strcpy(file_name,token_line);
+    				file_name=strdup(token_line);
     				file_name[strlen(file_name)-2]='\0';
 				}
 			}
-    		else if(strcmp(token_line,"XPath")==0)
-    		{
-    			token_line=strtok(NULL,seps);
-    			if(token_line!=NULL)
-    			{
-    				xmlPath=malloc(MAX_SIZE*sizeof(char));
-    				xmlPath=strcpy(xmlPath,token_line);
-    				xmlPath[strlen(xmlPath)-2]='\0';
+    		else if(strcmp(token_line,"File_List")==0)
+    		{
+    			token_line=strtok(NULL,"\n");
+    			if(token_line!=NULL)
+    			{
+    				batchFiles=strdup(trim_value(token_line));
+				}
+			}
+    		else if(strcmp(token_line,"XPath")==0)
+    		{
+    			token_line=strtok(NULL,"\n");  //the predicates could have '='
+    			if(token_line!=NULL)
+    			{
+    				xmlPath=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"version(0--sequential, 1--parallel)")==0||strcmp(token_line,"version(0--sequential, 1--parallel, 2--auto)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&choose);
+				}
+			}
+			else if(strcmp(token_line,"number-of-threads(no less than 1 and no more than 10)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&n);
+				}
+			}
+			else if(strcmp(token_line,"split-mode(0--equal bytes, 1--balanced by markup density)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&splitMode);
+				}
+			}
+			else if(strcmp(token_line,"output-mode(0--text, 1--whole element)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&fragmentMode);
+				}
+			}
+			else if(strcmp(token_line,"record-mode(0--off, 1--by delimiter, 2--by the end of each document)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&recordMode);
+				}
+			}
+			else if(strcmp(token_line,"record-delimiter")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					char *from=trim_value(token_line),*to=recordDelimiter;
+					for(;*from!='\0'&&to<recordDelimiter+MAX_LINE-1;from++,to++)  //\n and \t could be written as escapes
+					{
+						if(*from=='\\'&&from[1]=='n') {*to='\n'; from++;}
+						else if(*from=='\\'&&from[1]=='t') {*to='\t'; from++;}
+						else *to=*from;
+					}
+					*to='\0';
+				}
+			}
+			else if(strcmp(token_line,"limit(0--all the outputs)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&outputLimit);
+				}
+			}
+			else if(strcmp(token_line,"encoding-mode(0--raw bytes, 1--validate UTF-8 and transcode the others)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&encodingMode);
+				}
+			}
+			else if(strcmp(token_line,"line-numbers(0--off, 1--report the line and column)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&lineMode);
 				}
 			}
-			else if(strcmp(token_line,"version(0--sequential, 1--parallel)")==0)
+			else if(strcmp(token_line,"decode-entities(0--off, 1--decode the references of the outputs)")==0)
 			{
 				token_line=strtok(NULL,seps);
 				if(token_line!=NULL)
 				{
-					sscanf(token_line,"%d",&choose);
+					sscanf(token_line,"%d",&decodeMode);
 				}
 			}
-			else if(strcmp(token_line,"number-of-threads(no less than 1 and no more than 10)")==0)
+			else if(strcmp(token_line,"validate(0--off, 1--check the tags)")==0)
 			{
 				token_line=strtok(NULL,seps);
 				if(token_line!=NULL)
 				{
-					sscanf(token_line,"%d",&n);
+					sscanf(token_line,"%d",&validateMode);
+				}
+			}
+			else if(strcmp(token_line,"codegen-output")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					codegen_name=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"lexer-plugin")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					plugin_name=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"server-mode(0--off, 1--serve the queries, 2--send the query to the server)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&serverMode);
+				}
+			}
+			else if(strcmp(token_line,"server-socket")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					serverSocket=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"shard-mode(0--off, 1--worker, 2--coordinator)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&shardMode);
+				}
+			}
+			else if(strcmp(token_line,"number-of-shards")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&shardCount);
+				}
+			}
+			else if(strcmp(token_line,"shard-range")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%ld-%ld",&shardBegin,&shardEnd);
+				}
+			}
+			else if(strcmp(token_line,"column-output")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					columnFile=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"columns")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					columnList=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"namespaces")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					namespaceList=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"shard-output")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					shardOutput=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"shard-summaries")==0)
+			{
+				token_line=strtok(NULL,"\n");
+				if(token_line!=NULL)
+				{
+					shardSummaries=strdup(trim_value(token_line));
+				}
+			}
+			else if(strcmp(token_line,"perf-counters(0--off, 1--on)")==0)
+			{
+				token_line=strtok(NULL,seps);
+				if(token_line!=NULL)
+				{
+					sscanf(token_line,"%d",&perfMode);
 				}
 			}
 		}
@@ -1300,9 +8026,56 @@ int main(void)
 	free(buf);
 	fclose(fp);
 
+	if(serverMode!=0&&((serverMode!=1&&serverMode!=2)||serverSocket==NULL||serverSocket[0]=='\0'))
+	{
+		printf("The server-mode(0--off, 1--serve the queries, 2--send the query to the server) or the server-socket in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+#ifdef _WIN32
+	if(serverMode!=0)
+	{
+		printf("The query server is not supported on this system, please set the server-mode in config to 0.\n");
+		exit(1);
+	}
+#else
+	if(serverMode==1)
+	{
+		validateMode=0;  //the validation is for the whole file of one run
+		if((n<1)||(n>10)||outputLimit<0||(fragmentMode!=0&&fragmentMode!=1))
+		{
+			printf("The number-of-threads, limit or output-mode in config is not correct, please open the file and check it again!\n");
+			exit(1);
+		}
+		serverLimit=outputLimit;
+		serverFragment=fragmentMode;
+		inflateThreads=n;
+		if(server_main(serverSocket,n)==-1)
+		{
+			printf("The server can not listen on the server-socket %s in config, please check it again!\n",serverSocket);
+			exit(1);
+		}
+		return 0;
+	}
+	if(serverMode==2)
+	{
+		if(file_name==NULL||xmlPath==NULL)
+		{
+			printf("The File_Name and the XPath in config can not be empty, please open the file and check it again!\n");
+			exit(1);
+		}
+		if(query_server(serverSocket,file_name,xmlPath)==-1)
+		{
+			printf("The query can not be sent to the server on %s, please check whether the server is running.\n",serverSocket);
+			exit(1);
+		}
+		return 0;
+	}
+#endif
+
     //judge the version of program
-    printf("Welcome to the XML lexer program! Your file name is %s\n\n",file_name);
-    if(file_name==NULL)
+    if(batchFiles!=NULL) printf("Welcome to the XML lexer program! Your file list is %s\n\n",batchFiles);
+    else printf("Welcome to the XML lexer program! Your file name is %s\n\n",file_name);
+    if(file_name==NULL&&batchFiles==NULL)
     {
     	printf("The File_Name in config can not be empty, please open the file and check it again!\n");
     	exit(1);
@@ -1312,12 +8085,132 @@ int main(void)
 		printf("The XPath in config can not be empty, please open the file and check it again!\n");
     	exit(1);
 	}
-    if(choose!=0&&choose!=1)
+	char* xpathText=strdup(xmlPath);  //createAutoMachine cuts xmlPath into tokens
+	xmlPath=parse_aggregate(xmlPath);
+	if(xmlPath==NULL) exit(1);
+	if(outputLimit<0)
+	{
+		printf("The limit(0--all the outputs) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(fragmentMode!=0&&fragmentMode!=1)
+	{
+		printf("The output-mode(0--text, 1--whole element) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(aggKind!=agg_none)
+	{
+		outputLimit=0;  //an aggregation needs all the outputs
+		fragmentMode=0;
+	}
+	if(fragmentMode==1)
+	{
+		outputLimit=0;  //the limit counts the text outputs only
+	}
+	if(recordMode<0||recordMode>2||(recordMode==1&&recordDelimiter[0]=='\0'))
+	{
+		printf("The record-mode(0--off, 1--by delimiter, 2--by the end of each document) or the record-delimiter in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(encodingMode!=0&&encodingMode!=1)
+	{
+		printf("The encoding-mode(0--raw bytes, 1--validate UTF-8 and transcode the others) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(validateMode!=0&&validateMode!=1)
+	{
+		printf("The validate(0--off, 1--check the tags) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(lineMode!=0&&lineMode!=1)
+	{
+		printf("The line-numbers(0--off, 1--report the line and column) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(decodeMode!=0&&decodeMode!=1)
+	{
+		printf("The decode-entities(0--off, 1--decode the references of the outputs) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(validateMode==1)
+	{
+		outputLimit=0;  //all the tags of the file are checked
+	}
+	if(recordMode>0)
+	{
+		outputLimit=0;    //each record is output as a whole
+		fragmentMode=0;
+		validateMode=0;   //a record is checked by the engine as a small document
+		lineMode=0;
+	}
+	if(columnList!=NULL&&(columnFile==NULL||parse_columns(columnList)==-1))
+	{
+		printf("The columns(e.g @age,@sex, for the column-output) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(columnFile!=NULL&&(aggKind!=agg_none||recordMode>0||batchFiles!=NULL||serverMode!=0||shardMode!=0||strcmp(file_name,"-")==0))
+	{
+		printf("The column-output is only for the outputs of one file, so the outputs are printed as text instead.\n");
+		columnFile=NULL;
+		columnCount=0;
+	}
+	if(columnFile!=NULL)
+	{
+		fragmentMode=0;  //the columns are the text outputs
+	}
+	if(namespaceList!=NULL&&parse_namespaces(namespaceList)==-1)
+	{
+		printf("The namespaces(e.g ns=http://x.com/a, for the prefixes of XPath) in config is not correct, please open the file and check it again!\n");
+		exit(1);
+	}
+	if(nsPrefixCount>0&&(batchFiles!=NULL||serverMode!=0||shardMode!=0||strcmp(file_name,"-")==0))
+	{
+		printf("The namespaces are only for one file which is not read from stdin, so the steps are compared with the tag names instead.\n");
+	}
+	else if(nsPrefixCount>0)
+	{
+		nsMode=1;
+		if(outputLimit>0)
+		{
+			printf("The limit can not stop the lexing with the namespaces, since a prefix may be declared anywhere before a tag, so the whole file is lexed and only the first %d outputs are printed.\n",outputLimit);
+		}
+	}
+	if(codegen_name!=NULL)
+	{
+		if(createAutoMachine(xmlPath)==-1) exit(1);
+		if(generate_lexer(codegen_name,xpathText)==-1)
+		{
+			printf("The specialized lexer can not be written into %s, please check it again!\n",codegen_name);
+			exit(1);
+		}
+		printf("The lexer specialized for the XPath %s has been written into %s.\n",xpathText,codegen_name);
+		return 0;
+	}
+    if(choose!=0&&choose!=1&&choose!=2)
     {
-    	printf("The number of version(0--sequential, 1--parallel) in config is not correct, please open the file and check it again!\n");
+    	printf("The number of version(0--sequential, 1--parallel, 2--auto) in config is not correct, please open the file and check it again!\n");
     	exit(1);
 	}
 
+	if(shardMode!=0)
+	{
+		if((shardMode!=1&&shardMode!=2)||(shardMode==1&&shardOutput==NULL)||strcmp(file_name,"-")==0
+			||(shardMode==2&&shardSummaries==NULL&&(shardCount<1||shardCount*n>MAX_PART)))
+		{
+			printf("The shard-mode(0--off, 1--worker, 2--coordinator), number-of-shards, shard-range or shard-output in config is not correct, please open the file and check it again!\n");
+			exit(1);
+		}
+#ifdef _WIN32
+		if(shardMode==1||shardSummaries==NULL||shardSummaries[0]!='@')
+		{
+			printf("The shard workers can not be launched on this system, only the summaries given by shard-summaries=@ with a file of names are merged.\n");
+			exit(1);
+		}
+#endif
+		choose=1;       //the threads of each worker deal with its parts
+		recordMode=0;
+		lineMode=0;     //the coordinator merges the summaries without the content, only the offsets are reported
+	}
     if(choose==1)
 	{
         if((n<1)||(n>10))
@@ -1325,19 +8218,82 @@ int main(void)
     	    printf("The number-of-threads(no less than 1 and no more than 10) in config is not correct, please open the file and check it again!\n");
     	    exit(1);
 	    }
+	    workers=n;
+	    parts=n;
+	    if(outputLimit>0)
+	    {
+	    	parts=n*LIMIT_PARTS;  //the parts are confirmed in order, smaller parts stop sooner after the limit
+		}
+		if(shardMode!=0) parts=n;
+	}
+	if(choose==2||splitMode==1)
+	{
+		load_calibration(calibrationFile);
+	}
+	if(batchFiles!=NULL)
+	{
+		if(choose==0) workers=1;
+		else if(choose==2) workers=(n>=1&&n<=MAX_THREAD)?n:1;  //the files keep the threads busy, so the plan is not needed
+		outputLimit=0;  //the limit and the record mode are for one file
+		recordMode=0;
+		if(createAutoMachine(xmlPath)==-1) exit(1);
+		load_lexer(plugin_name==NULL?"":plugin_name,xpathText);
+		if(stateMachine[machineCount-1].outputAttr!=NULL||stateMachine[machineCount-1].textPredCount>0) fragmentMode=0;
+		inflateThreads=workers;
+		ret=batch_main(batchFiles,workers);
+		if(ret==-1)
+		{
+			printf("There is no file for the File_List %s in config, please open the file and check it again!\n",batchFiles);
+			exit(1);
+		}
+		return ret>0?1:0;
+	}
+	if(strcmp(file_name,"-")==0)
+	{
+		if(choose==2)
+		{
+			choose=1;  //stdin can't be sampled, the threads deal with the blocks as they are read
+			workers=(n>=1&&n<=MAX_THREAD)?n:1;
+			parts=workers;
+		}
+		stdinInput=(choose==1&&recordMode==0);
+		if(fragmentMode==1)
+		{
+			printf("The whole elements can not be output for stdin, which can not be mapped, so the text is output instead.\n");
+			fragmentMode=0;
+		}
+	}
+	if(choose==2)
+	{
+		if(sample_file(file_name,&sample)==-1)
+		{
+    	    printf("There are something wrong with the xml file, we can not load it. Please check whether it is placed in the right place.\n");
+    	    exit(1);
+		}
+		workers=n;
+		choose_plan(&sample,&choose,&workers,&parts);
+		choose+=2;  //2--auto sequential 3--auto parallel
+	}
+	if(choose==1||choose==3)
+	{
+		inflateThreads=workers;  //a compressed file is decompressed by the threads too
 	}
+	int streaming=(choose==1||choose==3)&&recordMode==0&&stdinInput==0&&shardMode==0&&stream_input(file_name); //1--a gzip file is inflated while the threads deal with it
 	//deal with the file
     printf("begin to split the file\n");
     gettimeofday(&begin,NULL);
-    if(choose==0){
-    	n=load_file(file_name);    //load file into memory
+    perf_start(&perf_split);
+    if(choose==0||choose==2||recordMode>0){
+    	n=load_file(file_name,0);    //load file into memory
 	}
-    else n=split_file(file_name,n);    //split file into several parts
+    else if(streaming==1||stdinInput==1||shardMode!=0) n=0;    //the parts are published by the decompression pipeline or the reader of stdin later, or dealt with by the shards
+    else n=split_file(file_name,parts,0);    //split file into several parts
+    perf_stop(&perf_split);
     printf("finish cutting the file!\n");
     gettimeofday(&end,NULL);   
     duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
     printf("The duration for spliting the file is %lf\n",duration/1000000);
-    sleep(1);
+    perf_print("the split phase",&perf_split);
         
     if(n==-1)
     {
@@ -1348,7 +8304,62 @@ int main(void)
 	printf("\nbegin to deal with XML file\n");
 	gettimeofday(&begin,NULL);
 
-    createAutoMachine(xmlPath);     //create automata by xmlpath
+    if(createAutoMachine(xmlPath)==-1) exit(1);     //create automata by xmlpath
+    load_lexer(plugin_name==NULL?"":plugin_name,xpathText);
+    if(nsMode==1)
+    {
+    	if(resolve_steps()==-1) exit(1);
+    	if(startMatcher!=NULL) printf("The tags are matched by their namespaces, so the matcher of the specialized lexer is not used.\n");
+	}
+    if(stateMachine[machineCount-1].outputAttr!=NULL||stateMachine[machineCount-1].textPredCount>0)
+    {
+    	fragmentMode=0;  //an attribute is not an element, and the text predicates are checked on the text output
+	}
+    if(columnCount>0)
+    {
+    	if(stateMachine[machineCount-1].outputAttr!=NULL)
+    	{
+    		printf("The columns are the attributes of the element whose text is output, so XPath can not output an attribute, please open the config and check it again!\n");
+    		exit(1);
+		}
+    	useAttributes=1;  //the lexer can not skip the attributes
+	}
+#ifndef _WIN32
+    if(shardMode==1)
+    {
+    	FILE* out=fopen(shardOutput,"wb");
+    	if(out==NULL||shard_worker(file_name,shardBegin,shardEnd,out,workers,parts)==-1)
+    	{
+    		printf("The summary of the range %ld-%ld can not be written into %s, please check the file and the shard-output.\n",shardBegin,shardEnd,shardOutput);
+    		exit(1);
+		}
+		fclose(out);
+		printf("The summary of the range %ld-%ld is written into %s.\n",shardBegin,shardEnd,shardOutput);
+		return 0;
+	}
+#endif
+    if(shardMode==2)
+    {
+    	if(shard_main(file_name,shardCount,workers,parts,shardSummaries)==-1)
+    	{
+    		printf("The shards can not be merged, please check the workers and the summaries.\n");
+    		exit(1);
+		}
+		gettimeofday(&end,NULL);
+		duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
+		printf("The duration for dealing with the file by the shards is %lf\n",duration/1000000);
+		return 0;
+	}
+    if(recordMode>0)
+    {
+    	if(record_main((choose==0||choose==2)?1:workers)==-1)
+    	{
+    		printf("There is no record in the xml file, please check the record-mode in config.\n");
+    		exit(1);
+		}
+		free(buffFiles[0]);
+		return 0;
+	}
     printf("The basic structure of the automata is (from to end):\n");
     int i,rc;
     char *out=" is an output";
@@ -1358,6 +8369,27 @@ int main(void)
     		printf("%d",stateMachine[i].start);
 		}
 		printf(" (str:%s",stateMachine[i].str);
+		int k;
+		char opName[7][3]={"","=","!=","<","<=",">",">="};
+		for(k=0;k<stateMachine[i].predCount;k++)
+		{
+			Predicate* pred=&stateMachine[i].pred[k];
+			if(pred->op==pred_exist) printf("[@%s]",pred->name);
+			else if(pred->numeric==1) printf("[@%s%s%s]",pred->name,opName[pred->op],pred->value);
+			else printf("[@%s%s\"%s\"]",pred->name,opName[pred->op],pred->value);
+		}
+		for(k=0;k<stateMachine[i].textPredCount;k++)
+		{
+			Predicate* pred=&stateMachine[i].textPred[k];
+			if(pred->op==pred_contains) printf("[contains(text(),\"%s\")]",pred->value);
+			else if(pred->op==pred_starts) printf("[starts-with(text(),\"%s\")]",pred->value);
+			else if(pred->numeric==1) printf("[text()%s%s]",opName[pred->op],pred->value);
+			else printf("[text()%s\"%s\"]",opName[pred->op],pred->value);
+		}
+		if(stateMachine[i].outputAttr!=NULL)
+		{
+			printf("/@%s",stateMachine[i].outputAttr);
+		}
 		if(stateMachine[i].isoutput==1)
 		{
 			printf("%s",out);
@@ -1376,13 +8408,31 @@ int main(void)
 		}	
 	}
 	printf("\n\n");
-	if(choose==0)
+	partCount=n+1;
+	nextPart=0;
+	if(streaming==1||stdinInput==1)
+	{
+		partCount=0;
+		streamInput=1;
+		inputDone=0;
+	}
+	if(stdinInput==1)
+	{
+		memset(&streamSet,0,sizeof(ResultSet));
+		memset(&streamTotal,0,sizeof(Aggregate));
+		if(validateMode==1) init_check(&checkSet);
+		lineRun=0;
+		columnRun=0;
+		printf("The outputs are printed in document order as the parts are merged:\n");
+	}
+	if(choose==0||choose==2)
 	{
 		main_function();
 	}
 	else
 	{
-		for(i=0;i<=n;i++)
+		if(workers>partCount&&streaming==0&&stdinInput==0) workers=partCount;
+		for(i=0;i<workers;i++)
         {
     	    thread_args[i]=i;
     	    finish_args[i]=0;
@@ -1393,19 +8443,135 @@ int main(void)
                 return EXIT_FAILURE;
             }
 	    }
-	    thread_wait(n);
+	    if(streaming==1)
+	    {
+	    	n=stream_parts(file_name,parts);   //inflate the file while the threads deal with the parts
+		}
+		else if(stdinInput==1)
+		{
+			n=stdin_parts();   //read stdin while the threads deal with the parts
+		}
+	    thread_wait(workers-1);
+	    if(n==-1&&stdinInput==1)
+	    {
+	    	printf("There is no XML from stdin, please check the input of the program.\n");
+	    	exit(1);
+		}
+	    if(n==-1)
+	    {
+	    	printf("There are something wrong with the compressed file, we can not inflate it.\n");
+	    	exit(1);
+		}
+	}
+	if(nsMode==1)
+	{
+		if(resolve_namespaces(partCount-1,workers)==-1)  //the parts which assumed other declarations before them are dealt with again
+		{
+			printf("There is something wrong with your XML format in the parts dealt with again by the namespaces, please check it!\n");
+			exit(1);
+		}
 	}
 	printf("\nfinish dealing with the file\n");
 	gettimeofday(&end,NULL);
     duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
     printf("The duration for dealing with the file is %lf\n",duration/1000000);
+    int tuned=(choose>=2&&streaming==0&&must_load(file_name)==0);  //the samples of a compressed or transcoded file are not its content
+    if(tuned==1)
+    {
+    	calibrate(&sample,choose-2,workers,partCount,duration/1000000);
+	}
+	else if(choose>=2)
+	{
+		printf("The file is compressed or transcoded, so its sample is not its content and the cost model is not calibrated by this run.\n");
+	}
+    if(splitMode==1&&(choose==1||choose==3)&&stdinInput==0)
+    {
+    	refine_split(partCount);
+	}
+	if(tuned==1||splitMode==1)
+	{
+    	save_calibration(calibrationFile);
+	}
+    if(perfMode==1)
+    {
+    	char phase[MAX_LINE];
+    	for(i=0;i<((choose==0||choose==2)?1:workers);i++)
+    	{
+    		sprintf(phase,"the process phase of thread %d",i);
+    		perf_print(phase,&perf_process[i]);
+		}
+	}
     printf("\n");
 	printf("All the subthread ended, now the program is merging its results.\n");
 	printf("begin to merge results\n");
 	gettimeofday(&begin,NULL);
-	ResultSet set=getresult(n);
+	if(stdinInput==1)
+	{
+		if(streamMerged==0) streamSet.begin=-1;
+		if(mergedParts<partCount)
+		{
+			printf("The first %d outputs are in the first %d parts, the other %d parts are skipped or cancelled.\n",outputLimit,mergedParts,partCount-mergedParts);
+		}
+		printf("The mappings for stdin is:\n");
+		if(streamFailed==0) print_result(streamSet,-1);  //the outputs have been printed as the parts were merged
+		if(aggKind!=agg_none)
+		{
+			print_total(streamSet.begin==-1?NULL:&streamTotal);
+		}
+		free_result(&streamSet);
+		if(validateMode==1) print_check(&checkSet);
+		printf("finish merging these results.\n");
+		gettimeofday(&end,NULL);
+		duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
+		printf("The duration for merging these results is %lf\n",duration/1000000);
+		return 0;
+	}
+	if(limitPart<partCount)
+	{
+		printf("The first %d outputs are in the first %d parts, the other %d parts are skipped or cancelled.\n",outputLimit,limitPart,partCount-limitPart);
+	}
+	if(lineMode==1) line_bases(0,limitPart<partCount?limitPart-1:n);
+	ResultSet set=getresult(limitPart<partCount?limitPart-1:n);
 	printf("The mappings for text.xml is:\n");
-	print_result(set,n);
+	if(columnFile!=NULL)
+	{
+		ret=write_columns(set,columnFile,limitPart<partCount?limitPart-1:n,(workers>=1)?workers:1);
+		if(ret==-1) printf("The columns can not be written into %s, please check it again!\n",columnFile);
+		else if(set.begin==-1) printf("The mapping for this part is null, so no output is written into %s.\n",columnFile);
+		else printf("The %d outputs are written into %s by %d columns.\n",ret,columnFile,columnCount+1);
+		ret=0;
+	}
+	else print_result(set,limitPart<partCount?limitPart-1:n);
+	if(aggKind!=agg_none)
+	{
+		print_aggregate(set,n);
+	}
+	free_result(&set);
+	if(fragmentMode==1)
+	{
+		stitch_fragments(n);
+		if(print_fragments(file_name,n)==-1)
+		{
+			printf("There are something wrong with the xml file, we can not map it for the fragments.\n");
+		}
+	}
+	if(validateMode==1)
+	{
+		init_check(&checkSet);
+		for(i=0;i<=n;i++)
+		{
+			merge_check(&checkSet,i);
+		}
+		print_check(&checkSet);
+	}
+	if(streaming==1)
+	{
+		for(i=0;i<=n;i++)
+		{
+			free(buffFiles[i]);  //the outputs are spans of these parts, each of them is inflated into its own buffer
+		}
+	}
+	else free(buffFiles[0]);  //the parts are spans of the content loaded by the first part
 	printf("finish merging these results.\n");
     gettimeofday(&end,NULL);
     duration=1000000*(end.tv_sec-begin.tv_sec)+end.tv_usec-begin.tv_usec; 
@@ -1414,3 +8580,4 @@ int main(void)
     //system("pause");
     return 0;
 }
+#endif
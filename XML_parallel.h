@@ -0,0 +1,58 @@
+/************************************************************
+Copyright (C).
+FileName: XML_parallel.h
+Author: Jack
+Version : V7.0
+Date: 10/18/2026
+Description: The event API for the programs(C or C++) embedding the lexer of XML_parallel.c. The content is divided into parts
+which are lexed in parallel, each part keeps its tokens as events, and the events are delivered in document order in batches
+of records held by one buffer, which is used again for each batch.
+Build: gcc -O2 -DXPQ_LIBRARY -c XML_parallel.c, then link XML_parallel.o with -lpthread -ldl -lz -lm(the program has no main).
+***********************************************************/
+#ifndef XML_PARALLEL_H
+#define XML_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*data structure for elements in XML file*/
+typedef enum {
+    xml_tt_U, /* Unknow */
+    xml_tt_H, /* XML Head <?xxx?>*/
+    xml_tt_E, /* End Tag </xxx> */
+    xml_tt_B, /* Start Tag <xxx> */
+    xml_tt_BE, /* Tag <xxx/> */
+    xml_tt_T, /* Content for the tag <aaa>xxx</aaa> */
+    xml_tt_C, /* Comment <!--xx-->*/
+    xml_tt_ATN, /* Attribute Name <xxx id="">*/
+    xml_tt_ATV, /* Attribute Value <xxx id="222">*/
+    xml_tt_CDATA/* <![CDATA[xxxxx]]>*/
+}
+xml_TokenType;
+
+/*data structure for an event: a token of the content. A start tag(xml_tt_B or xml_tt_BE) spans the whole tag and is followed by
+the names(without '=') and values(without the quotes) of its attributes; the others span the markup or the text as they are.*/
+typedef struct{
+	int type;    //xml_TokenType
+	int depth;   //the number of elements around the token, 0 for the root element(an attribute has the depth of its element)
+	long offset; //the offset of the token in the content
+	int len;     //the number of bytes of the token
+}XpqEvent;
+
+/*the consumer of the events: events--count events in document order(the buffer is used again after it returns); content--the
+content given to xpq_events(); user--the pointer given to xpq_events(). Return 0 to go on, or nonzero to stop.*/
+typedef int (*XpqEventHandler)(const XpqEvent* events, int count, const char* content, void* user);
+
+/*lex the content by threads(1 to 10) and deliver its events to handler in batches of batch events. handler is called on the calling
+thread, with the events of each part as soon as it and the parts before it are lexed, while the parts after it are still lexed. The 
+lexer keeps its state in the globals of XML_parallel.c, so one call runs at a time.
+Return: 0--all the events are delivered; 1--the handler stopped it; -1--the content is not correct XML(the events before the
+part with the error are delivered) or the arguments are not correct*/
+int xpq_events(const char* content, long size, int threads, int batch, XpqEventHandler handler, void* user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif